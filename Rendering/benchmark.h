@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <algorithm> // for std::sort
+#include <cmath> // for std::ceil
+#include <cstddef>
+#include <ostream>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+
+// Summary of a set of timing samples, in milliseconds
+struct SampleStatistics
+{
+    size_t count {0};
+    double min {0.0};
+    double avg {0.0};
+    double p50 {0.0};
+    double p99 {0.0};
+    double max {0.0};
+};
+
+// Samples collected while benchmarking a sequence of frames, in milliseconds
+struct BenchmarkSamples
+{
+    std::vector<double> cpuFrameTimes;
+    // CPU time spent preparing the frame's command buffer (recording it, or picking a pre-recorded one)
+    std::vector<double> cpuRecordTimes;
+    std::vector<double> gpuFrameTimes;
+    double totalSeconds {0.0};
+};
+
+// Nearest-rank percentile of samples already sorted in ascending order
+inline double percentile(const std::vector<double> & sortedSamples, double fraction)
+{
+    if(sortedSamples.empty())
+    {
+        return 0.0;
+    }
+
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sortedSamples.size()));
+    if(rank > 0)
+    {
+        rank--;
+    }
+    return sortedSamples[std::min(rank, sortedSamples.size() - 1)];
+}
+
+// Takes the samples by value, since they have to be sorted for the percentiles
+inline SampleStatistics computeStatistics(std::vector<double> samples)
+{
+    SampleStatistics statistics {};
+    if(samples.empty())
+    {
+        return statistics;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum {0.0};
+    for(double sample : samples)
+    {
+        sum += sample;
+    }
+
+    statistics.count = samples.size();
+    statistics.min = samples.front();
+    statistics.max = samples.back();
+    statistics.avg = sum / samples.size();
+    statistics.p50 = percentile(samples, 0.50);
+    statistics.p99 = percentile(samples, 0.99);
+
+    return statistics;
+}
+
+inline void writeStatisticsJson(std::ostream & out, const SampleStatistics & statistics)
+{
+    out << "{\"count\": " << statistics.count
+        << ", \"min\": " << statistics.min
+        << ", \"avg\": " << statistics.avg
+        << ", \"p50\": " << statistics.p50
+        << ", \"p99\": " << statistics.p99
+        << ", \"max\": " << statistics.max
+        << "}";
+}
+
+// Stream a report is written to: the file at path, or stdout when path is empty.
+// file holds the opened file, so it must outlive the returned stream.
+inline std::ostream & openReportStream(const std::string & path, std::ofstream & file)
+{
+    if(path.empty())
+    {
+        return std::cout;
+    }
+    file.open(path);
+    if(!file.is_open())
+    {
+        throw std::runtime_error("Failed to open benchmark output file " + path);
+    }
+    return file;
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <array>
+#include <stdexcept>
+#include <ostream>
+#include <algorithm> // for std::max
+#include <iterator> // for std::prev
+#include <string>
+
+// Part of a device memory block, handed out by GpuMemoryAllocator
+struct GpuAllocation
+{
+    VkDeviceMemory memory {VK_NULL_HANDLE};
+    VkDeviceSize offset {0};
+    VkDeviceSize size {0};
+    // Host address of the allocation if its memory is host visible, else nullptr.
+    // Host visible blocks are mapped once, for their whole lifetime.
+    void * mapped {nullptr};
+    uint32_t memoryTypeIndex {0};
+    // Pool and block the allocation was taken from. A dedicated allocation has no block.
+    uint32_t poolIndex {0};
+    void * block {nullptr};
+};
+
+// Memory usage of one memory heap
+struct GpuHeapStatistics
+{
+    // Bytes handed out in allocations
+    VkDeviceSize liveBytes {0};
+    VkDeviceSize peakLiveBytes {0};
+    // Bytes allocated from the device, in blocks and dedicated allocations
+    VkDeviceSize reservedBytes {0};
+    uint32_t allocationCount {0};
+    uint32_t deviceAllocationCount {0};
+    // Free ranges inside the blocks. Many small free ranges mean fragmented blocks.
+    uint32_t freeRangeCount {0};
+    VkDeviceSize freeBytes {0};
+    VkDeviceSize largestFreeRange {0};
+};
+
+// Sub-allocates buffers and images from large device memory blocks, instead of calling
+// vkAllocateMemory per resource, which is slow and limited to maxMemoryAllocationCount allocations.
+// There is one pool of blocks per memory type for linear resources (buffers, linear images)
+// and one for optimal tiling images, so bufferImageGranularity never has to be respected
+// between neighbouring allocations.
+class GpuMemoryAllocator
+{
+public:
+    // Resources at least half a block large get their own device memory
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE {64ull * 1024 * 1024};
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE)
+    {
+        this->device = device;
+        this->blockSize = blockSize;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        pools.clear();
+        pools.resize(2 * memoryProperties.memoryTypeCount);
+        heapStatistics.fill(GpuHeapStatistics {});
+    }
+
+    // Frees all device memory. Every allocation must have been freed or be unused by then.
+    void destroy()
+    {
+        for(Pool & pool : pools)
+        {
+            for(std::unique_ptr<Block> & block : pool.blocks)
+            {
+                vkFreeMemory(device, block->memory, nullptr);
+            }
+            pool.blocks.clear();
+        }
+    }
+
+    // linear is true for buffers and linear tiling images
+    GpuAllocation allocate(const VkMemoryRequirements & requirements, uint32_t memoryTypeIndex, bool linear)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        GpuAllocation allocation {};
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.size = requirements.size;
+        allocation.poolIndex = 2 * memoryTypeIndex + (linear ? 0 : 1);
+
+        if(requirements.size >= blockSize / 2)
+        {
+            allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIndex, allocation.mapped);
+            recordAllocation(allocation, requirements.size);
+            return allocation;
+        }
+
+        Pool & pool {pools[allocation.poolIndex]};
+        for(std::unique_ptr<Block> & block : pool.blocks)
+        {
+            if(allocateFromBlock(*block, requirements, allocation))
+            {
+                recordAllocation(allocation, 0);
+                return allocation;
+            }
+        }
+
+        std::unique_ptr<Block> block {std::make_unique<Block>()};
+        block->memory = allocateDeviceMemory(blockSize, memoryTypeIndex, block->mapped);
+        block->freeRanges[0] = blockSize;
+        pool.blocks.push_back(std::move(block));
+        if(!allocateFromBlock(*pool.blocks.back(), requirements, allocation))
+        {
+            throw std::runtime_error("Failed to sub-allocate memory from a new block.");
+        }
+        recordAllocation(allocation, blockSize);
+        return allocation;
+    }
+
+    void free(GpuAllocation & allocation)
+    {
+        if(allocation.memory == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock {mutex};
+
+        GpuHeapStatistics & statistics {heapStatistics[heapIndex(allocation.memoryTypeIndex)]};
+        statistics.liveBytes -= allocation.size;
+        statistics.allocationCount--;
+
+        if(allocation.block == nullptr)
+        {
+            // Dedicated allocation
+            vkFreeMemory(device, allocation.memory, nullptr);
+            statistics.reservedBytes -= allocation.size;
+            statistics.deviceAllocationCount--;
+            allocation = GpuAllocation {};
+            return;
+        }
+
+        Block & block {*static_cast<Block *>(allocation.block)};
+        block.allocationCount--;
+
+        // Return the range, merging it with the free ranges around it
+        VkDeviceSize offset {allocation.offset};
+        VkDeviceSize size {allocation.size};
+        std::map<VkDeviceSize, VkDeviceSize>::iterator next {block.freeRanges.lower_bound(offset)};
+        if(next != block.freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = block.freeRanges.erase(next);
+        }
+        if(next != block.freeRanges.begin())
+        {
+            std::map<VkDeviceSize, VkDeviceSize>::iterator previous {std::prev(next)};
+            if(previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                block.freeRanges.erase(previous);
+            }
+        }
+        block.freeRanges[offset] = size;
+
+        // Release empty blocks, but keep the pool's last block around for the next allocations
+        Pool & pool {pools[allocation.poolIndex]};
+        if(block.allocationCount == 0 && pool.blocks.size() > 1)
+        {
+            for(size_t i {0}; i < pool.blocks.size(); i++)
+            {
+                if(pool.blocks[i].get() == &block)
+                {
+                    vkFreeMemory(device, block.memory, nullptr);
+                    statistics.reservedBytes -= blockSize;
+                    statistics.deviceAllocationCount--;
+                    pool.blocks.erase(pool.blocks.begin() + i);
+                    break;
+                }
+            }
+        }
+
+        allocation = GpuAllocation {};
+    }
+
+    // Statistics of every heap, with the free ranges of the blocks counted at the time of the call
+    std::vector<GpuHeapStatistics> getStatistics()
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        std::vector<GpuHeapStatistics> statistics(heapStatistics.begin(), heapStatistics.begin() + memoryProperties.memoryHeapCount);
+        for(size_t poolIndex {0}; poolIndex < pools.size(); poolIndex++)
+        {
+            GpuHeapStatistics & heap {statistics[heapIndex(static_cast<uint32_t>(poolIndex / 2))]};
+            for(const std::unique_ptr<Block> & block : pools[poolIndex].blocks)
+            {
+                for(const std::pair<const VkDeviceSize, VkDeviceSize> & freeRange : block->freeRanges)
+                {
+                    heap.freeRangeCount++;
+                    heap.freeBytes += freeRange.second;
+                    heap.largestFreeRange = std::max(heap.largestFreeRange, freeRange.second);
+                }
+            }
+        }
+        return statistics;
+    }
+
+    void writeStatisticsJson(std::ostream & out, const std::string & indent)
+    {
+        std::vector<GpuHeapStatistics> statistics {getStatistics()};
+        out << "[\n";
+        for(size_t i {0}; i < statistics.size(); i++)
+        {
+            const GpuHeapStatistics & heap {statistics[i]};
+            // Share of the free bytes that can't be used by an allocation as large as the largest free range
+            double fragmentation {heap.freeBytes > 0 ? 1.0 - static_cast<double>(heap.largestFreeRange) / heap.freeBytes : 0.0};
+            out << indent << "  {\"heap\": " << i
+                << ", \"live_bytes\": " << heap.liveBytes
+                << ", \"peak_live_bytes\": " << heap.peakLiveBytes
+                << ", \"reserved_bytes\": " << heap.reservedBytes
+                << ", \"allocations\": " << heap.allocationCount
+                << ", \"device_allocations\": " << heap.deviceAllocationCount
+                << ", \"free_ranges\": " << heap.freeRangeCount
+                << ", \"largest_free_range\": " << heap.largestFreeRange
+                << ", \"fragmentation\": " << fragmentation
+                << "}" << (i + 1 < statistics.size() ? "," : "") << "\n";
+        }
+        out << indent << "]";
+    }
+
+private:
+    struct Block
+    {
+        VkDeviceMemory memory {VK_NULL_HANDLE};
+        void * mapped {nullptr};
+        // Offset to size of the free ranges, sorted by offset so neighbours can be merged
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+        uint32_t allocationCount {0};
+    };
+
+    struct Pool
+    {
+        std::vector<std::unique_ptr<Block>> blocks;
+    };
+
+    VkDevice device {VK_NULL_HANDLE};
+    VkDeviceSize blockSize {DEFAULT_BLOCK_SIZE};
+    VkPhysicalDeviceMemoryProperties memoryProperties {};
+    // Indexed by 2 * memory type index, + 1 for optimal tiling images
+    std::vector<Pool> pools;
+    std::array<GpuHeapStatistics, VK_MAX_MEMORY_HEAPS> heapStatistics {};
+    std::mutex mutex;
+
+    uint32_t heapIndex(uint32_t memoryTypeIndex) const
+    {
+        return memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    }
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void * & mapped)
+    {
+        VkMemoryAllocateInfo memoryAllocateInfo {};
+        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocateInfo.allocationSize = size;
+        memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory;
+        VkResult result {vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &memory)};
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate device memory.");
+        }
+
+        mapped = nullptr;
+        if(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+            if(result != VK_SUCCESS)
+            {
+                vkFreeMemory(device, memory, nullptr);
+                throw std::runtime_error("Failed to map device memory.");
+            }
+        }
+
+        return memory;
+    }
+
+    // First fit
+    bool allocateFromBlock(Block & block, const VkMemoryRequirements & requirements, GpuAllocation & allocation)
+    {
+        for(std::map<VkDeviceSize, VkDeviceSize>::iterator freeRange {block.freeRanges.begin()}; freeRange != block.freeRanges.end(); freeRange++)
+        {
+            VkDeviceSize rangeOffset {freeRange->first};
+            VkDeviceSize rangeEnd {rangeOffset + freeRange->second};
+            // Alignments are powers of two
+            VkDeviceSize alignedOffset {(rangeOffset + requirements.alignment - 1) & ~(requirements.alignment - 1)};
+            if(alignedOffset + requirements.size > rangeEnd)
+            {
+                continue;
+            }
+
+            // The padding before the allocation stays free
+            block.freeRanges.erase(freeRange);
+            if(alignedOffset > rangeOffset)
+            {
+                block.freeRanges[rangeOffset] = alignedOffset - rangeOffset;
+            }
+            if(alignedOffset + requirements.size < rangeEnd)
+            {
+                block.freeRanges[alignedOffset + requirements.size] = rangeEnd - (alignedOffset + requirements.size);
+            }
+
+            block.allocationCount++;
+            allocation.memory = block.memory;
+            allocation.offset = alignedOffset;
+            allocation.block = &block;
+            allocation.mapped = block.mapped != nullptr ? static_cast<char *>(block.mapped) + alignedOffset : nullptr;
+            return true;
+        }
+        return false;
+    }
+
+    void recordAllocation(const GpuAllocation & allocation, VkDeviceSize newDeviceBytes)
+    {
+        GpuHeapStatistics & statistics {heapStatistics[heapIndex(allocation.memoryTypeIndex)]};
+        statistics.liveBytes += allocation.size;
+        statistics.peakLiveBytes = std::max(statistics.peakLiveBytes, statistics.liveBytes);
+        statistics.allocationCount++;
+        if(newDeviceBytes > 0)
+        {
+            statistics.reservedBytes += newDeviceBytes;
+            statistics.deviceAllocationCount++;
+        }
+    }
+};
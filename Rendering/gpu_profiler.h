@@ -0,0 +1,335 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+// Timings of one named scope over the last frames, in milliseconds
+struct GpuScopeStatistics
+{
+    std::string name;
+    size_t samples;
+    double last;
+    double avg;
+    double min;
+    double max;
+};
+
+// GPU timings of named scopes of the command buffers, from timestamp queries.
+// Each frame in flight has its own query pool, which is reset at the start of its command buffer and
+// read back once the frame's fence has signaled, so reading never waits for the GPU.
+// Scopes are added while recording on one thread, but their timestamps can be written into
+// secondary command buffers recorded on other threads.
+class GpuProfiler
+{
+public:
+    // Scopes per frame, two timestamps each
+    static constexpr uint32_t MAX_SCOPES {16};
+    // Frames the rolling statistics cover
+    static constexpr size_t ROLLING_FRAMES {128};
+    // Frames kept for the trace, the oldest are dropped first
+    static constexpr size_t MAX_TRACE_FRAMES {1000};
+    // A scope which wasn't added, for instance because profiling is off. Writing its timestamps does nothing.
+    static constexpr uint32_t NO_SCOPE {UINT32_MAX};
+
+    // timestampPeriod is in nanoseconds per tick, validBits is the timestampValidBits of the queue family
+    void init(VkDevice device, uint32_t frameCount, float timestampPeriod, uint32_t validBits)
+    {
+        vkDevice = device;
+        nanosecondsPerTick = timestampPeriod;
+        validMask = validBits >= 64 ? UINT64_MAX : (uint64_t {1} << validBits) - 1;
+
+        frames.resize(frameCount);
+        for(Frame & frame : frames)
+        {
+            VkQueryPoolCreateInfo queryPoolCreateInfo {};
+            queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCreateInfo.queryCount = 2*MAX_SCOPES;
+
+            VkResult result = vkCreateQueryPool(vkDevice, &queryPoolCreateInfo, nullptr, &frame.queryPool);
+            if(result != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create timestamp query pool.");
+            }
+        }
+    }
+
+    void destroy()
+    {
+        for(Frame & frame : frames)
+        {
+            vkDestroyQueryPool(vkDevice, frame.queryPool, nullptr);
+        }
+        frames.clear();
+    }
+
+    // Resets the frame's queries and forgets its scopes. Must be recorded outside a render pass,
+    // before any of the frame's timestamps.
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+    {
+        frames[frame].scopeNames.clear();
+        vkCmdResetQueryPool(commandBuffer, frames[frame].queryPool, 0, 2*MAX_SCOPES);
+    }
+
+    // Adds a scope to the frame being recorded, and returns it, to write its timestamps
+    uint32_t addScope(uint32_t frame, const std::string & name)
+    {
+        std::vector<std::string> & scopeNames {frames[frame].scopeNames};
+        if(scopeNames.size() == MAX_SCOPES)
+        {
+            throw std::runtime_error("Too many GPU profiler scopes in one frame.");
+        }
+        scopeNames.push_back(name);
+        return static_cast<uint32_t>(scopeNames.size() - 1);
+    }
+
+    // The scope starts once the previous commands have reached the stage
+    void writeBegin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT) const
+    {
+        if(scope == NO_SCOPE)
+        {
+            return;
+        }
+        vkCmdWriteTimestamp(commandBuffer, stage, frames[frame].queryPool, 2*scope);
+    }
+
+    // The scope ends once the previous commands have completed the stage
+    void writeEnd(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT) const
+    {
+        if(scope == NO_SCOPE)
+        {
+            return;
+        }
+        vkCmdWriteTimestamp(commandBuffer, stage, frames[frame].queryPool, 2*scope + 1);
+    }
+
+    // Adds the scope and writes its start into the same command buffer
+    uint32_t beginScope(VkCommandBuffer commandBuffer, uint32_t frame, const std::string & name)
+    {
+        uint32_t scope {addScope(frame, name)};
+        writeBegin(commandBuffer, frame, scope);
+        return scope;
+    }
+
+    // Called once the frame's command buffer is submitted, so its results are read back by collect
+    void markSubmitted(uint32_t frame)
+    {
+        frames[frame].pending = true;
+    }
+
+    // Reads the timestamps of the frame's last submission, once its fence has signaled.
+    // Returns false if there was nothing to read or the results aren't available, which includes
+    // when the profiler wasn't initialized.
+    bool collect(uint32_t frame)
+    {
+        if(frame >= frames.size())
+        {
+            return false;
+        }
+        Frame & current {frames[frame]};
+        if(!current.pending || current.scopeNames.empty())
+        {
+            return false;
+        }
+        current.pending = false;
+
+        std::vector<uint64_t> timestamps(2*current.scopeNames.size());
+        VkResult result = vkGetQueryPoolResults(
+            vkDevice,
+            current.queryPool,
+            0,
+            static_cast<uint32_t>(timestamps.size()),
+            sizeof(uint64_t)*timestamps.size(),
+            timestamps.data(),
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT
+        );
+        if(result != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        if(!hasOrigin)
+        {
+            origin = timestamps[0] & validMask;
+            hasOrigin = true;
+        }
+        for(size_t scope {0}; scope < current.scopeNames.size(); scope++)
+        {
+            uint64_t begin {timestamps[2*scope] & validMask};
+            uint64_t end {timestamps[2*scope + 1] & validMask};
+            // Masked subtractions stay correct when the counter wraps
+            double milliseconds {ticksToMilliseconds((end - begin) & validMask)};
+            scopeHistory(current.scopeNames[scope]).push(milliseconds);
+
+            TraceEvent event {};
+            event.name = current.scopeNames[scope];
+            event.frame = collectedFrames;
+            event.startMicroseconds = ticksToMilliseconds((begin - origin) & validMask) * 1000.0;
+            event.durationMicroseconds = milliseconds * 1000.0;
+            traceEvents.push_back(event);
+        }
+        collectedFrames++;
+
+        // Drop the oldest frames of the trace
+        while(!traceEvents.empty() && collectedFrames - traceEvents.front().frame > MAX_TRACE_FRAMES)
+        {
+            traceEvents.pop_front();
+        }
+        return true;
+    }
+
+    // Duration of the scope in the last collected frame which had it, or a negative value if none did
+    double lastMilliseconds(const std::string & name) const
+    {
+        for(const ScopeHistory & history : histories)
+        {
+            if(history.name == name && !history.samples.empty())
+            {
+                return history.samples.back();
+            }
+        }
+        return -1.0;
+    }
+
+    // Statistics of every scope over the last ROLLING_FRAMES frames which had it, in order of first appearance
+    std::vector<GpuScopeStatistics> statistics() const
+    {
+        std::vector<GpuScopeStatistics> result;
+        for(const ScopeHistory & history : histories)
+        {
+            if(history.samples.empty())
+            {
+                continue;
+            }
+            GpuScopeStatistics statistics {history.name, history.samples.size(), history.samples.back(), 0.0, history.samples.front(), history.samples.front()};
+            for(double sample : history.samples)
+            {
+                statistics.avg += sample;
+                statistics.min = std::min(statistics.min, sample);
+                statistics.max = std::max(statistics.max, sample);
+            }
+            statistics.avg /= history.samples.size();
+            result.push_back(statistics);
+        }
+        return result;
+    }
+
+    // One line per scope, in milliseconds
+    void printStatistics(std::ostream & out) const
+    {
+        out << "GPU scopes over the last " << ROLLING_FRAMES << " frames (ms):" << std::endl;
+        for(const GpuScopeStatistics & scope : statistics())
+        {
+            out << "  " << scope.name << ": avg " << scope.avg << ", min " << scope.min << ", max " << scope.max << std::endl;
+        }
+    }
+
+    // Writes the statistics as a JSON object whose fields start at the given indent
+    void writeStatisticsJson(std::ostream & out, const std::string & indent) const
+    {
+        std::vector<GpuScopeStatistics> scopes {statistics()};
+        out << "{\n";
+        for(size_t i {0}; i < scopes.size(); i++)
+        {
+            out << indent << "  \"" << scopes[i].name << "\": {\"avg\": " << scopes[i].avg
+                << ", \"min\": " << scopes[i].min << ", \"max\": " << scopes[i].max
+                << ", \"frames\": " << scopes[i].samples << "}"
+                << (i + 1 < scopes.size() ? "," : "") << "\n";
+        }
+        out << indent << "}";
+    }
+
+    // Writes the kept frames in the Chrome trace event format, for chrome://tracing or Perfetto.
+    // Nested scopes show up nested, since they share the GPU track. Returns false if the file can't be written.
+    bool writeChromeTrace(const std::string & path) const
+    {
+        std::ofstream file {path, std::ios::trunc};
+        if(!file.is_open())
+        {
+            return false;
+        }
+        // Microseconds, with the full resolution of the timestamps however long the trace is
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"GPU\"}}";
+        for(const TraceEvent & event : traceEvents)
+        {
+            file << ",\n  {\"name\": \"" << event.name << "\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"
+                << ", \"ts\": " << event.startMicroseconds << ", \"dur\": " << event.durationMicroseconds
+                << ", \"args\": {\"frame\": " << event.frame << "}}";
+        }
+        file << "\n]}" << std::endl;
+        return static_cast<bool>(file);
+    }
+
+private:
+    struct Frame
+    {
+        VkQueryPool queryPool {VK_NULL_HANDLE};
+        // Scope i uses queries 2i and 2i + 1
+        std::vector<std::string> scopeNames;
+        bool pending {false};
+    };
+
+    struct ScopeHistory
+    {
+        std::string name;
+        std::deque<double> samples;
+
+        void push(double milliseconds)
+        {
+            samples.push_back(milliseconds);
+            if(samples.size() > ROLLING_FRAMES)
+            {
+                samples.pop_front();
+            }
+        }
+    };
+
+    struct TraceEvent
+    {
+        std::string name;
+        uint64_t frame;
+        double startMicroseconds;
+        double durationMicroseconds;
+    };
+
+    VkDevice vkDevice {VK_NULL_HANDLE};
+    float nanosecondsPerTick {1.0f};
+    uint64_t validMask {UINT64_MAX};
+    std::vector<Frame> frames;
+    std::vector<ScopeHistory> histories;
+    std::deque<TraceEvent> traceEvents;
+    uint64_t collectedFrames {0};
+    // First timestamp read, the start of the trace
+    uint64_t origin {0};
+    bool hasOrigin {false};
+
+    double ticksToMilliseconds(uint64_t ticks) const
+    {
+        return ticks * static_cast<double>(nanosecondsPerTick) / 1.0e6;
+    }
+
+    ScopeHistory & scopeHistory(const std::string & name)
+    {
+        for(ScopeHistory & history : histories)
+        {
+            if(history.name == name)
+            {
+                return history;
+            }
+        }
+        histories.push_back({name, {}});
+        return histories.back();
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // for memcpy
+
+// 64-bit hash of raw bytes (MurmurHash64A).
+// Reads 8 bytes at a time, so it is fast enough to hash whole asset files.
+inline uint64_t hashBytes(const void * key, size_t length, uint64_t seed = 0)
+{
+    const uint64_t m {0xc6a4a7935bd1e995ULL};
+    const int r {47};
+
+    uint64_t h {seed ^ (length * m)};
+
+    const unsigned char * data {static_cast<const unsigned char *>(key)};
+    const unsigned char * end {data + (length / 8) * 8};
+
+    while(data != end)
+    {
+        // memcpy instead of a cast, since data may not be aligned
+        uint64_t k;
+        memcpy(&k, data, sizeof(k));
+        data += sizeof(k);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    // Remaining bytes
+    switch(length & 7)
+    {
+        case 7: h ^= static_cast<uint64_t>(data[6]) << 48; [[fallthrough]];
+        case 6: h ^= static_cast<uint64_t>(data[5]) << 40; [[fallthrough]];
+        case 5: h ^= static_cast<uint64_t>(data[4]) << 32; [[fallthrough]];
+        case 4: h ^= static_cast<uint64_t>(data[3]) << 24; [[fallthrough]];
+        case 3: h ^= static_cast<uint64_t>(data[2]) << 16; [[fallthrough]];
+        case 2: h ^= static_cast<uint64_t>(data[1]) << 8; [[fallthrough]];
+        case 1:
+            h ^= static_cast<uint64_t>(data[0]);
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
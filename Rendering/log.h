@@ -0,0 +1,16 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+
+// Writes one line of progress to stderr with a single write, so the lines of tasks running at the same time
+// never interleave. Booleans are written as true or false.
+template<typename... Parts>
+void logLine(const Parts & ... parts)
+{
+    std::ostringstream line;
+    line << std::boolalpha;
+    (line << ... << parts);
+    line << '\n';
+    std::cerr << line.str();
+}
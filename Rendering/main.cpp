@@ -25,6 +25,26 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "libraries/tinyobjloader/tiny_obj_loader.h"
 #include <unordered_map>
+#include <string>
+#include "benchmark.h"
+#include "hash.h"
+#include "mesh_cache.h"
+#include "vertex_dedup.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
+#include "thread_pool.h"
+#include "gpu_allocator.h"
+#include "upload_context.h"
+#include "pipeline_cache.h"
+#include "texture_container.h"
+#include "texture_mips.h"
+#include "startup_timeline.h"
+#include "task_graph.h"
+#include "render_queue.h"
+#include "gpu_profiler.h"
+#include "log.h"
+#include <type_traits>
 
 // Validation layers
 const std::vector<const char*> validationLayers = {"VK_LAYER_KHRONOS_validation"};
@@ -40,10 +60,16 @@ struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // Family with transfer support but without graphics support, for uploads which overlap with rendering.
+    // Not every device has one, uploads then use the graphics family.
+    std::optional<uint32_t> transferFamily;
+
+    // Headless rendering doesn't present images, so it doesn't need a presentation family
+    bool presentationRequired {true};
 
     bool isComplete()
     {
-        return graphicsFamily.has_value() && presentFamily.has_value();
+        return graphicsFamily.has_value() && (presentFamily.has_value() || !presentationRequired);
     }
 };
 
@@ -107,6 +133,164 @@ struct Vertex
     }
 };
 
+// For the per-instance vertex buffer, read once per instance instead of once per vertex
+struct InstanceData
+{
+    glm::mat4 transform;
+    glm::vec4 tint;
+
+    static VkVertexInputBindingDescription getBindingDescription()
+    {
+        VkVertexInputBindingDescription bindingDescription {};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions {};
+
+        // A mat4 attribute takes one location per column
+        for(uint32_t column {0}; column < 4; column++)
+        {
+            attributeDescriptions[column].binding = 1;
+            attributeDescriptions[column].location = 3 + column;
+            attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[column].offset = offsetof(InstanceData, transform) + column*sizeof(glm::vec4);
+        }
+
+        attributeDescriptions[4].binding = 1;
+        attributeDescriptions[4].location = 7;
+        attributeDescriptions[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[4].offset = offsetof(InstanceData, tint);
+
+        return attributeDescriptions;
+    }
+};
+
+// Largest instance count of the instancing benchmark, which multiplies the count by 10 at each step
+const uint32_t INSTANCE_BENCHMARK_MAX {1000000};
+
+// Packed vertex: position and texture coordinate quantized to 16 bits inside the mesh's bounds, no color.
+// 12 bytes instead of the 32 bytes of Vertex.
+struct PackedVertex
+{
+    // xyz, w is padding, since 3 component 16 bit formats are rarely supported for vertex buffers
+    std::array<uint16_t, 4> pos;
+    std::array<uint16_t, 2> textureCoord;
+
+    static VkVertexInputBindingDescription getBindingDescription()
+    {
+        VkVertexInputBindingDescription bindingDescription {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    // Location 1, the color, comes from the push constants instead
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions {};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 2;
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_UNORM;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, textureCoord);
+
+        return attributeDescriptions;
+    }
+};
+
+// Push constants of the packed vertex shader, which turn the quantized attributes back into floats
+struct VertexDequantization
+{
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+    // xy offset, zw scale
+    glm::vec4 textureCoordOffsetScale;
+    // The color shared by all vertices
+    glm::vec4 color;
+};
+
+// Maps value in [offset, offset + scale*65535] to a 16 bit unsigned normalized integer
+inline uint16_t quantizeUnorm16(float value, float offset, float scale)
+{
+    if(scale <= 0.0f)
+    {
+        return 0;
+    }
+    float normalized {std::round((value - offset) / scale)};
+    return static_cast<uint16_t>(std::clamp(normalized, 0.0f, 65535.0f));
+}
+
+// Returns false, packing nothing, if the vertices don't all have the same color
+bool packVertices(
+    const Vertex * vertices,
+    uint32_t vertexCount,
+    std::vector<PackedVertex> & packedVertices,
+    VertexDequantization & dequantization
+)
+{
+    if(vertexCount == 0)
+    {
+        return false;
+    }
+
+    glm::vec3 positionMin {vertices[0].pos};
+    glm::vec3 positionMax {vertices[0].pos};
+    glm::vec2 textureCoordMin {vertices[0].textureCoord};
+    glm::vec2 textureCoordMax {vertices[0].textureCoord};
+    for(uint32_t i {0}; i < vertexCount; i++)
+    {
+        if(!(vertices[i].color == vertices[0].color))
+        {
+            return false;
+        }
+        for(int axis {0}; axis < 3; axis++)
+        {
+            positionMin[axis] = std::min(positionMin[axis], vertices[i].pos[axis]);
+            positionMax[axis] = std::max(positionMax[axis], vertices[i].pos[axis]);
+        }
+        for(int axis {0}; axis < 2; axis++)
+        {
+            textureCoordMin[axis] = std::min(textureCoordMin[axis], vertices[i].textureCoord[axis]);
+            textureCoordMax[axis] = std::max(textureCoordMax[axis], vertices[i].textureCoord[axis]);
+        }
+    }
+
+    glm::vec3 positionScale {(positionMax - positionMin) / 65535.0f};
+    glm::vec2 textureCoordScale {(textureCoordMax - textureCoordMin) / 65535.0f};
+    dequantization.positionOffset = glm::vec4(positionMin, 0.0f);
+    dequantization.positionScale = glm::vec4(positionScale, 0.0f);
+    dequantization.textureCoordOffsetScale = {textureCoordMin.x, textureCoordMin.y, textureCoordScale.x, textureCoordScale.y};
+    dequantization.color = glm::vec4(vertices[0].color, 1.0f);
+
+    packedVertices.resize(vertexCount);
+    for(uint32_t i {0}; i < vertexCount; i++)
+    {
+        for(int axis {0}; axis < 3; axis++)
+        {
+            packedVertices[i].pos[axis] = quantizeUnorm16(vertices[i].pos[axis], positionMin[axis], positionScale[axis]);
+        }
+        packedVertices[i].pos[3] = 0;
+        for(int axis {0}; axis < 2; axis++)
+        {
+            packedVertices[i].textureCoord[axis] = quantizeUnorm16(vertices[i].textureCoord[axis], textureCoordMin[axis], textureCoordScale[axis]);
+        }
+    }
+    return true;
+}
+
 namespace std
 {
     template <>
@@ -125,22 +309,409 @@ namespace std
     };
 }
 
+// 64-bit hash over the raw bytes of a vertex, for VertexDeduplicator
+struct VertexBytesHash
+{
+    uint64_t operator()(const Vertex & vertex) const
+    {
+        // Adding 0.0f turns -0.0f into +0.0f, so vertices which compare equal hash equally
+        Vertex canonical {
+            vertex.pos + 0.0f,
+            vertex.color + 0.0f,
+            vertex.textureCoord + 0.0f
+        };
+        return hashBytes(&canonical, sizeof(canonical));
+    }
+};
+
 // Model
 const std::string MODEL_PATH {"models/viking_room.obj"};
+// Where the material libraries named by the OBJ file are looked up
+const std::string MODEL_DIRECTORY {"models/"};
 const std::string TEXTURE_PATH {"textures/viking_room.png"};
+// Binary cache of the parsed model, rebuilt when the OBJ file or its material libraries change
+const std::string MESH_CACHE_PATH {"models/viking_room.meshcache"};
+// Block compressed texture, written by --compress-texture and used when it was made from the current TEXTURE_PATH
+const std::string TEXTURE_CONTAINER_PATH {"textures/viking_room.vktex"};
+
+// Compiled pipelines, kept between runs
+const std::string PIPELINE_CACHE_PATH {"pipeline_cache.bin"};
+
+// The mesh cache stores the vertices as raw bytes
+static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex must be trivially copyable");
+
+// Builds the vertex referenced by an index of an OBJ face
+Vertex objVertex(const tinyobj::attrib_t & attrib, const tinyobj::index_t & index)
+{
+    Vertex vertex {};
+
+    vertex.pos = {
+        attrib.vertices[3*index.vertex_index],
+        attrib.vertices[3*index.vertex_index + 1],
+        attrib.vertices[3*index.vertex_index + 2]
+    };
+
+    vertex.textureCoord = {
+        attrib.texcoords[2*index.texcoord_index],
+        1.0f - attrib.texcoords[2*index.texcoord_index+1]
+    };
+
+    vertex.color = {1.0f, 1.0f, 1.0f};
+
+    return vertex;
+}
+
+size_t objIndexCount(const std::vector<tinyobj::shape_t> & shapes)
+{
+    size_t indexCount {0};
+    for(const tinyobj::shape_t & shape : shapes)
+    {
+        indexCount += shape.mesh.indices.size();
+    }
+    return indexCount;
+}
+
+// File names of the material libraries of an OBJ file, from its mtllib lines, relative to MODEL_DIRECTORY
+std::vector<std::string> objMaterialLibraries(const unsigned char * data, size_t size)
+{
+    std::vector<std::string> libraries;
+    const char * text {reinterpret_cast<const char *>(data)};
+    size_t lineStart {0};
+    while(lineStart < size)
+    {
+        size_t lineEnd {lineStart};
+        while(lineEnd < size && text[lineEnd] != '\n' && text[lineEnd] != '\r')
+        {
+            lineEnd++;
+        }
+
+        // Whitespace separated tokens, the first being the keyword
+        std::vector<std::string> tokens;
+        size_t position {lineStart};
+        while(position < lineEnd)
+        {
+            while(position < lineEnd && (text[position] == ' ' || text[position] == '\t'))
+            {
+                position++;
+            }
+            size_t tokenStart {position};
+            while(position < lineEnd && text[position] != ' ' && text[position] != '\t')
+            {
+                position++;
+            }
+            if(position > tokenStart)
+            {
+                tokens.emplace_back(text + tokenStart, position - tokenStart);
+            }
+        }
+        if(!tokens.empty() && tokens[0] == "mtllib")
+        {
+            libraries.insert(libraries.end(), tokens.begin() + 1, tokens.end());
+        }
+        lineStart = lineEnd + 1;
+    }
+    return libraries;
+}
+
+// Material id of each triangle, in the order weldObjVertices writes them, -1 for the triangles without one.
+// LoadObj triangulates the faces.
+std::vector<int> objTriangleMaterials(const std::vector<tinyobj::shape_t> & shapes)
+{
+    std::vector<int> triangleMaterials;
+    triangleMaterials.reserve(objIndexCount(shapes) / 3);
+    for(const tinyobj::shape_t & shape : shapes)
+    {
+        triangleMaterials.insert(triangleMaterials.end(), shape.mesh.material_ids.begin(), shape.mesh.material_ids.end());
+    }
+    return triangleMaterials;
+}
+
+// Range of indices of one shape, welded by one task
+struct ObjIndexRange
+{
+    const tinyobj::shape_t * shape;
+    size_t begin;
+    size_t end;
+    // Position of the range's first index in the welded index array
+    size_t offset;
+};
+
+// Builds the vertices of all shapes and welds identical ones together.
+// Unique vertices are appended to vertices in order of first occurrence, so the result doesn't
+// depend on the number of threads.
+void weldObjVertices(
+    const tinyobj::attrib_t & attrib,
+    const std::vector<tinyobj::shape_t> & shapes,
+    ThreadPool & threadPool,
+    std::vector<Vertex> & vertices,
+    std::vector<uint32_t> & vertexIndices
+)
+{
+    size_t indexCount {objIndexCount(shapes)};
+
+    // A few ranges per thread, to balance the load, but not so small that the merge dominates
+    const size_t MIN_RANGE_SIZE {1 << 16};
+    size_t rangeSize {std::max(MIN_RANGE_SIZE, indexCount / (4 * threadPool.threadCount()) + 1)};
+
+    if(threadPool.threadCount() == 1 || indexCount <= rangeSize)
+    {
+        vertexIndices.reserve(indexCount);
+
+        // The index count is an upper bound of the unique vertices, so the table never grows
+        VertexDeduplicator<Vertex, VertexBytesHash> deduplicator {vertices, indexCount};
+        for(const tinyobj::shape_t & shape : shapes)
+        {
+            for(const tinyobj::index_t & index : shape.mesh.indices)
+            {
+                vertexIndices.push_back(deduplicator.insert(objVertex(attrib, index)));
+            }
+        }
+        return;
+    }
+
+    std::vector<ObjIndexRange> ranges;
+    size_t offset {0};
+    for(const tinyobj::shape_t & shape : shapes)
+    {
+        size_t shapeIndexCount {shape.mesh.indices.size()};
+        for(size_t begin {0}; begin < shapeIndexCount; begin += rangeSize)
+        {
+            size_t end {std::min(begin + rangeSize, shapeIndexCount)};
+            ranges.push_back({&shape, begin, end, offset});
+            offset += end - begin;
+        }
+    }
+
+    // Weld each range on its own. vertexIndices first holds the indices into the range's vertices.
+    std::vector<std::vector<Vertex>> rangeVertices(ranges.size());
+    size_t firstIndex {vertexIndices.size()};
+    vertexIndices.resize(firstIndex + indexCount);
+    threadPool.parallelFor(ranges.size(), [&](size_t r)
+    {
+        const ObjIndexRange & range {ranges[r]};
+        VertexDeduplicator<Vertex, VertexBytesHash> deduplicator {rangeVertices[r], range.end - range.begin};
+        uint32_t * indices {vertexIndices.data() + firstIndex + range.offset};
+        for(size_t i {range.begin}; i < range.end; i++)
+        {
+            *indices++ = deduplicator.insert(objVertex(attrib, range.shape->mesh.indices[i]));
+        }
+    });
+
+    // Merge the ranges in order. A vertex is first added by the first range containing it,
+    // at its first position in that range, which gives the same order as welding serially.
+    size_t rangeVertexCount {0};
+    for(const std::vector<Vertex> & rangeVertex : rangeVertices)
+    {
+        rangeVertexCount += rangeVertex.size();
+    }
+    std::vector<std::vector<uint32_t>> remaps(ranges.size());
+    VertexDeduplicator<Vertex, VertexBytesHash> deduplicator {vertices, rangeVertexCount};
+    for(size_t r {0}; r < ranges.size(); r++)
+    {
+        remaps[r].reserve(rangeVertices[r].size());
+        for(const Vertex & vertex : rangeVertices[r])
+        {
+            remaps[r].push_back(deduplicator.insert(vertex));
+        }
+        rangeVertices[r] = {};
+    }
+
+    // Translate the range indices into indices into vertices
+    threadPool.parallelFor(ranges.size(), [&](size_t r)
+    {
+        const ObjIndexRange & range {ranges[r]};
+        const std::vector<uint32_t> & remap {remaps[r]};
+        uint32_t * indices {vertexIndices.data() + firstIndex + range.offset};
+        for(size_t i {0}; i < range.end - range.begin; i++)
+        {
+            indices[i] = remap[indices[i]];
+        }
+    });
+}
 
+// Per-frame camera block
 struct UniformBufferObject
 {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
 };
 
+// Per-object block, one per object in the object uniform ring, selected with a dynamic offset
+struct ObjectUniformBufferObject
+{
+    glm::mat4 model;
+    // Slot of the object's texture in the bindless texture array
+    uint32_t textureIndex;
+    uint32_t padding[3];
+};
+
+// Per-material block, one per material, each at a multiple of minUniformBufferOffsetAlignment
+struct MaterialUniformBufferObject
+{
+    glm::vec4 diffuse;
+};
+
+// Distance between neighbouring objects, which are placed on a grid
+const float OBJECT_SPACING {2.5f};
+
+// Number of columns (and rows) of the smallest square grid holding count items
+inline uint32_t squareGridSide(uint32_t count)
+{
+    return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+}
+
+// Square ring around the origin which holds the grid cell of the index, when cells are numbered ring by ring.
+// Ring r holds 8r cells, so the first N cells always fill a square around the origin, whatever N is.
+inline uint32_t squareRing(uint32_t index)
+{
+    uint32_t ring {0};
+    while(static_cast<uint64_t>(2*ring + 1) * (2*ring + 1) <= index)
+    {
+        ring++;
+    }
+    return ring;
+}
+
+// Cell of the index on the rings of squareRing, relative to the origin
+inline glm::ivec2 squareRingCell(uint32_t index)
+{
+    int32_t ring {static_cast<int32_t>(squareRing(index))};
+    if(ring == 0)
+    {
+        return {0, 0};
+    }
+    // Walk the four sides of the ring counterclockwise, each 2r cells long
+    uint32_t step {index - static_cast<uint32_t>((2*ring - 1) * (2*ring - 1))};
+    int32_t side {static_cast<int32_t>(step / (2*ring))};
+    int32_t t {static_cast<int32_t>(step % (2*ring))};
+    switch(side)
+    {
+        case 0: return {ring, -ring + 1 + t};
+        case 1: return {ring - 1 - t, ring};
+        case 2: return {-ring, ring - 1 - t};
+        default: return {-ring + 1 + t, -ring};
+    }
+}
+
+// Vertical field of view and near plane of the camera
+const float CAMERA_FIELD_OF_VIEW {glm::radians(45.0f)};
+const float CAMERA_NEAR {0.1f};
+
+// Levels of detail generated for the model, the full detail one included
+const size_t MAX_MESH_LODS {5};
+
+// Size of the bindless texture array, unless the device allows fewer update after bind samplers
+const uint32_t MAX_BINDLESS_TEXTURES {4096};
+// Stop generating levels of detail once a level removes less than this fraction of the triangles
+const float MIN_LOD_REDUCTION {0.1f};
+
+// Push constants of the culling compute shader
+struct CullPushConstants
+{
+    uint32_t instanceCount;
+    // Radius of the sphere around an instance's origin that bounds all its objects
+    float boundingRadius;
+};
+
+// Must match local_size_x in cull.comp
+const uint32_t CULL_WORKGROUP_SIZE {64};
+
+// Command line options
+struct ApplicationOptions
+{
+    // Render into offscreen images instead of a window, for a fixed number of frames,
+    // and report frame time statistics as JSON
+    bool headless {false};
+    uint32_t benchmarkFrames {1000};
+    uint32_t warmupFrames {60};
+    // Where to write the JSON report. If empty, it is written to the standard output.
+    std::string benchmarkOutputPath;
+    // Record the command buffers once, instead of re-recording them every frame
+    bool prerecordCommandBuffers {false};
+    // Load the model from the binary mesh cache when it is up to date
+    bool useMeshCache {true};
+    // Only benchmark the vertex deduplication of the model, without creating a window or device
+    bool benchmarkDedup {false};
+    // Only optimize the given OBJ file's mesh and report its vertex cache statistics, without creating a window or device
+    std::string meshReportPath;
+    // Only compress the texture into TEXTURE_CONTAINER_PATH with this encoding (bc1, bc3, bc7 or rgba8),
+    // without creating a window or device
+    std::string compressTextureEncoding;
+    // Load the texture from TEXTURE_CONTAINER_PATH when it is up to date
+    bool useTextureContainer {true};
+    // Number of copies of the model, each drawn with its own transform
+    uint32_t objectCount {1};
+    // Number of instances of each object, drawn with a single instanced draw
+    uint32_t instanceCount {1};
+    // Headless benchmark of instanced drawing, from 1 instance up to INSTANCE_BENCHMARK_MAX
+    bool benchmarkInstances {false};
+    // Cull the instances against the view frustum in a compute pass, and draw the visible ones indirectly
+    bool useGpuCulling {true};
+    // Upload the vertices in the quantized PackedVertex format
+    bool packedVertices {false};
+    // Use 16 bit indices, splitting the mesh into sub-meshes if it has too many vertices
+    bool shortIndices {true};
+    // Split the full detail mesh into meshlets, and only draw those inside the view frustum and facing the camera.
+    // Replaces the GPU instance culling.
+    bool meshlets {false};
+    // Sample the textures from one descriptor array, indexed per object and bound once per command buffer.
+    // Needs descriptor indexing, otherwise the single texture binding is used.
+    bool bindless {false};
+    // Bindless texture slots to fill, with object i sampling slot i % bindlessTextureCount.
+    // The scene has one texture, so every slot holds it.
+    uint32_t bindlessTextureCount {1};
+    // Draw each object with the coarsest level of detail whose error projects to fewer pixels than this.
+    // 0 always draws the full detail mesh.
+    float lodThreshold {1.0f};
+    // Split the object draws into this many secondary command buffers, recorded on the thread pool. 0 records inline.
+    uint32_t recordThreadCount {0};
+    // Headless benchmark of the command buffer recording time, with 1, 2, 4, ... recording threads
+    bool benchmarkRecording {false};
+    // Load and save the pipeline cache file
+    bool usePipelineCache {true};
+    // Upload on a dedicated transfer queue family when the device has one
+    bool useTransferQueue {true};
+    // Size of the staging ring used by all uploads. Larger uploads are split into chunks.
+    uint32_t stagingRingKilobytes {16 * 1024};
+    // Worker threads for loading. 0 uses one per hardware thread.
+    uint32_t threadCount {0};
+    // Time the GPU scopes of each frame in windowed mode too, and print their statistics on exit
+    bool gpuProfile {false};
+    // Where to write the GPU scopes of the last frames as a Chrome trace on exit. Empty writes none.
+    std::string gpuTracePath;
+};
+
+// Format used for the offscreen color images in headless mode
+const VkFormat OFFSCREEN_IMAGE_FORMAT {VK_FORMAT_R8G8B8A8_SRGB};
+
 class HelloTriangleApplication
 {
 private:
+    ApplicationOptions options;
+
+    // Startup work, timed from the creation of the application
+    StartupTimeline startupTimeline;
+
+    // Texture files read and decoded on the thread pool while the device is created
+    struct DecodedTexture
+    {
+        // The container, when it was made from the current texture image
+        MappedFile containerFile;
+        TextureContainerView container {};
+        bool hasContainer {false};
+        // Otherwise the decoded image, in RGBA8
+        std::vector<uint8_t> pixels;
+        uint32_t width {0};
+        uint32_t height {0};
+    };
+    DecodedTexture decodedTexture;
+
+    // Worker threads for CPU side loading work.
+    // Declared after what the tasks write to, so the workers are joined before it is destroyed.
+    ThreadPool threadPool;
+
     // GLFWwindow
-    GLFWwindow * window;
+    GLFWwindow * window {nullptr};
     const uint32_t WIDTH {800};
     const uint32_t HEIGHT {600};
 
@@ -165,11 +736,21 @@ private:
     // Presentation queue
     VkQueue presentQueue;
 
+    // Transfer queue, the graphics queue if the device has no dedicated transfer family
+    VkQueue transferQueue;
+
+    // Batches the texture and mesh uploads
+    UploadContext uploadContext;
+    VkBuffer stagingRingBuffer;
+    GpuAllocation stagingRingAllocation;
+
     // Swap chain
     VkSwapchainKHR swapChain;
 
     // Images
+    // In headless mode these are offscreen images owned by the application, not by a swap chain
     std::vector<VkImage> swapChainImages;
+    std::vector<GpuAllocation> offscreenImagesAllocations;
 
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
@@ -180,8 +761,9 @@ private:
     // Render pass
     VkRenderPass renderPass;
 
-    // Descriptor set layout
+    // Descriptor set layouts: set 0 for the per-frame data, set 1 for the per-object data
     VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorSetLayout objectDescriptorSetLayout;
 
     // Pipeline layout
     VkPipelineLayout pipelineLayout;
@@ -189,6 +771,12 @@ private:
     // Pipeline
     VkPipeline pipeline;
 
+    // Pipeline cache, loaded at startup and saved at cleanup
+    VkPipelineCache pipelineCache {VK_NULL_HANDLE};
+    // How the pipeline cache was created: "loaded", "empty", "rejected" or "disabled"
+    std::string pipelineCacheState {"disabled"};
+    double pipelineCreationMilliseconds {0.0};
+
     // Framebuffers
     std::vector<VkFramebuffer> swapChainFramebuffers;
 
@@ -198,6 +786,13 @@ private:
     // Command buffer
     std::vector<VkCommandBuffer> commandBuffers;
 
+    // Pre-recorded command buffers, one per (frame in flight, swap chain image) pair,
+    // stored at index frame*swapChainImages.size() + imageIndex.
+    // Everything they use is the same every frame, except the uniform buffer contents,
+    // so they only have to be recorded again when the swap chain is recreated.
+    bool usePrerecordedCommandBuffers {false};
+    std::vector<VkCommandBuffer> prerecordedCommandBuffers;
+
     // Syncing
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
@@ -209,53 +804,193 @@ private:
     // Frame flight
     uint32_t currentFrame {0};
 
-    // Vertices data
+    // Vertices data, only filled when the OBJ file has to be parsed
     std::vector<Vertex> vertices;
     std::vector<uint32_t> vertexIndices;
+    // Memory mapped mesh cache
+    MappedFile meshCacheFile;
+    // Mesh to upload, points either into meshCacheFile or into vertices and vertexIndices
+    const Vertex * meshVertices {nullptr};
+    uint32_t meshVertexCount {0};
+    const uint32_t * meshIndices {nullptr};
+    // Indices of all the levels of detail
+    uint32_t meshIndexCount {0};
+    // Levels of detail, finest first, each a range of the mesh indices
+    std::vector<MeshCacheLod> meshLods;
+    // At least one material, the first one for the triangles without any when there are some
+    std::vector<MeshCacheMaterial> meshMaterials;
+    // The index range of material m in level of detail l is meshMaterialRanges[l*meshMaterials.size() + m]
+    std::vector<MeshCacheMaterialRange> meshMaterialRanges;
+    // Radius of the sphere around the model origin bounding the mesh
+    float meshBoundingRadius {0.0f};
+
+    // Device memory for all buffers and images
+    GpuMemoryAllocator gpuAllocator;
 
     // Vertex buffer
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    GpuAllocation vertexBufferAllocation;
 
     // Index buffer
     VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
+    VkIndexType meshIndexType {VK_INDEX_TYPE_UINT32};
+    // Each sub-mesh is drawn on its own, with a single material.
+    // With 32 bit indices, one per material of each level of detail which has triangles of it.
+    std::vector<SubMesh> subMeshes;
+    // The sub-meshes of level of detail l are [lodFirstSubMesh[l], lodFirstSubMesh[l + 1])
+    std::vector<uint32_t> lodFirstSubMesh;
+    std::vector<uint16_t> shortIndices;
+    GpuAllocation indexBufferAllocation;
 
     // Uniform buffers
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<GpuAllocation> uniformBuffersAllocations;
     std::vector<void *> uniformBuffersMapped;
 
+    // Object uniform ring: for each frame in flight, one ObjectUniformBufferObject per object,
+    // each at a multiple of minUniformBufferOffsetAlignment
+    VkBuffer objectUniformBuffer;
+    GpuAllocation objectUniformAllocation;
+    VkDeviceSize objectUniformStride;
+    VkDeviceSize objectUniformFrameSize;
+    VkDescriptorSet objectDescriptorSet;
+    std::vector<glm::vec3> objectPositions;
+
+    // One MaterialUniformBufferObject per material, never changed, and one descriptor set for each
+    VkDescriptorSetLayout materialDescriptorSetLayout;
+    VkBuffer materialUniformBuffer;
+    GpuAllocation materialUniformAllocation;
+    VkDeviceSize materialUniformStride;
+    std::vector<VkDescriptorSet> materialDescriptorSets;
+
+    // Draws of the recorded frame, sorted by state, and the binds they needed
+    std::vector<DrawItem> renderQueue;
+    DrawStateChanges drawStateChanges;
+
+    // Per-instance transforms and tints, shared by all objects
+    VkBuffer instanceBuffer;
+    GpuAllocation instanceBufferAllocation;
+    uint32_t instanceCapacity;
+    // Instances drawn per object, changed by the instancing benchmark
+    uint32_t activeInstanceCount;
+    // Half the width of the grid of the active instances
+    float instanceGridCenter {0.0f};
+
+    // GPU frustum culling: a compute pass writes the visible instances and the indirect draw command of each frame
+    bool useGpuCulling {false};
+    VkDescriptorSetLayout cullDescriptorSetLayout;
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline;
+    std::vector<VkDescriptorSet> cullDescriptorSets;
+    std::vector<VkBuffer> visibleInstanceBuffers;
+    std::vector<GpuAllocation> visibleInstanceBuffersAllocations;
+    std::vector<VkBuffer> indirectBuffers;
+    std::vector<GpuAllocation> indirectBuffersAllocations;
+    float cullBoundingRadius {0.0f};
+
+    // Meshlets of the full detail mesh, culled on the CPU every frame. Each object has one indirect draw command
+    // per meshlet in the frame's buffer, with no instances when the meshlet is culled, so the commands recorded
+    // in the command buffers never change.
+    bool useMeshlets {false};
+    std::vector<Meshlet> meshlets;
+    // The meshlets of full detail sub-mesh i are [subMeshFirstMeshlet[i], subMeshFirstMeshlet[i + 1])
+    std::vector<uint32_t> subMeshFirstMeshlet;
+    std::vector<VkBuffer> meshletDrawBuffers;
+    std::vector<GpuAllocation> meshletDrawBuffersAllocations;
+    // Meshlets tested and drawn by the CPU culling since the start, for the report
+    uint64_t meshletsTested {0};
+    uint64_t meshletsDrawn {0};
+    // With the multiDrawIndirect feature, up to maxDrawIndirectCount commands are drawn by one call
+    bool multiDrawIndirectSupported {false};
+    uint32_t maxDrawIndirectCount {1};
+    // The textureCompressionBC feature, needed to sample BC formats
+    bool textureCompressionBCSupported {false};
+    // Descriptor indexing with update after bind samplers, and how many of them one set can hold
+    bool useBindless {false};
+    uint32_t bindlessTextureCapacity {0};
+
+    // Quantized copy of the mesh vertices, used instead of them when packing succeeded
+    bool usePackedVertices {false};
+    std::vector<PackedVertex> packedVertices;
+    VertexDequantization vertexDequantization {};
+
+    // Secondary command buffers, maxRecordSliceCount per frame in flight, each from its own pool
+    // so that the slices can be recorded on different threads
+    uint32_t maxRecordSliceCount {0};
+    // Slices used when recording, changed by the recording benchmark
+    uint32_t recordSliceCount {0};
+    std::vector<VkCommandPool> secondaryCommandPools;
+    std::vector<VkCommandBuffer> secondaryCommandBuffers;
+    // The camera moves back to keep all objects in view
+    float sceneScale {1.0f};
+
     // Descriptor pool
     VkDescriptorPool descriptorPool;
+    // Bindless textures: one array of every texture, in its own update after bind pool.
+    // Slots [0, bindlessTextureSlots) are written, the others stay unbound.
+    VkDescriptorSetLayout bindlessDescriptorSetLayout {VK_NULL_HANDLE};
+    VkDescriptorPool bindlessDescriptorPool {VK_NULL_HANDLE};
+    VkDescriptorSet bindlessDescriptorSet {VK_NULL_HANDLE};
+    uint32_t bindlessTextureSlots {0};
 
     // Descriptor sets
     std::vector<VkDescriptorSet> descriptorSets;
 
     // Texture
     VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    GpuAllocation textureImageAllocation;
     VkImageView textureImageView;
     VkSampler textureSampler;
     uint32_t mipLevels;
+    VkFormat textureFormat {VK_FORMAT_R8G8B8A8_SRGB};
+    // How the texture is stored on the GPU, for the report
+    TextureEncoding textureEncoding {TextureEncoding::RGBA8};
+    VkDeviceSize textureBytes {0};
 
     // Depth
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    GpuAllocation depthImageAllocation;
     VkImageView depthImageView;
 
     // Multisampling
     VkSampleCountFlagBits msaaSamples {VK_SAMPLE_COUNT_1_BIT}; // initialize with no multisampling
     VkImage colorImage;
-    VkDeviceMemory colorImageMemory;
+    GpuAllocation colorImageAllocation;
     VkImageView colorImageView;
 
+    // GPU timestamps of the scopes of each frame. Used in headless mode, to measure the GPU frame time,
+    // and in windowed mode with --gpu-profile or --gpu-trace.
+    bool timestampsEnabled {false};
+    float timestampPeriod {1.0f}; // nanoseconds per timestamp tick
+    uint32_t timestampValidBits {0};
+    GpuProfiler gpuProfiler;
+    // Whether the frame's GPU time is a benchmark sample, because it was submitted while benchmarking
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> gpuFrameTimesPending {};
+
+    // Where drawFrame stores its timings while benchmarking, nullptr otherwise
+    BenchmarkSamples * benchmarkSamples {nullptr};
+
 public:
+    explicit HelloTriangleApplication(const ApplicationOptions & options) :
+        options {options},
+        threadPool {options.threadCount}
+    {
+    }
+
     void run()
     {
-        initWindow();
+        // Creates the window too, so it overlaps the texture decode and the model loading
         initVulkan();
-        mainLoop();
+        startupTimeline.print(std::cerr);
+        if(options.headless)
+        {
+            benchmarkLoop();
+        }
+        else
+        {
+            mainLoop();
+        }
+        reportGpuProfile();
         cleanup();
     }
 
@@ -284,102 +1019,288 @@ private:
         glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
     }
 
+    // Runs the creation steps as a task graph on the thread pool, each once the steps it needs are done.
+    // The texture decode and the model loading need no device, so they overlap the whole device setup.
+    // Steps using the upload context are chained, since it records into one command buffer.
     void initVulkan()
     {
-        std::cout << "create instance" << std::endl;
-        createVkInstance();
-        std::cout << "create surface" << std::endl;
-        createSurface();
-        std::cout << "create physical device" << std::endl;
-        pickPhysicalDevice();
-        std::cout << "create logical device" << std::endl;
-        createLogicalDevice();
-        std::cout << "create swap chain" << std::endl;
-        createSwapChain();
-        std::cout << "create image views" << std::endl;
-        createImageViews();
-        std::cout << "create render pass" << std::endl;
-        createRenderPass();
-        std::cout << "create descriptor set layout" << std::endl;
-        createDescriptorSetLayout();
-        std::cout << "create graphics pipeline" << std::endl;
-        createGraphicsPipeline();
-        std::cout << "create color resources" << std::endl;
-        createColorResources();
-        std::cout << "create depth resources" << std::endl;
-        createDepthResources();
-        std::cout << "create framebuffers" << std::endl;
-        createFramebuffers();
-        std::cout << "create command pool" << std::endl;
-        createCommandPool();
-        std::cout << "create texture image" << std::endl;
-        createTextureImage();
-        std::cout << "create texture image view" << std::endl;
-        createTextureImageView();
-        std::cout << "create texture sampler" << std::endl;
-        createTextureSampler();
-        std::cout << "load model" << std::endl;
-        loadModel();
-        std::cout << "create vertex buffer" << std::endl;
-        createVertexBuffer();
-        std::cout << "create index buffer" << std::endl;
-        createIndexBuffer();
-        std::cout << "create uniform buffers" << std::endl;
-        createUniformBuffers();
-        std::cout << "create descriptor pools" << std::endl;
-        createDescriptorPool();
-        std::cout << "create descriptor sets" << std::endl;
-        createDescriptorSets();
-        std::cout << "create command buffer" << std::endl;
-        createCommandBuffers();
-        std::cout << "create sync objects" << std::endl;
-        createSyncObjects();
-    }
-
-    void createVkInstance()
-    {
-        if(enableValidationLayers)
+        TaskGraph graph;
+        // Dependencies on optional steps which were left out
+        auto existing = [](std::initializer_list<size_t> steps)
         {
-            bool hasValidationSupport = checkValidationLayerSupport();
-            if(!hasValidationSupport)
+            std::vector<size_t> result;
+            for(size_t step : steps)
             {
-                throw std::runtime_error("Validation layers requested, but not available");
+                if(step != SIZE_MAX)
+                {
+                    result.push_back(step);
+                }
             }
-        }
-
-        VkApplicationInfo appInfo {};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Hello Triangle";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1,0,0);
-        appInfo.pEngineName = "No engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1,0,0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
-
-        VkInstanceCreateInfo instanceCreateInfo {};
-        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        instanceCreateInfo.pApplicationInfo = &appInfo;
+            return result;
+        };
 
-        uint32_t glfwExtensionCount {0};
-        const char ** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        // GLFW windows must be created on the main thread
+        size_t windowTask {SIZE_MAX};
+        if(!options.headless)
+        {
+            windowTask = graph.add("create window", [this]() { initWindow(); }, {}, true);
+        }
+        size_t textureDecodeTask {graph.add("decode texture", [this]() { decodeTexture(); })};
+        // Parsing the model uses the thread pool itself, so it stays on the main thread
+        size_t modelTask {graph.add("load model", [this]()
+        {
+            loadModel();
+            computeMeshBoundingRadius();
+        }, {}, true)};
+        // The vertex format depends on the packing
+        size_t meshVerticesTask {modelTask};
+        if(options.packedVertices)
+        {
+            meshVerticesTask = graph.add("pack vertices", [this]() { packMeshVertices(); }, {modelTask});
+        }
 
-        instanceCreateInfo.enabledExtensionCount = glfwExtensionCount;
-        instanceCreateInfo.ppEnabledExtensionNames = glfwExtensions;
+        size_t instanceTask {graph.add("create instance", [this]() { createVkInstance(); }, existing({windowTask}))};
+        size_t surfaceTask {SIZE_MAX};
+        if(!options.headless)
+        {
+            surfaceTask = graph.add("create surface", [this]() { createSurface(); }, {instanceTask, windowTask});
+        }
+        size_t physicalDeviceTask {graph.add("create physical device", [this]() { pickPhysicalDevice(); }, existing({instanceTask, surfaceTask}))};
+        size_t logicalDeviceTask {graph.add("create logical device", [this]() { createLogicalDevice(); }, {physicalDeviceTask})};
+        size_t allocatorTask {graph.add("create gpu memory allocator", [this]() { gpuAllocator.init(vkPhysicalDevice, vkDevice); }, {logicalDeviceTask})};
 
-        if(enableValidationLayers)
+        size_t swapChainTask;
+        if(options.headless)
         {
-            instanceCreateInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            instanceCreateInfo.ppEnabledLayerNames = validationLayers.data();
+            swapChainTask = graph.add("create offscreen images", [this]() { createOffscreenImages(); }, {allocatorTask});
         }
         else
         {
-            instanceCreateInfo.enabledLayerCount = 0;
+            // The swap chain extent comes from the window's framebuffer size, which GLFW only gives on the main thread
+            swapChainTask = graph.add("create swap chain", [this]() { createSwapChain(); }, {logicalDeviceTask, windowTask}, true);
         }
-
-        VkResult result = vkCreateInstance(&instanceCreateInfo, nullptr, &vkInstance);
-        if(result != VK_SUCCESS)
+        size_t imageViewsTask {graph.add("create image views", [this]() { createImageViews(); }, {swapChainTask})};
+        size_t renderPassTask {graph.add("create render pass", [this]() { createRenderPass(); }, {swapChainTask})};
+        size_t descriptorSetLayoutTask {graph.add("create descriptor set layout", [this]() { createDescriptorSetLayout(); }, {logicalDeviceTask})};
+        size_t pipelineCacheTask {SIZE_MAX};
+        if(options.usePipelineCache)
         {
-            std::cout << "Failed to create Vulkan instance" << std::endl;
+            pipelineCacheTask = graph.add("create pipeline cache", [this]() { createPipelineCache(); }, {logicalDeviceTask});
+        }
+        size_t graphicsPipelineTask {graph.add(
+            "create graphics pipeline",
+            [this]() { createGraphicsPipeline(); },
+            existing({renderPassTask, descriptorSetLayoutTask, pipelineCacheTask, meshVerticesTask})
+        )};
+        size_t cullPipelineTask {graph.add(
+            "create culling pipeline",
+            [this]() { createCullPipeline(); },
+            existing({descriptorSetLayoutTask, pipelineCacheTask})
+        )};
+        size_t colorResourcesTask {graph.add("create color resources", [this]() { createColorResources(); }, {swapChainTask, allocatorTask})};
+        size_t depthResourcesTask {graph.add("create depth resources", [this]() { createDepthResources(); }, {swapChainTask, allocatorTask})};
+        size_t framebuffersTask {graph.add(
+            "create framebuffers",
+            [this]() { createFramebuffers(); },
+            {imageViewsTask, renderPassTask, colorResourcesTask, depthResourcesTask}
+        )};
+        size_t commandPoolTask {graph.add("create command pool", [this]() { createCommandPool(); }, {logicalDeviceTask})};
+
+        size_t uploadsTask {graph.add("create upload context", [this]()
+        {
+            createUploadContext();
+            uploadContext.begin();
+        }, {allocatorTask})};
+        size_t vertexBufferTask {graph.add("create vertex buffer", [this]() { createVertexBuffer(); }, {uploadsTask, meshVerticesTask})};
+        size_t indexBufferTask {graph.add("create index buffer", [this]() { createIndexBuffer(); }, {vertexBufferTask})};
+        size_t instanceBufferTask {graph.add("create instance buffer", [this]() { createInstanceBuffer(); }, {indexBufferTask})};
+        // The texture is uploaded last, to give its decode as much time as possible.
+        // Generating its mip levels on the CPU uses the thread pool, so it stays on the main thread.
+        size_t textureImageTask {graph.add("create texture image", [this]() { createTextureImage(); }, {instanceBufferTask, textureDecodeTask}, true)};
+        size_t textureImageViewTask {graph.add("create texture image view", [this]() { createTextureImageView(); }, {textureImageTask})};
+        size_t textureSamplerTask {graph.add("create texture sampler", [this]() { createTextureSampler(); }, {textureImageTask})};
+        // The uploads run while the rest is created
+        size_t submitUploadsTask {graph.add("submit uploads", [this]() { uploadContext.submit(); }, {textureImageTask})};
+
+        size_t uniformBuffersTask {graph.add("create uniform buffers", [this]() { createUniformBuffers(); }, {allocatorTask})};
+        // The object grid is scaled around the instance grid
+        size_t objectUniformBufferTask {graph.add("create object uniform buffer", [this]() { createObjectUniformBuffer(); }, {instanceBufferTask})};
+        // Whether the device supports culling is only known once the culling pipeline is created
+        size_t cullBuffersTask {graph.add("create culling buffers", [this]()
+        {
+            if(useGpuCulling)
+            {
+                createCullBuffers();
+            }
+        }, {cullPipelineTask, objectUniformBufferTask, indexBufferTask})};
+        size_t meshletBuffersTask {SIZE_MAX};
+        if(options.meshlets)
+        {
+            meshletBuffersTask = graph.add("create meshlets", [this]() { createMeshlets(); }, {indexBufferTask, instanceBufferTask});
+        }
+        size_t materialUniformBufferTask {graph.add("create material uniform buffer", [this]() { createMaterialUniformBuffer(); }, {allocatorTask, modelTask})};
+        // One set per material of the model
+        size_t descriptorPoolTask {graph.add("create descriptor pools", [this]() { createDescriptorPool(); }, {logicalDeviceTask, modelTask})};
+        size_t descriptorSetsTask {graph.add(
+            "create descriptor sets",
+            [this]() { createDescriptorSets(); },
+            {
+                descriptorPoolTask,
+                descriptorSetLayoutTask,
+                uniformBuffersTask,
+                objectUniformBufferTask,
+                materialUniformBufferTask,
+                textureImageViewTask,
+                textureSamplerTask,
+                cullBuffersTask
+            }
+        )};
+        size_t commandBuffersTask {graph.add("create command buffer", [this]() { createCommandBuffers(); }, {commandPoolTask})};
+        if(options.recordThreadCount > 0 || options.benchmarkRecording)
+        {
+            graph.add("create secondary command buffers", [this]() { createSecondaryCommandBuffers(); }, {logicalDeviceTask});
+        }
+        graph.add("create sync objects", [this]() { createSyncObjects(); }, {logicalDeviceTask});
+        // Timestamp support is only known once the physical device is picked
+        size_t profilerTask {graph.add("create gpu profiler", [this]()
+        {
+            if(timestampsEnabled)
+            {
+                gpuProfiler.init(vkDevice, MAX_FRAMES_IN_FLIGHT, timestampPeriod, timestampValidBits);
+            }
+        }, {logicalDeviceTask})};
+        if(options.prerecordCommandBuffers)
+        {
+            // Pre-recorded command buffers are recorded inline, so they don't need the secondary command buffers,
+            // and the recording doesn't use the thread pool
+            graph.add("record command buffers", [this]()
+            {
+                createPrerecordedCommandBuffers();
+                usePrerecordedCommandBuffers = true;
+            }, existing({
+                commandBuffersTask,
+                descriptorSetsTask,
+                graphicsPipelineTask,
+                framebuffersTask,
+                submitUploadsTask,
+                meshletBuffersTask,
+                profilerTask
+            }));
+        }
+        graph.add("wait for uploads", [this]() { uploadContext.wait(); }, {submitUploadsTask});
+
+        graph.run(threadPool, startupTimeline);
+    }
+
+    // Reads the texture container, or decodes the PNG image when there is no valid container
+    void decodeTexture()
+    {
+        if(options.useTextureContainer && readTextureContainerFile())
+        {
+            decodedTexture.hasContainer = true;
+            return;
+        }
+
+        int textureWidth, textureHeight, textureChannels;
+        // STBI_rgb_alpha forces to load with an alpha channel
+        stbi_uc * pixels {stbi_load(TEXTURE_PATH.c_str(), &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha)};
+        if(!pixels)
+        {
+            throw std::runtime_error("Failed to load texture image.");
+        }
+        decodedTexture.width = static_cast<uint32_t>(textureWidth);
+        decodedTexture.height = static_cast<uint32_t>(textureHeight);
+        decodedTexture.pixels.assign(pixels, pixels + 4 * static_cast<size_t>(textureWidth) * textureHeight);
+        stbi_image_free(pixels);
+    }
+
+    void createUploadContext()
+    {
+        // Persistently mapped staging ring, shared by all uploads
+        VkDeviceSize stagingRingSize {static_cast<VkDeviceSize>(options.stagingRingKilobytes) * 1024};
+        createBuffer(
+            stagingRingSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingRingBuffer,
+            stagingRingAllocation
+        );
+
+        uint32_t graphicsFamily {queueFamilyIndices.graphicsFamily.value()};
+        uint32_t transferFamily {queueFamilyIndices.transferFamily.value_or(graphicsFamily)};
+
+        // Image copies on the transfer queue must respect its granularity
+        uint32_t queueFamilyCount {0};
+        vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uploadContext.init(
+            vkDevice,
+            stagingRingBuffer,
+            stagingRingAllocation.mapped,
+            stagingRingSize,
+            transferFamily,
+            transferQueue,
+            queueFamilies[transferFamily].minImageTransferGranularity,
+            graphicsFamily,
+            graphicsQueue
+        );
+        if(uploadContext.usesTransferQueue())
+        {
+            logLine("uploading on transfer queue family ", queueFamilyIndices.transferFamily.value());
+        }
+    }
+
+    void createVkInstance()
+    {
+        if(enableValidationLayers)
+        {
+            bool hasValidationSupport = checkValidationLayerSupport();
+            if(!hasValidationSupport)
+            {
+                throw std::runtime_error("Validation layers requested, but not available");
+            }
+        }
+
+        VkApplicationInfo appInfo {};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Hello Triangle";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1,0,0);
+        appInfo.pEngineName = "No engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1,0,0);
+        // 1.1 for vkGetPhysicalDeviceFeatures2, to query descriptor indexing
+        appInfo.apiVersion = VK_API_VERSION_1_1;
+
+        VkInstanceCreateInfo instanceCreateInfo {};
+        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceCreateInfo.pApplicationInfo = &appInfo;
+
+        // Headless mode doesn't have a window, so it doesn't need the window system extensions
+        uint32_t glfwExtensionCount {0};
+        const char ** glfwExtensions {nullptr};
+        if(!options.headless)
+        {
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        }
+
+        instanceCreateInfo.enabledExtensionCount = glfwExtensionCount;
+        instanceCreateInfo.ppEnabledExtensionNames = glfwExtensions;
+
+        if(enableValidationLayers)
+        {
+            instanceCreateInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            instanceCreateInfo.ppEnabledLayerNames = validationLayers.data();
+        }
+        else
+        {
+            instanceCreateInfo.enabledLayerCount = 0;
+        }
+
+        VkResult result = vkCreateInstance(&instanceCreateInfo, nullptr, &vkInstance);
+        if(result != VK_SUCCESS)
+        {
+            logLine("Failed to create Vulkan instance");
         }
     }
 
@@ -394,12 +1315,12 @@ private:
         // Store the validation layer properties in the vector
         vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
 
-        std::cout << "available layers:\n";
+        std::string layerNames;
         for(const VkLayerProperties& layerProperties : availableLayers)
         {
-            std::cout << layerProperties.layerName << "\n";
+            layerNames += std::string("\n") + layerProperties.layerName;
         }
-        std::cout << std::endl;
+        logLine("available layers:", layerNames);
 
         // Check if the validation layers are available
         for(const char * layerName : validationLayers)
@@ -456,7 +1377,8 @@ private:
             {
                 vkPhysicalDevice = device;
                 msaaSamples = getMaxUsableSampleCount();
-                std::cout << "msaaSamples = " << msaaSamples << std::endl;
+                logLine("msaaSamples = ", msaaSamples);
+                checkTimestampSupport();
                 break;
             }
         }
@@ -478,19 +1400,17 @@ private:
         //bool isDiscreteGPU = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
         bool supportsGeometryShaders = physicalDeviceFeatures.geometryShader;
         
-        std::cout << std::boolalpha;
-        //std::cout << "-- is discrete gpu: " << isDiscreteGPU << std::endl;
-        std::cout << "-- has geometry shaders: " << supportsGeometryShaders << std::endl;
+        //logLine("-- is discrete gpu: ", isDiscreteGPU);
+        logLine("-- has geometry shaders: ", supportsGeometryShaders);
 
         // Queue families
         queueFamilyIndices = findQueueFamilies(physicalDevice);
 
-        std::cout << "-- has queue families: " << queueFamilyIndices.isComplete() << std::endl;
+        logLine("-- has queue families: ", queueFamilyIndices.isComplete());
 
-        // Swap chains
-        bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice);
-        bool swapChainAdequate {false};
-        if(extensionsSupported)
+        // Swap chains. Headless mode renders to offscreen images, so it doesn't need one.
+        bool swapChainAdequate {options.headless};
+        if(!options.headless && checkDeviceExtensionSupport(physicalDevice))
         {
             SwapChainSupportDetails swapChainSupportDetails = querySwapChainSupport(physicalDevice);
             swapChainAdequate = !swapChainSupportDetails.formats.empty() && !swapChainSupportDetails.presentModes.empty();
@@ -501,8 +1421,8 @@ private:
                             swapChainAdequate && 
                             physicalDeviceFeatures.samplerAnisotropy;
 
-        std::cout << "maxFramebufferWidth = " << physicalDeviceProperties.limits.maxFramebufferWidth << std::endl;
-        std::cout << "maxFramebufferHeight = " << physicalDeviceProperties.limits.maxFramebufferHeight << std::endl;
+        logLine("maxFramebufferWidth = ", physicalDeviceProperties.limits.maxFramebufferWidth);
+        logLine("maxFramebufferHeight = ", physicalDeviceProperties.limits.maxFramebufferHeight);
 
         return isSuitable;
     }
@@ -510,6 +1430,7 @@ private:
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice)
     {
         QueueFamilyIndices indices;
+        indices.presentationRequired = !options.headless;
 
         uint32_t queueFamilyCount {0};
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
@@ -520,22 +1441,40 @@ private:
         int i {0};
         for(const VkQueueFamilyProperties& queueFamily : queueFamilies)
         {
-            // Graphics family
-            if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            // Keep looking for a transfer family once complete, without changing the other families
+            if(!indices.isComplete())
             {
-                indices.graphicsFamily = i;
+                // Graphics family
+                if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+                {
+                    indices.graphicsFamily = i;
+                }
+
+                // Presentation family
+                if(indices.presentationRequired)
+                {
+                    VkBool32 presentSupport {false};
+                    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+                    if(presentSupport)
+                    {
+                        indices.presentFamily = i;
+                    }
+                }
             }
 
-            // Presentation family
-            VkBool32 presentSupport {false};
-            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-            if(presentSupport)
+            // Dedicated transfer family, preferably without compute support either (the DMA engines)
+            if(
+                options.useTransferQueue &&
+                (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                (!indices.transferFamily.has_value() || !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
+            )
             {
-                indices.presentFamily = i;
+                indices.transferFamily = i;
             }
 
             // Early stop
-            if(indices.isComplete())
+            if(indices.isComplete() && indices.transferFamily.has_value() && !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
             {
                 break;
             }
@@ -566,11 +1505,73 @@ private:
         return requiredExtensions.empty();
     }
 
+    // Checks for the descriptor indexing features of the bindless texture array, and sets its capacity
+    bool isBindlessSupported()
+    {
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+        if(physicalDeviceProperties.apiVersion < VK_API_VERSION_1_1)
+        {
+            return false;
+        }
+
+        uint32_t extensionCount {0};
+        vkEnumerateDeviceExtensionProperties(vkPhysicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(vkPhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+        bool extensionSupported {std::any_of(availableExtensions.begin(), availableExtensions.end(), [](const VkExtensionProperties & extension)
+        {
+            return strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0;
+        })};
+        if(!extensionSupported)
+        {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures {};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2 {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &descriptorIndexingFeatures;
+        vkGetPhysicalDeviceFeatures2(vkPhysicalDevice, &features2);
+        if(
+            !descriptorIndexingFeatures.runtimeDescriptorArray ||
+            !descriptorIndexingFeatures.descriptorBindingPartiallyBound ||
+            !descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+        )
+        {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties {};
+        descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2 {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &descriptorIndexingProperties;
+        vkGetPhysicalDeviceProperties2(vkPhysicalDevice, &properties2);
+        bindlessTextureCapacity = std::min({
+            MAX_BINDLESS_TEXTURES,
+            descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+            descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+            descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers
+        });
+        return bindlessTextureCapacity >= options.bindlessTextureCount;
+    }
+
     void createLogicalDevice()
     {
         // Create the queues (graphics and presentation)
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.presentFamily.value()};
+        std::set<uint32_t> uniqueQueueFamilies = {queueFamilyIndices.graphicsFamily.value()};
+        if(queueFamilyIndices.presentFamily.has_value())
+        {
+            uniqueQueueFamilies.insert(queueFamilyIndices.presentFamily.value());
+        }
+        if(queueFamilyIndices.transferFamily.has_value())
+        {
+            uniqueQueueFamilies.insert(queueFamilyIndices.transferFamily.value());
+        }
         const float queuePriority = 1.0f;
         for(uint32_t queueFamily : uniqueQueueFamilies)
         {
@@ -587,13 +1588,49 @@ private:
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+        // Optional, lets one indirect call draw all the meshlets of an object
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(vkPhysicalDevice, &supportedFeatures);
+        multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        // Optional, the compressed texture is decoded when it is missing
+        textureCompressionBCSupported = supportedFeatures.textureCompressionBC == VK_TRUE;
+        deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+        maxDrawIndirectCount = multiDrawIndirectSupported ? physicalDeviceProperties.limits.maxDrawIndirectCount : 1;
+
+        // The swap chain extension isn't needed in headless mode
+        std::vector<const char *> enabledExtensions;
+        if(!options.headless)
+        {
+            enabledExtensions = deviceExtensions;
+        }
+
         VkDeviceCreateInfo deviceCreateInfo{};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        // Optional, only the features the bindless texture array uses
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures {};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        if(options.bindless)
+        {
+            useBindless = isBindlessSupported();
+            logLine("bindless textures: ", useBindless);
+        }
+        if(useBindless)
+        {
+            descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            deviceCreateInfo.pNext = &descriptorIndexingFeatures;
+            enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
+        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         if(enableValidationLayers)
         {
@@ -613,7 +1650,18 @@ private:
 
         // Get a queue handle
         vkGetDeviceQueue(vkDevice, queueFamilyIndices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(vkDevice, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
+        if(queueFamilyIndices.presentFamily.has_value())
+        {
+            vkGetDeviceQueue(vkDevice, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
+        }
+        if(queueFamilyIndices.transferFamily.has_value())
+        {
+            vkGetDeviceQueue(vkDevice, queueFamilyIndices.transferFamily.value(), 0, &transferQueue);
+        }
+        else
+        {
+            transferQueue = graphicsQueue;
+        }
     }
 
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physicalDevice)
@@ -681,12 +1729,12 @@ private:
     {
         if(capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
         {
-            std::cout << "capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()" << std::endl;
+            logLine("capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()");
             return capabilities.currentExtent;
         }
         else
         {
-            std::cout << "capabilities.currentExtent.width == std::numeric_limits<uint32_t>::max()" << std::endl;
+            logLine("capabilities.currentExtent.width == std::numeric_limits<uint32_t>::max()");
             int width, height;
             glfwGetFramebufferSize(window, &width, &height);
 
@@ -780,6 +1828,31 @@ private:
         vkGetSwapchainImagesKHR(vkDevice, swapChain, &imageCount, swapChainImages.data());
     }
 
+    void createOffscreenImages()
+    {
+        // Stand-ins for the swap chain images, one per frame in flight
+        swapChainImageFormat = OFFSCREEN_IMAGE_FORMAT;
+        swapChainExtent = {WIDTH, HEIGHT};
+
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+        offscreenImagesAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+        for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createImage(
+                swapChainExtent.width,
+                swapChainExtent.height,
+                1,
+                VK_SAMPLE_COUNT_1_BIT,
+                swapChainImageFormat,
+                VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                swapChainImages[i],
+                offscreenImagesAllocations[i]
+            );
+        }
+    }
+
     void recreateSwapChain()
     {
         // Handle minimization by pausing until it is not minimized
@@ -801,6 +1874,13 @@ private:
         createColorResources();
         createDepthResources();
         createFramebuffers();
+
+        // The pre-recorded command buffers reference the old framebuffers
+        if(options.prerecordCommandBuffers)
+        {
+            freePrerecordedCommandBuffers();
+            createPrerecordedCommandBuffers();
+        }
     }
     
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -835,7 +1915,7 @@ private:
 
         for(size_t i {0}; i < swapChainImages.size(); i++)
         {
-            std::cout << "-- creating image view " << i << std::endl;
+            logLine("-- creating image view ", i);
             swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
         }
     }
@@ -866,8 +1946,8 @@ private:
 
     VkShaderModule createShaderModule(const std::vector<char> & shader_code)
     {
-        //std::cout << "createShaderModule" << std::endl;
-        //std::cout << "Shader code size = " << shader_code.size() << std::endl;
+        //logLine("createShaderModule");
+        //logLine("Shader code size = ", shader_code.size());
 
         VkShaderModuleCreateInfo shaderModuleCreateInfo {};
         shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -923,7 +2003,8 @@ private:
         colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // Offscreen images aren't presented, so leave them ready to be copied out instead
+        colorAttachmentResolve.finalLayout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkAttachmentReference colorAttachmentResolveRef {};
         colorAttachmentResolveRef.attachment = 2;
@@ -1000,14 +2081,109 @@ private:
         {
             throw std::runtime_error("Failed to create descriptor set layout.");
         }
+
+        // Per-object uniforms, offset into the object uniform ring when binding
+        VkDescriptorSetLayoutBinding objectLayoutBinding {};
+        objectLayoutBinding.binding = 0;
+        objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        objectLayoutBinding.descriptorCount = 1;
+        // The bindless fragment shader reads the object's texture index
+        objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | (useBindless ? VK_SHADER_STAGE_FRAGMENT_BIT : 0);
+        objectLayoutBinding.pImmutableSamplers = nullptr;
+
+        VkDescriptorSetLayoutCreateInfo objectDescriptorSetLayoutCreateInfo {};
+        objectDescriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        objectDescriptorSetLayoutCreateInfo.bindingCount = 1;
+        objectDescriptorSetLayoutCreateInfo.pBindings = &objectLayoutBinding;
+
+        result = vkCreateDescriptorSetLayout(vkDevice, &objectDescriptorSetLayoutCreateInfo, nullptr, &objectDescriptorSetLayout);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create object descriptor set layout.");
+        }
+
+        // Per-material uniforms, one set per material
+        VkDescriptorSetLayoutBinding materialLayoutBinding {};
+        materialLayoutBinding.binding = 0;
+        materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        materialLayoutBinding.descriptorCount = 1;
+        materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        materialLayoutBinding.pImmutableSamplers = nullptr;
+
+        VkDescriptorSetLayoutCreateInfo materialDescriptorSetLayoutCreateInfo {};
+        materialDescriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        materialDescriptorSetLayoutCreateInfo.bindingCount = 1;
+        materialDescriptorSetLayoutCreateInfo.pBindings = &materialLayoutBinding;
+
+        result = vkCreateDescriptorSetLayout(vkDevice, &materialDescriptorSetLayoutCreateInfo, nullptr, &materialDescriptorSetLayout);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create material descriptor set layout.");
+        }
+
+        // Culling pass: camera, all instances, visible instances, indirect draw command
+        std::array<VkDescriptorSetLayoutBinding, 4> cullLayoutBindings {};
+        for(uint32_t binding {0}; binding < cullLayoutBindings.size(); binding++)
+        {
+            cullLayoutBindings[binding].binding = binding;
+            cullLayoutBindings[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            cullLayoutBindings[binding].descriptorCount = 1;
+            cullLayoutBindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            cullLayoutBindings[binding].pImmutableSamplers = nullptr;
+        }
+
+        VkDescriptorSetLayoutCreateInfo cullDescriptorSetLayoutCreateInfo {};
+        cullDescriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        cullDescriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(cullLayoutBindings.size());
+        cullDescriptorSetLayoutCreateInfo.pBindings = cullLayoutBindings.data();
+
+        result = vkCreateDescriptorSetLayout(vkDevice, &cullDescriptorSetLayoutCreateInfo, nullptr, &cullDescriptorSetLayout);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create culling descriptor set layout.");
+        }
+
+        if(useBindless)
+        {
+            // Every texture in one array, where unwritten slots are allowed and slots can be written while in use
+            VkDescriptorSetLayoutBinding bindlessLayoutBinding {};
+            bindlessLayoutBinding.binding = 0;
+            bindlessLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            bindlessLayoutBinding.descriptorCount = bindlessTextureCapacity;
+            bindlessLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+            bindlessLayoutBinding.pImmutableSamplers = nullptr;
+
+            VkDescriptorBindingFlagsEXT bindlessBindingFlags {
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+            };
+            VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo {};
+            bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+            bindingFlagsCreateInfo.bindingCount = 1;
+            bindingFlagsCreateInfo.pBindingFlags = &bindlessBindingFlags;
+
+            VkDescriptorSetLayoutCreateInfo bindlessDescriptorSetLayoutCreateInfo {};
+            bindlessDescriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            bindlessDescriptorSetLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+            bindlessDescriptorSetLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+            bindlessDescriptorSetLayoutCreateInfo.bindingCount = 1;
+            bindlessDescriptorSetLayoutCreateInfo.pBindings = &bindlessLayoutBinding;
+
+            result = vkCreateDescriptorSetLayout(vkDevice, &bindlessDescriptorSetLayoutCreateInfo, nullptr, &bindlessDescriptorSetLayout);
+            if(result != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bindless descriptor set layout.");
+            }
+        }
     }
     
     void createGraphicsPipeline()
     {
-        std::vector<char> vertShaderCode = readFile("shaders/vert.spv");
-        std::vector<char> fragShaderCode = readFile("shaders/frag.spv");
-        std::cout << "vert shader code size: " << vertShaderCode.size() << " bytes" << std::endl;
-        std::cout << "frag shader code size: " << fragShaderCode.size() << " bytes" << std::endl;
+        // The packed vertices are read by a variant of the vertex shader compiled with PACKED_VERTICES
+        std::vector<char> vertShaderCode = readFile(usePackedVertices ? "shaders/vert_packed.spv" : "shaders/vert.spv");
+        // The bindless variant samples the texture array, compiled with BINDLESS
+        std::vector<char> fragShaderCode = readFile(useBindless ? "shaders/frag_bindless.spv" : "shaders/frag.spv");
+        logLine("vert shader code size: ", vertShaderCode.size(), " bytes");
+        logLine("frag shader code size: ", fragShaderCode.size(), " bytes");
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
         VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -1042,14 +2218,36 @@ private:
         dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
 
-        // Set up thegraphics pipeline to accept vertex data from Vertex struct
-        VkVertexInputBindingDescription bindingDescription {Vertex::getBindingDescription()};
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions {Vertex::getAttributeDescriptions()};
+        // Set up thegraphics pipeline to accept vertex data from Vertex (or PackedVertex) struct
+        // and the per-instance data from InstanceData
+        std::array<VkVertexInputBindingDescription, 2> bindingDescriptions {
+            usePackedVertices ? PackedVertex::getBindingDescription() : Vertex::getBindingDescription(),
+            InstanceData::getBindingDescription()
+        };
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+        if(usePackedVertices)
+        {
+            for(const VkVertexInputAttributeDescription & description : PackedVertex::getAttributeDescriptions())
+            {
+                attributeDescriptions.push_back(description);
+            }
+        }
+        else
+        {
+            for(const VkVertexInputAttributeDescription & description : Vertex::getAttributeDescriptions())
+            {
+                attributeDescriptions.push_back(description);
+            }
+        }
+        for(const VkVertexInputAttributeDescription & description : InstanceData::getAttributeDescriptions())
+        {
+            attributeDescriptions.push_back(description);
+        }
 
         VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo {};
         vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-        vertexInputStateCreateInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputStateCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputStateCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();
         vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
         vertexInputStateCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
@@ -1132,10 +2330,20 @@ private:
         // Pipeline layout
         VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo {};
         pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.setLayoutCount = 1;
-        pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutCreateInfo.pushConstantRangeCount = 0; // optional
-        pipelineLayoutCreateInfo.pPushConstantRanges = nullptr; // optional
+        std::vector<VkDescriptorSetLayout> setLayouts {descriptorSetLayout, objectDescriptorSetLayout, materialDescriptorSetLayout};
+        if(useBindless)
+        {
+            setLayouts.push_back(bindlessDescriptorSetLayout);
+        }
+        pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+        // Only the packed vertex shader reads the push constants
+        VkPushConstantRange pushConstantRange {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(VertexDequantization);
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 
         VkResult result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
         if(result != VK_SUCCESS)
@@ -1176,17 +2384,67 @@ private:
         graphicsPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE; // optional
         graphicsPipelineCreateInfo.basePipelineIndex = -1; // optional
 
-        result = vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline);
+        auto startTime {std::chrono::high_resolution_clock::now()};
+        result = vkCreateGraphicsPipelines(vkDevice, pipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline);
         if(result != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create graphics pipeline.");
         }
+        pipelineCreationMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        logLine("created graphics pipeline in ", pipelineCreationMilliseconds, " ms (pipeline cache ", pipelineCacheState, ")");
         
         // cleanup
         vkDestroyShaderModule(vkDevice, vertShaderModule, nullptr);
         vkDestroyShaderModule(vkDevice, fragShaderModule, nullptr);
     }
 
+    void createPipelineCache()
+    {
+        std::vector<char> cacheData {readPipelineCacheFile(PIPELINE_CACHE_PATH)};
+
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+
+        // Data from another device or driver version would be useless, so start empty instead
+        if(cacheData.empty())
+        {
+            pipelineCacheState = "empty";
+        }
+        else if(isPipelineCacheCompatible(cacheData, physicalDeviceProperties))
+        {
+            pipelineCacheState = "loaded";
+        }
+        else
+        {
+            pipelineCacheState = "rejected";
+            cacheData.clear();
+        }
+
+        VkPipelineCacheCreateInfo pipelineCacheCreateInfo {};
+        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+        pipelineCacheCreateInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+        VkResult result = vkCreatePipelineCache(vkDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline cache.");
+        }
+    }
+
+    void savePipelineCache()
+    {
+        size_t dataSize {0};
+        vkGetPipelineCacheData(vkDevice, pipelineCache, &dataSize, nullptr);
+        std::vector<char> cacheData(dataSize);
+        VkResult result = vkGetPipelineCacheData(vkDevice, pipelineCache, &dataSize, cacheData.data());
+        // Not fatal, the pipelines are just compiled again next time
+        if(result != VK_SUCCESS || !writePipelineCacheFile(PIPELINE_CACHE_PATH, cacheData))
+        {
+            logLine("Failed to save pipeline cache ", PIPELINE_CACHE_PATH);
+        }
+    }
+
     void createFramebuffers()
     {
         swapChainFramebuffers.resize(swapChainImageViews.size());
@@ -1249,7 +2507,85 @@ private:
         }
     }
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    void createSecondaryCommandBuffers()
+    {
+        // The benchmark tries every slice count up to the number of pool threads
+        maxRecordSliceCount = std::max(options.recordThreadCount, options.benchmarkRecording ? static_cast<uint32_t>(threadPool.threadCount()) : 0u);
+        recordSliceCount = options.recordThreadCount;
+
+        secondaryCommandPools.resize(MAX_FRAMES_IN_FLIGHT * maxRecordSliceCount);
+        secondaryCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT * maxRecordSliceCount);
+        for(size_t i {0}; i < secondaryCommandPools.size(); i++)
+        {
+            // Reset as a whole every frame
+            VkCommandPoolCreateInfo commandPoolCreateInfo {};
+            commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+            VkResult result = vkCreateCommandPool(vkDevice, &commandPoolCreateInfo, nullptr, &secondaryCommandPools[i]);
+            if(result != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create secondary command pool.");
+            }
+
+            VkCommandBufferAllocateInfo commandBufferAllocateInfo {};
+            commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            commandBufferAllocateInfo.commandPool = secondaryCommandPools[i];
+            commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            commandBufferAllocateInfo.commandBufferCount = 1;
+
+            result = vkAllocateCommandBuffers(vkDevice, &commandBufferAllocateInfo, &secondaryCommandBuffers[i]);
+            if(result != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create secondary command buffer.");
+            }
+        }
+    }
+
+    void createPrerecordedCommandBuffers()
+    {
+        prerecordedCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT * swapChainImages.size());
+
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo {};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandPool = commandPool;
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandBufferCount = static_cast<uint32_t>(prerecordedCommandBuffers.size());
+
+        VkResult result = vkAllocateCommandBuffers(vkDevice, &commandBufferAllocateInfo, prerecordedCommandBuffers.data());
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pre-recorded command buffers.");
+        }
+
+        for(uint32_t frame {0}; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            for(uint32_t imageIndex {0}; imageIndex < swapChainImages.size(); imageIndex++)
+            {
+                recordCommandBuffer(getPrerecordedCommandBuffer(frame, imageIndex), imageIndex, frame, false);
+            }
+        }
+    }
+
+    VkCommandBuffer getPrerecordedCommandBuffer(uint32_t frame, uint32_t imageIndex)
+    {
+        return prerecordedCommandBuffers[frame*swapChainImages.size() + imageIndex];
+    }
+
+    void freePrerecordedCommandBuffers()
+    {
+        vkFreeCommandBuffers(
+            vkDevice,
+            commandPool,
+            static_cast<uint32_t>(prerecordedCommandBuffers.size()),
+            prerecordedCommandBuffers.data()
+        );
+        prerecordedCommandBuffers.clear();
+    }
+
+    // Pre-recorded command buffers are recorded inline, since the secondary command pools are reset every frame
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t frame, bool useSecondaryCommandBuffers)
     {
         VkCommandBufferBeginInfo commandBufferBeginInfo {};
         commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1262,11 +2598,34 @@ private:
             throw std::runtime_error("Failed to begin recording command buffer.");
         }
 
-        VkRenderPassBeginInfo renderPassBeginInfo {};
-        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassBeginInfo.renderPass = renderPass;
-        renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassBeginInfo.renderArea.offset = {0, 0};
+        // GPU scopes: the whole frame, the culling pass, the render pass, and within it the draws and the MSAA resolve
+        uint32_t frameScope {GpuProfiler::NO_SCOPE};
+        uint32_t cullingScope {GpuProfiler::NO_SCOPE};
+        uint32_t renderPassScope {GpuProfiler::NO_SCOPE};
+        uint32_t drawScope {GpuProfiler::NO_SCOPE};
+        uint32_t resolveScope {GpuProfiler::NO_SCOPE};
+        if(timestampsEnabled)
+        {
+            gpuProfiler.beginFrame(commandBuffer, frame);
+            frameScope = gpuProfiler.beginScope(commandBuffer, frame, "frame");
+        }
+
+        // Culling runs outside the render pass
+        if(useGpuCulling)
+        {
+            if(timestampsEnabled)
+            {
+                cullingScope = gpuProfiler.beginScope(commandBuffer, frame, "culling");
+            }
+            recordCulling(commandBuffer, frame);
+            gpuProfiler.writeEnd(commandBuffer, frame, cullingScope);
+        }
+
+        VkRenderPassBeginInfo renderPassBeginInfo {};
+        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBeginInfo.renderPass = renderPass;
+        renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassBeginInfo.renderArea.offset = {0, 0};
         renderPassBeginInfo.renderArea.extent = swapChainExtent;
 
         std::array<VkClearValue, 2> clearValues {};
@@ -1275,14 +2634,60 @@ private:
         renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassBeginInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        if(timestampsEnabled)
+        {
+            renderPassScope = gpuProfiler.beginScope(commandBuffer, frame, "render pass");
+            // Written inside the render pass, by the command buffers holding the first and last draws
+            drawScope = gpuProfiler.addScope(frame, "draws");
+            // The resolve runs when the subpass ends, along with the attachment stores
+            if(msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+            {
+                resolveScope = gpuProfiler.addScope(frame, "msaa resolve");
+            }
+        }
+
+        buildRenderQueue();
+        if(useSecondaryCommandBuffers && recordSliceCount > 0)
+        {
+            // The slices of the render queue are recorded in parallel, then executed in order
+            recordSecondaryCommandBuffers(frame, drawScope, resolveScope);
+            vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(commandBuffer, recordSliceCount, &secondaryCommandBuffers[frame*maxRecordSliceCount]);
+        }
+        else
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            DrawStateTracker stateTracker;
+            gpuProfiler.writeBegin(commandBuffer, frame, drawScope);
+            recordDrawState(commandBuffer, frame);
+            recordQueuedDraws(commandBuffer, frame, 0, renderQueue.size(), stateTracker);
+            writeDrawScopeEnd(commandBuffer, frame, drawScope, resolveScope);
+            drawStateChanges = stateTracker.stateChanges();
+        }
+        vkCmdEndRenderPass(commandBuffer);
+
+        gpuProfiler.writeEnd(commandBuffer, frame, resolveScope);
+        gpuProfiler.writeEnd(commandBuffer, frame, renderPassScope);
+        gpuProfiler.writeEnd(commandBuffer, frame, frameScope);
+
+        result = vkEndCommandBuffer(commandBuffer);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to record command buffer.");
+        }
+    }
 
-        // Bind vertex buffer
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    // Ends the draw scope once the draws have completed, which is when the resolve scope starts
+    void writeDrawScopeEnd(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t drawScope, uint32_t resolveScope)
+    {
+        gpuProfiler.writeEnd(commandBuffer, frame, drawScope);
+        gpuProfiler.writeBegin(commandBuffer, frame, resolveScope, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
 
+    // Binds the state which all the draws share. Secondary command buffers don't inherit any of it.
+    // The pipeline, vertex buffers, material and object are bound by the draws which need them.
+    void recordDrawState(VkCommandBuffer commandBuffer, uint32_t frame)
+    {
         // Bind descriptor sets
         vkCmdBindDescriptorSets(
             commandBuffer,
@@ -1290,13 +2695,32 @@ private:
             pipelineLayout,
             0,
             1,
-            &descriptorSets[currentFrame],
+            &descriptorSets[frame],
             0,
             nullptr
         );
+        // All the textures, whichever each object samples
+        if(useBindless)
+        {
+            vkCmdBindDescriptorSets(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelineLayout,
+                3,
+                1,
+                &bindlessDescriptorSet,
+                0,
+                nullptr
+            );
+        }
 
         // Bind index buffer
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, meshIndexType);
+
+        if(usePackedVertices)
+        {
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vertexDequantization), &vertexDequantization);
+        }
 
         // Since we are using dynamic states, we have to set the viewport and scissor before drawing
         VkViewport viewport {};
@@ -1312,18 +2736,196 @@ private:
         scissor.offset = {0, 0};
         scissor.extent = swapChainExtent;
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    // Sorts the sub-meshes every object draws, at its level of detail, by their state, then front to back.
+    // There is a single pipeline and vertex buffer so far, so their parts of the keys are all 0.
+    void buildRenderQueue()
+    {
+        renderQueue.clear();
+        glm::vec3 camera {cameraPosition()};
+        for(uint32_t object {0}; object < options.objectCount; object++)
+        {
+            float depth {glm::length(camera - objectPositions[object])};
+            uint32_t lod {selectLod(object)};
+            for(uint32_t i {lodFirstSubMesh[lod]}; i < lodFirstSubMesh[lod + 1]; i++)
+            {
+                renderQueue.push_back({drawSortKey(0, subMeshes[i].material, 0, depth), object, i});
+            }
+        }
+        sortDrawItems(renderQueue);
+    }
 
+    // Draws the render queue items in [firstItem, endItem), binding only the state which changes from one to the next
+    void recordQueuedDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t firstItem, size_t endItem, DrawStateTracker & stateTracker)
+    {
         // Replaced vkCmdDraw with vkCmdDrawIndexed, which draws the vertices from their indices
         //vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(vertexIndices.size()), 1, 0, 0, 0);
-        vkCmdEndRenderPass(commandBuffer);
-        result = vkEndCommandBuffer(commandBuffer);
-        if(result != VK_SUCCESS)
+        for(size_t item {firstItem}; item < endItem; item++)
         {
-            throw std::runtime_error("Failed to record command buffer.");
+            const DrawItem & draw {renderQueue[item]};
+            if(stateTracker.bind(DrawState::Pipeline, drawKeyPipeline(draw.key)))
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            }
+            if(stateTracker.bind(DrawState::VertexBuffer, drawKeyVertexBuffer(draw.key)))
+            {
+                VkBuffer vertexBuffers[] = {vertexBuffer, useGpuCulling ? visibleInstanceBuffers[frame] : instanceBuffer};
+                VkDeviceSize offsets[] = {0, 0};
+                vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+            }
+            if(stateTracker.bind(DrawState::Material, drawKeyMaterial(draw.key)))
+            {
+                vkCmdBindDescriptorSets(
+                    commandBuffer,
+                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelineLayout,
+                    2,
+                    1,
+                    &materialDescriptorSets[drawKeyMaterial(draw.key)],
+                    0,
+                    nullptr
+                );
+            }
+            // Only the dynamic offset into the object uniform ring changes between objects
+            if(stateTracker.bind(DrawState::Object, draw.object))
+            {
+                uint32_t dynamicOffset {static_cast<uint32_t>(frame*objectUniformFrameSize + draw.object*objectUniformStride)};
+                vkCmdBindDescriptorSets(
+                    commandBuffer,
+                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelineLayout,
+                    1,
+                    1,
+                    &objectDescriptorSet,
+                    1,
+                    &dynamicOffset
+                );
+            }
+
+            stateTracker.countDraw();
+            const SubMesh & subMesh {subMeshes[draw.subMesh]};
+            if(useMeshlets && draw.subMesh < lodFirstSubMesh[1])
+            {
+                recordMeshletDraws(commandBuffer, frame, draw.object, draw.subMesh);
+            }
+            else if(useGpuCulling)
+            {
+                // Only the visible instances, counted by the culling pass.
+                // One command per call, since drawing several at once needs the multiDrawIndirect feature.
+                VkDeviceSize offset {draw.subMesh*sizeof(VkDrawIndexedIndirectCommand)};
+                vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[frame], offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+            }
+            else
+            {
+                vkCmdDrawIndexed(commandBuffer, subMesh.indexCount, activeInstanceCount, subMesh.firstIndex, subMesh.vertexOffset, 0);
+            }
+        }
+    }
+
+    // Draws the meshlet commands of the object's full detail sub-mesh, the culled ones have no instances
+    void recordMeshletDraws(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t object, uint32_t subMesh)
+    {
+        const VkDeviceSize stride {sizeof(VkDrawIndexedIndirectCommand)};
+        VkDeviceSize offset {object*meshlets.size()*stride};
+        for(size_t first {subMeshFirstMeshlet[subMesh]}; first < subMeshFirstMeshlet[subMesh + 1]; first += maxDrawIndirectCount)
+        {
+            uint32_t drawCount {static_cast<uint32_t>(std::min<size_t>(maxDrawIndirectCount, subMeshFirstMeshlet[subMesh + 1] - first))};
+            vkCmdDrawIndexedIndirect(commandBuffer, meshletDrawBuffers[frame], offset + first*stride, drawCount, static_cast<uint32_t>(stride));
+        }
+    }
+
+    // Records one secondary command buffer per slice of the render queue, each on a pool thread with its own command pool.
+    // The first slice starts the draw scope and the last one ends it.
+    void recordSecondaryCommandBuffers(uint32_t frame, uint32_t drawScope, uint32_t resolveScope)
+    {
+        size_t sliceSize {(renderQueue.size() + recordSliceCount - 1) / recordSliceCount};
+        std::vector<DrawStateTracker> stateTrackers(recordSliceCount);
+        threadPool.parallelFor(recordSliceCount, [&](size_t slice)
+        {
+            size_t index {frame*maxRecordSliceCount + slice};
+            // The frame's fence was waited for, so its previous secondary command buffers are done
+            vkResetCommandPool(vkDevice, secondaryCommandPools[index], 0);
+
+            VkCommandBufferInheritanceInfo inheritanceInfo {};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritanceInfo.renderPass = renderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = VK_NULL_HANDLE; // optional
+
+            VkCommandBufferBeginInfo commandBufferBeginInfo {};
+            commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            VkCommandBuffer commandBuffer {secondaryCommandBuffers[index]};
+            VkResult result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+            if(result != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to begin recording secondary command buffer.");
+            }
+
+            size_t firstItem {std::min(slice*sliceSize, renderQueue.size())};
+            size_t endItem {std::min(firstItem + sliceSize, renderQueue.size())};
+            if(slice == 0)
+            {
+                gpuProfiler.writeBegin(commandBuffer, frame, drawScope);
+            }
+            recordDrawState(commandBuffer, frame);
+            recordQueuedDraws(commandBuffer, frame, firstItem, endItem, stateTrackers[slice]);
+            if(slice + 1 == recordSliceCount)
+            {
+                writeDrawScopeEnd(commandBuffer, frame, drawScope, resolveScope);
+            }
+
+            result = vkEndCommandBuffer(commandBuffer);
+            if(result != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to record secondary command buffer.");
+            }
+        });
+
+        drawStateChanges = {};
+        for(const DrawStateTracker & stateTracker : stateTrackers)
+        {
+            drawStateChanges += stateTracker.stateChanges();
         }
     }
 
+    glm::vec3 cameraPosition() const
+    {
+        return sceneScale * glm::vec3(2.0f, 2.0f, 2.0f);
+    }
+
+    // Coarsest level of detail whose error, seen from the camera at the nearest point of the object's instances,
+    // covers fewer than options.lodThreshold pixels.
+    // The camera only moves when the instance count changes, which re-records the pre-recorded command buffers.
+    uint32_t selectLod(uint32_t object) const
+    {
+        // Sphere bounding every instance of the object
+        float radius {meshBoundingRadius + instanceGridCenter * std::sqrt(2.0f)};
+        float distance {std::max(glm::length(cameraPosition() - objectPositions[object]) - radius, CAMERA_NEAR)};
+        float pixelsPerUnit {swapChainExtent.height / (2.0f * std::tan(CAMERA_FIELD_OF_VIEW / 2.0f) * distance)};
+
+        uint32_t lod {0};
+        while(lod + 1 < meshLods.size() && meshLods[lod + 1].error * pixelsPerUnit < options.lodThreshold)
+        {
+            lod++;
+        }
+        return lod;
+    }
+
+    // Triangles drawn for one instance of every object, at their selected levels of detail
+    uint64_t objectTriangleCount() const
+    {
+        uint64_t triangleCount {0};
+        for(uint32_t object {0}; object < options.objectCount; object++)
+        {
+            triangleCount += meshLods[selectLod(object)].indexCount / 3;
+        }
+        return triangleCount;
+    }
+
     void updateUniformBuffer(uint32_t frame)
     {
         static auto startTime {std::chrono::high_resolution_clock::now()};
@@ -1331,68 +2933,178 @@ private:
         float time {std::chrono::duration<float, std::chrono::seconds::period>(currentTime-startTime).count()};
 
         UniformBufferObject ubo {};
-        // rotation around Z-axis, proportional to time
-        ubo.model = glm::rotate(
-            glm::mat4(1.0f),
-            time * glm::radians(90.0f),
-            glm::vec3(0.0f, 0.0f, 1.0f)
-        );
         ubo.view = glm::lookAt(
-            glm::vec3(2.0f, 2.0f, 2.0f),
+            cameraPosition(),
             glm::vec3(0.0f, 0.0f, 0.0f),
             glm::vec3(0.0f, 0.0f, 1.0f)
         );
         ubo.proj = glm::perspective(
-            glm::radians(45.0f),
+            CAMERA_FIELD_OF_VIEW,
             swapChainExtent.width / (float) swapChainExtent.height,
-            0.1f,
-            10.0f
+            CAMERA_NEAR,
+            sceneScale * 10.0f
         );
         // Invert Y axis, because GLM was made for OpenGL
         ubo.proj[1][1] *= -1;
 
         // Copy ubo data to uniformBuffersMapped
         memcpy(uniformBuffersMapped[frame], &ubo, sizeof(ubo));
+
+        // rotation around Z-axis, proportional to time
+        glm::mat4 rotation {glm::rotate(
+            glm::mat4(1.0f),
+            time * glm::radians(90.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f)
+        )};
+
+        // Write the objects into this frame's part of the object uniform ring
+        char * objectData {static_cast<char *>(objectUniformAllocation.mapped) + frame*objectUniformFrameSize};
+        for(uint32_t object {0}; object < options.objectCount; object++)
+        {
+            ObjectUniformBufferObject objectUbo {};
+            objectUbo.model = glm::translate(glm::mat4(1.0f), objectPositions[object]) * rotation;
+            objectUbo.textureIndex = useBindless ? object % bindlessTextureSlots : 0;
+            memcpy(objectData + object*objectUniformStride, &objectUbo, sizeof(objectUbo));
+        }
+
+        if(useMeshlets)
+        {
+            cullMeshlets(frame, ubo.proj * ubo.view, rotation);
+        }
+    }
+
+    // Sets the instance count of the frame's meshlet draw commands, to 0 for the meshlets outside the view frustum
+    // or facing away from the camera. The bounds are widened to cover every instance of the object.
+    void cullMeshlets(uint32_t frame, const glm::mat4 & viewProj, const glm::mat4 & rotation)
+    {
+        // Frustum planes from the rows of the view projection matrix, as in cull.comp
+        glm::vec4 row0 {viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]};
+        glm::vec4 row1 {viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]};
+        glm::vec4 row2 {viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]};
+        glm::vec4 row3 {viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]};
+        std::array<glm::vec4, 6> planes {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2};
+        for(glm::vec4 & plane : planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+
+        glm::vec3 camera {cameraPosition()};
+        float instanceSpread {instanceGridCenter * std::sqrt(2.0f)};
+        glm::mat3 objectRotation {rotation};
+
+        VkDrawIndexedIndirectCommand * drawCommands {static_cast<VkDrawIndexedIndirectCommand *>(meshletDrawBuffersAllocations[frame].mapped)};
+        for(uint32_t object {0}; object < options.objectCount; object++)
+        {
+            // Objects drawn with a coarser level of detail don't use their meshlet commands
+            if(selectLod(object) != 0)
+            {
+                continue;
+            }
+
+            VkDrawIndexedIndirectCommand * objectDrawCommands {drawCommands + object*meshlets.size()};
+            for(size_t i {0}; i < meshlets.size(); i++)
+            {
+                const Meshlet & meshlet {meshlets[i]};
+                glm::vec3 center {objectPositions[object] + objectRotation * glm::vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2])};
+                float radius {meshlet.radius + instanceSpread};
+
+                bool visible {true};
+                for(const glm::vec4 & plane : planes)
+                {
+                    if(glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                    {
+                        visible = false;
+                        break;
+                    }
+                }
+                if(visible)
+                {
+                    glm::vec3 coneAxis {objectRotation * glm::vec3(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2])};
+                    visible = !isMeshletBackfacing(
+                        {center.x, center.y, center.z},
+                        radius,
+                        {coneAxis.x, coneAxis.y, coneAxis.z},
+                        meshlet.coneCutoff,
+                        {camera.x, camera.y, camera.z}
+                    );
+                }
+
+                objectDrawCommands[i].instanceCount = visible ? activeInstanceCount : 0;
+                meshletsDrawn += visible ? 1 : 0;
+            }
+            meshletsTested += meshlets.size();
+        }
     }
 
     void drawFrame()
     {
         vkWaitForFences(vkDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
 
+        // The previous frame which used these queries has finished, so reading them doesn't stall
+        if(timestampsEnabled)
+        {
+            collectTimestamps(currentFrame);
+        }
+
         uint32_t imageIndex;
-        
-        VkResult result = vkAcquireNextImageKHR(vkDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-        if(result == VK_ERROR_OUT_OF_DATE_KHR)
+        VkResult result;
+
+        if(options.headless)
         {
-            recreateSwapChain();
-            return;
+            // Each frame in flight renders to its own offscreen image
+            imageIndex = currentFrame;
         }
-        else if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        else
         {
-            std::cout << result << std::endl;
-            throw std::runtime_error("Failed to acquire swap chain image.");
+            result = vkAcquireNextImageKHR(vkDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+            if(result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                recreateSwapChain();
+                return;
+            }
+            else if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+            {
+                logLine(result);
+                throw std::runtime_error("Failed to acquire swap chain image.");
+            }
         }
 
         // Only reset the fence if we are submitting work
         vkResetFences(vkDevice, 1, &inFlightFences[currentFrame]);
         
-        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        auto recordStart {std::chrono::high_resolution_clock::now()};
+        VkCommandBuffer commandBuffer;
+        if(usePrerecordedCommandBuffers)
+        {
+            commandBuffer = getPrerecordedCommandBuffer(currentFrame, imageIndex);
+        }
+        else
+        {
+            commandBuffer = commandBuffers[currentFrame];
+            vkResetCommandBuffer(commandBuffer, 0);
+            recordCommandBuffer(commandBuffer, imageIndex, currentFrame, true);
+        }
+        if(benchmarkSamples != nullptr)
+        {
+            auto recordEnd {std::chrono::high_resolution_clock::now()};
+            benchmarkSamples->cpuRecordTimes.push_back(std::chrono::duration<double, std::milli>(recordEnd - recordStart).count());
+        }
 
         updateUniformBuffer(currentFrame);
 
         VkSubmitInfo submitInfo {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
+        // In headless mode there is no image to acquire or present, so there is nothing to wait for or signal
         VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
         VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.waitSemaphoreCount = options.headless ? 0 : 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+        submitInfo.pCommandBuffers = &commandBuffer;
         VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.signalSemaphoreCount = options.headless ? 0 : 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
         result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]);
@@ -1400,7 +3112,26 @@ private:
         {
             throw std::runtime_error("Failed to submit draw command buffer.");
         }
+        if(timestampsEnabled)
+        {
+            gpuProfiler.markSubmitted(currentFrame);
+        }
+        gpuFrameTimesPending[currentFrame] = timestampsEnabled && benchmarkSamples != nullptr;
+
+        if(!options.headless)
+        {
+            presentFrame(imageIndex, signalSemaphores);
+        }
+
+        currentFrame++;
+        if(currentFrame == MAX_FRAMES_IN_FLIGHT)
+        {
+            currentFrame = 0;
+        }
+    }
 
+    void presentFrame(uint32_t imageIndex, VkSemaphore * signalSemaphores)
+    {
         VkPresentInfoKHR presentInfo {};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         presentInfo.waitSemaphoreCount = 1;
@@ -1411,7 +3142,7 @@ private:
         presentInfo.pImageIndices = &imageIndex;
         presentInfo.pResults = nullptr; // optional
         
-        result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
         if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
         {
             framebufferResized = false;
@@ -1421,12 +3152,6 @@ private:
         {
             throw std::runtime_error("Failed to present swap chain image.");
         }
-
-        currentFrame++;
-        if(currentFrame == MAX_FRAMES_IN_FLIGHT)
-        {
-            currentFrame = 0;
-        }
     }
 
     void createSyncObjects()
@@ -1459,12 +3184,45 @@ private:
         }
     }
 
+    void checkTimestampSupport()
+    {
+        // GPU times are reported by the headless benchmark, and on request in windowed mode
+        if(!options.headless && !options.gpuProfile && options.gpuTracePath.empty())
+        {
+            return;
+        }
+
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+        timestampPeriod = physicalDeviceProperties.limits.timestampPeriod;
+
+        uint32_t queueFamilyCount {0};
+        vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        // Timestamps can only be written on queues with valid timestamp bits
+        timestampValidBits = queueFamilies[queueFamilyIndices.graphicsFamily.value()].timestampValidBits;
+        timestampsEnabled = timestampValidBits > 0;
+        logLine("timestamps supported: ", timestampsEnabled);
+    }
+
+    void collectTimestamps(uint32_t frame)
+    {
+        if(!gpuProfiler.collect(frame) || !gpuFrameTimesPending[frame])
+        {
+            return;
+        }
+        gpuFrameTimesPending[frame] = false;
+        benchmarkSamples->gpuFrameTimes.push_back(gpuProfiler.lastMilliseconds("frame"));
+    }
+
     void createBuffer(
         VkDeviceSize bufferSize,
         VkBufferUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags,
         VkBuffer & buffer,
-        VkDeviceMemory & bufferMemory
+        GpuAllocation & bufferAllocation
     )
     {
         VkBufferCreateInfo bufferCreateInfo {};
@@ -1482,151 +3240,452 @@ private:
         VkMemoryRequirements memoryRequirements {};
         vkGetBufferMemoryRequirements(vkDevice, buffer, &memoryRequirements);
 
-        VkMemoryAllocateInfo memoryAllocateInfo {};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.allocationSize = memoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = 
-            findMemoryType(
-                memoryRequirements.memoryTypeBits,
-                memoryPropertyFlags);
-
-        result = vkAllocateMemory(vkDevice, &memoryAllocateInfo, nullptr, &bufferMemory);
-        if(result != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to allocate memory for buffer.");
-        }
-
-        vkBindBufferMemory(vkDevice, buffer, bufferMemory, 0);
-    }
-
-    VkCommandBuffer beginSingleTimeCommands()
-    {
-        VkCommandBufferAllocateInfo commandBufferAllocateInfo {};
-        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        commandBufferAllocateInfo.commandPool = commandPool;
-        commandBufferAllocateInfo.commandBufferCount = 1;
-
-        VkCommandBuffer commandBuffer;
-        // ignoring result
-        vkAllocateCommandBuffers(vkDevice, &commandBufferAllocateInfo, &commandBuffer);
-
-        VkCommandBufferBeginInfo commandBufferBeginInfo {};
-        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        // ignoring result
-        vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-
-        return commandBuffer;
-    }
-
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer)
-    {
-        // ignoring result
-        vkEndCommandBuffer(commandBuffer);
-
-        VkSubmitInfo submitInfo {};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+        uint32_t memoryTypeIndex {findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags)};
+        bufferAllocation = gpuAllocator.allocate(memoryRequirements, memoryTypeIndex, true);
 
-        // ignoring results
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
-        vkFreeCommandBuffers(vkDevice, commandPool, 1, &commandBuffer);
+        vkBindBufferMemory(vkDevice, buffer, bufferAllocation.memory, bufferAllocation.offset);
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+    void packMeshVertices()
     {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkBufferCopy copyRegion {};
-        copyRegion.srcOffset = 0; // optional
-        copyRegion.dstOffset = 0; // optional
-        copyRegion.size = size;
-
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-        endSingleTimeCommands(commandBuffer);
+        usePackedVertices = packVertices(meshVertices, meshVertexCount, packedVertices, vertexDequantization);
+        if(usePackedVertices)
+        {
+            logLine("packed ", meshVertexCount, " vertices into ",
+                sizeof(PackedVertex)*meshVertexCount, " bytes, from ",
+                sizeof(Vertex)*meshVertexCount, " bytes");
+        }
+        else
+        {
+            logLine("vertex colors differ, so the vertices are not packed");
+        }
     }
 
     void createVertexBuffer()
     {
-        VkDeviceSize bufferSize {sizeof(vertices[0])*vertices.size()}; // space to store all vertices
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        VkBufferUsageFlags stagingUsageFlags {VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
-        VkMemoryPropertyFlags stagingMemoryPropertyFlags
-        {
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-        createBuffer(
-            bufferSize,
-            stagingUsageFlags,
-            stagingMemoryPropertyFlags,
-            stagingBuffer,
-            stagingBufferMemory
-        );
-
-        // Send vertex data to staging buffer
-        void * data;
-        vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(vkDevice, stagingBufferMemory);
+        // space to store all vertices
+        VkDeviceSize bufferSize {(usePackedVertices ? sizeof(PackedVertex) : sizeof(Vertex))*meshVertexCount};
+        const void * vertexData {usePackedVertices ? static_cast<const void *>(packedVertices.data()) : meshVertices};
 
         VkBufferUsageFlags vertexUsageFlags
         {
             VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
         };
         VkMemoryPropertyFlags vertexMemoryPropertyFlags {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
-        createBuffer(bufferSize, vertexUsageFlags, vertexMemoryPropertyFlags, vertexBuffer, vertexBufferMemory);
-        
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+        createBuffer(bufferSize, vertexUsageFlags, vertexMemoryPropertyFlags, vertexBuffer, vertexBufferAllocation);
 
-        // cleanup
-        vkDestroyBuffer(vkDevice, stagingBuffer, nullptr);
-        vkFreeMemory(vkDevice, stagingBufferMemory, nullptr);
+        // Send vertex data through the staging ring
+        uploadContext.uploadBuffer(vertexBuffer, 0, vertexData, bufferSize);
+        uploadContext.releaseBuffer(vertexBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
     }
 
     void createIndexBuffer()
     {
-        VkDeviceSize bufferSize {sizeof(vertexIndices[0])*vertexIndices.size()};
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        VkBufferUsageFlags stagingUsageFlags {VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
-        VkMemoryPropertyFlags stagingMemoryPropertyFlags
+        // 16 bit indices, relative to each sub-mesh's vertex offset
+        if(options.shortIndices && splitLodsForShortIndices())
         {
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-        createBuffer(
-            bufferSize,
-            stagingUsageFlags,
-            stagingMemoryPropertyFlags,
-            stagingBuffer,
-            stagingBufferMemory
-        );
-
-        // Send vertex index data to staging buffer
-        void * data;
-        vkMapMemory(vkDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertexIndices.data(), (size_t) bufferSize);
-        vkUnmapMemory(vkDevice, stagingBufferMemory);
-
+            meshIndexType = VK_INDEX_TYPE_UINT16;
+            logLine("16 bit indices, ", subMeshes.size(), " sub-meshes");
+        }
+        else
+        {
+            meshIndexType = VK_INDEX_TYPE_UINT32;
+            subMeshes.clear();
+            lodFirstSubMesh.clear();
+            for(size_t lod {0}; lod < meshLods.size(); lod++)
+            {
+                lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+                for(uint32_t material {0}; material < meshMaterials.size(); material++)
+                {
+                    const MeshCacheMaterialRange & range {meshMaterialRanges[lod*meshMaterials.size() + material]};
+                    if(range.indexCount == 0)
+                    {
+                        continue;
+                    }
+                    SubMesh subMesh {};
+                    subMesh.firstIndex = range.firstIndex;
+                    subMesh.indexCount = range.indexCount;
+                    subMesh.vertexOffset = 0;
+                    subMesh.material = material;
+                    subMeshes.push_back(subMesh);
+                }
+            }
+            lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+        }
+        bool useShortIndices {meshIndexType == VK_INDEX_TYPE_UINT16};
+        VkDeviceSize bufferSize {(useShortIndices ? sizeof(uint16_t) : sizeof(uint32_t))*meshIndexCount};
+        const void * indexData {useShortIndices ? static_cast<const void *>(shortIndices.data()) : meshIndices};
+
         VkBufferUsageFlags indexBufferUsageFlags
         {
             VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
         };
         VkMemoryPropertyFlags indexBufferMemoryPropertyFlags {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
-        createBuffer(bufferSize, indexBufferUsageFlags, indexBufferMemoryPropertyFlags, indexBuffer, indexBufferMemory);
-        
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+        createBuffer(bufferSize, indexBufferUsageFlags, indexBufferMemoryPropertyFlags, indexBuffer, indexBufferAllocation);
 
-        // cleanup
-        vkDestroyBuffer(vkDevice, stagingBuffer, nullptr);
-        vkFreeMemory(vkDevice, stagingBufferMemory, nullptr);
+        // Send vertex index data through the staging ring
+        uploadContext.uploadBuffer(indexBuffer, 0, indexData, bufferSize);
+        uploadContext.releaseBuffer(indexBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    }
+
+    // Splits each material range of each level of detail on its own, keeping the ranges in order in shortIndices.
+    // Returns false if one of them can't use 16 bit indices.
+    // The mesh cache only holds the 32 bit indices, so this copies them into shortIndices at every launch, one linear pass.
+    // Only the 32 bit path uploads straight from the mapped cache. The meshlets need the 32 bit indices either way.
+    bool splitLodsForShortIndices()
+    {
+        subMeshes.clear();
+        shortIndices.clear();
+        lodFirstSubMesh.clear();
+        std::vector<SubMesh> rangeSubMeshes;
+        std::vector<uint16_t> rangeShortIndices;
+        for(size_t lod {0}; lod < meshLods.size(); lod++)
+        {
+            lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+            for(uint32_t material {0}; material < meshMaterials.size(); material++)
+            {
+                const MeshCacheMaterialRange & range {meshMaterialRanges[lod*meshMaterials.size() + material]};
+                if(!splitForShortIndices(meshIndices + range.firstIndex, range.indexCount, rangeSubMeshes, rangeShortIndices))
+                {
+                    return false;
+                }
+                for(SubMesh subMesh : rangeSubMeshes)
+                {
+                    subMesh.firstIndex += static_cast<uint32_t>(shortIndices.size());
+                    subMesh.material = material;
+                    subMeshes.push_back(subMesh);
+                }
+                shortIndices.insert(shortIndices.end(), rangeShortIndices.begin(), rangeShortIndices.end());
+            }
+        }
+        lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+        return true;
+    }
+
+    void createCullPipeline()
+    {
+        // The culling pass is recorded in the graphics command buffers, so the graphics queue must support compute
+        uint32_t queueFamilyCount {0};
+        vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
+        bool computeSupported {(queueFamilies[queueFamilyIndices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0};
+
+        // The meshlet draw commands carry the instance count themselves, so they can't use the culled instances
+        useGpuCulling = options.useGpuCulling && !options.meshlets && computeSupported;
+        logLine("gpu culling: ", useGpuCulling);
+
+        VkPushConstantRange pushConstantRange {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(CullPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = &cullDescriptorSetLayout;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+        VkResult result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &cullPipelineLayout);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create culling pipeline layout.");
+        }
+
+        if(!useGpuCulling)
+        {
+            cullPipeline = VK_NULL_HANDLE;
+            return;
+        }
+
+        std::vector<char> cullShaderCode = readFile("shaders/cull.spv");
+        VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+        VkComputePipelineCreateInfo computePipelineCreateInfo {};
+        computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computePipelineCreateInfo.stage.module = cullShaderModule;
+        computePipelineCreateInfo.stage.pName = "main";
+        computePipelineCreateInfo.layout = cullPipelineLayout;
+        computePipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE; // optional
+        computePipelineCreateInfo.basePipelineIndex = -1; // optional
+
+        result = vkCreateComputePipelines(vkDevice, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &cullPipeline);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create culling pipeline.");
+        }
+
+        vkDestroyShaderModule(vkDevice, cullShaderModule, nullptr);
+    }
+
+    // Splits each sub-mesh of the full detail level into meshlets, and creates the per-frame draw command buffers
+    void createMeshlets()
+    {
+        auto startTime {std::chrono::high_resolution_clock::now()};
+        // The 32 bit indices are at the same positions as the 16 bit ones, and index the whole vertex array
+        meshlets.clear();
+        subMeshFirstMeshlet.clear();
+        for(uint32_t i {lodFirstSubMesh[0]}; i < lodFirstSubMesh[1]; i++)
+        {
+            subMeshFirstMeshlet.push_back(static_cast<uint32_t>(meshlets.size()));
+            buildMeshlets(
+                &meshVertices[0].pos.x,
+                sizeof(Vertex),
+                meshVertexCount,
+                meshIndices,
+                subMeshes[i].firstIndex,
+                subMeshes[i].indexCount,
+                subMeshes[i].vertexOffset,
+                meshlets
+            );
+        }
+        subMeshFirstMeshlet.push_back(static_cast<uint32_t>(meshlets.size()));
+        logLine(meshlets.size(), " meshlets built in ",
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count(),
+            " ms");
+
+        // Every meshlet starts visible, until the first frame culls them
+        std::vector<VkDrawIndexedIndirectCommand> drawCommands(meshlets.size()*options.objectCount);
+        for(size_t i {0}; i < drawCommands.size(); i++)
+        {
+            const Meshlet & meshlet {meshlets[i % meshlets.size()]};
+            drawCommands[i].indexCount = meshlet.indexCount;
+            drawCommands[i].instanceCount = activeInstanceCount;
+            drawCommands[i].firstIndex = meshlet.firstIndex;
+            drawCommands[i].vertexOffset = meshlet.vertexOffset;
+            drawCommands[i].firstInstance = 0;
+        }
+
+        // Written every frame by the CPU, so it stays host visible and mapped
+        meshletDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        meshletDrawBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+        for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(
+                sizeof(VkDrawIndexedIndirectCommand)*drawCommands.size(),
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                meshletDrawBuffers[i],
+                meshletDrawBuffersAllocations[i]
+            );
+            memcpy(meshletDrawBuffersAllocations[i].mapped, drawCommands.data(), sizeof(VkDrawIndexedIndirectCommand)*drawCommands.size());
+        }
+        useMeshlets = true;
+    }
+
+    void createCullBuffers()
+    {
+        // Objects rotate around their own position, so the sphere around the instance origin
+        // through the farthest object position plus the mesh radius bounds them all
+        float objectsRadius {0.0f};
+        for(const glm::vec3 & position : objectPositions)
+        {
+            objectsRadius = std::max(objectsRadius, glm::length(position));
+        }
+        cullBoundingRadius = objectsRadius + meshBoundingRadius;
+
+        visibleInstanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        visibleInstanceBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+        indirectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        indirectBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+
+        // One set per frame in flight, since the culling pass of a frame can run while the previous frame is drawn
+        for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(
+                sizeof(InstanceData)*instanceCapacity,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                visibleInstanceBuffers[i],
+                visibleInstanceBuffersAllocations[i]
+            );
+            createBuffer(
+                sizeof(VkDrawIndexedIndirectCommand)*subMeshes.size(),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                indirectBuffers[i],
+                indirectBuffersAllocations[i]
+            );
+        }
+    }
+
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t frame)
+    {
+        // Reset the draw commands with no instances, the culling pass counts them
+        std::vector<VkDrawIndexedIndirectCommand> drawCommands(subMeshes.size());
+        for(size_t i {0}; i < subMeshes.size(); i++)
+        {
+            drawCommands[i].indexCount = subMeshes[i].indexCount;
+            drawCommands[i].instanceCount = 0;
+            drawCommands[i].firstIndex = subMeshes[i].firstIndex;
+            drawCommands[i].vertexOffset = subMeshes[i].vertexOffset;
+            drawCommands[i].firstInstance = 0;
+        }
+        // vkCmdUpdateBuffer writes at most 65536 bytes at a time
+        const size_t updateSize {65536};
+        size_t drawCommandsSize {drawCommands.size()*sizeof(VkDrawIndexedIndirectCommand)};
+        for(size_t offset {0}; offset < drawCommandsSize; offset += updateSize)
+        {
+            vkCmdUpdateBuffer(
+                commandBuffer,
+                indirectBuffers[frame],
+                offset,
+                std::min(updateSize, drawCommandsSize - offset),
+                reinterpret_cast<const char *>(drawCommands.data()) + offset
+            );
+        }
+
+        VkMemoryBarrier resetBarrier {};
+        resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &resetBarrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            cullPipelineLayout,
+            0,
+            1,
+            &cullDescriptorSets[frame],
+            0,
+            nullptr
+        );
+
+        CullPushConstants pushConstants {};
+        pushConstants.instanceCount = activeInstanceCount;
+        pushConstants.boundingRadius = cullBoundingRadius;
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        vkCmdDispatch(commandBuffer, (activeInstanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+        // The draw reads the command and the visible instances written by the culling pass,
+        // and the copy below reads the instance count
+        VkMemoryBarrier cullBarrier {};
+        cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            1, &cullBarrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        // The culling pass only counts the visible instances into the first command, so a single counter is contended.
+        // Its count is copied into the other commands of the levels of detail some object draws this frame.
+        std::vector<bool> lodDrawn(meshLods.size(), false);
+        for(uint32_t object {0}; object < options.objectCount; object++)
+        {
+            lodDrawn[selectLod(object)] = true;
+        }
+        const VkDeviceSize instanceCountOffset {offsetof(VkDrawIndexedIndirectCommand, instanceCount)};
+        std::vector<VkBufferCopy> countCopies;
+        for(size_t lod {0}; lod < meshLods.size(); lod++)
+        {
+            if(!lodDrawn[lod])
+            {
+                continue;
+            }
+            for(uint32_t subMesh {std::max(lodFirstSubMesh[lod], 1u)}; subMesh < lodFirstSubMesh[lod + 1]; subMesh++)
+            {
+                countCopies.push_back({instanceCountOffset, subMesh*sizeof(VkDrawIndexedIndirectCommand) + instanceCountOffset, sizeof(uint32_t)});
+            }
+        }
+        if(countCopies.empty())
+        {
+            return;
+        }
+        vkCmdCopyBuffer(commandBuffer, indirectBuffers[frame], indirectBuffers[frame], static_cast<uint32_t>(countCopies.size()), countCopies.data());
+
+        VkMemoryBarrier copyBarrier {};
+        copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        copyBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0,
+            1, &copyBarrier,
+            0, nullptr,
+            0, nullptr
+        );
+    }
+
+    void createInstanceBuffer()
+    {
+        // The benchmark reuses the buffer for all its instance counts
+        instanceCapacity = options.benchmarkInstances ? std::max(options.instanceCount, INSTANCE_BENCHMARK_MAX) : options.instanceCount;
+        activeInstanceCount = options.instanceCount;
+
+        // The instances fill square rings around the origin, so the active ones are the first of the buffer
+        // and stay centered whatever their count
+        float spacing {instanceSpacing()};
+        std::vector<InstanceData> instances(instanceCapacity);
+        for(uint32_t instance {0}; instance < instanceCapacity; instance++)
+        {
+            glm::ivec2 cell {squareRingCell(instance)};
+            glm::vec3 position {cell.x * spacing, cell.y * spacing, 0.0f};
+            instances[instance].transform = glm::translate(glm::mat4(1.0f), position);
+
+            // The first instance is untinted, the others get a pale color of their own
+            float phase {static_cast<float>(instance)};
+            instances[instance].tint = {
+                1.0f - 0.4f * glm::fract(phase * 0.618034f),
+                1.0f - 0.4f * glm::fract(phase * 0.754878f),
+                1.0f - 0.4f * glm::fract(phase * 0.569840f),
+                1.0f
+            };
+        }
+
+        VkDeviceSize bufferSize {sizeof(InstanceData)*instanceCapacity};
+
+        // Read as a storage buffer by the culling pass, or directly as a vertex buffer without it
+        VkBufferUsageFlags instanceUsageFlags
+        {
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        };
+        VkMemoryPropertyFlags instanceMemoryPropertyFlags {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
+        createBuffer(bufferSize, instanceUsageFlags, instanceMemoryPropertyFlags, instanceBuffer, instanceBufferAllocation);
+
+        // Send instance data through the staging ring. It is copied before uploadBuffer returns.
+        uploadContext.uploadBuffer(instanceBuffer, 0, instances.data(), bufferSize);
+        uploadContext.releaseBuffer(
+            instanceBuffer,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+        );
+    }
+
+    // Each instance moves a whole grid of objects, so the instance grid is spaced by the object grid's width
+    float instanceSpacing() const
+    {
+        return squareGridSide(options.objectCount) * OBJECT_SPACING;
+    }
+
+    // Fits the camera and the bounds of the instances to the active instances, not to the capacity of the instance buffer.
+    // Must be called again whenever activeInstanceCount changes.
+    void updateSceneScale()
+    {
+        float objectGridCenter {(squareGridSide(options.objectCount) - 1) * OBJECT_SPACING / 2.0f};
+        instanceGridCenter = squareRing(std::max(activeInstanceCount, 1u) - 1) * instanceSpacing();
+        sceneScale = std::max(1.0f, objectGridCenter + instanceGridCenter);
     }
 
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags)
@@ -1651,7 +3710,7 @@ private:
     void createUniformBuffers()
     {
         uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        uniformBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
         uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
         
         const VkDeviceSize bufferSize {sizeof(UniformBufferObject)};
@@ -1663,25 +3722,92 @@ private:
 
         for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            createBuffer(bufferSize, usageFlags, memoryPropertyFlags, uniformBuffers[i], uniformBuffersMemory[i]);
+            createBuffer(bufferSize, usageFlags, memoryPropertyFlags, uniformBuffers[i], uniformBuffersAllocations[i]);
+
+            // The allocator keeps host visible memory mapped
+            uniformBuffersMapped[i] = uniformBuffersAllocations[i].mapped;
+        }
+    }
+
+    void createObjectUniformBuffer()
+    {
+        // Place the objects on a square grid around the origin
+        uint32_t gridSide {squareGridSide(options.objectCount)};
+        float gridCenter {(gridSide - 1) * OBJECT_SPACING / 2.0f};
+        objectPositions.resize(options.objectCount);
+        for(uint32_t object {0}; object < options.objectCount; object++)
+        {
+            objectPositions[object] = {
+                (object % gridSide) * OBJECT_SPACING - gridCenter,
+                (object / gridSide) * OBJECT_SPACING - gridCenter,
+                0.0f
+            };
+        }
+        updateSceneScale();
+
+        // Dynamic offsets must be multiples of minUniformBufferOffsetAlignment
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+        VkDeviceSize alignment {physicalDeviceProperties.limits.minUniformBufferOffsetAlignment};
+        objectUniformStride = (sizeof(ObjectUniformBufferObject) + alignment - 1) / alignment * alignment;
+        objectUniformFrameSize = objectUniformStride * options.objectCount;
+
+        // Written every frame by the CPU, so it stays host visible and mapped
+        createBuffer(
+            objectUniformFrameSize * MAX_FRAMES_IN_FLIGHT,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            objectUniformBuffer,
+            objectUniformAllocation
+        );
+    }
+
+    void createMaterialUniformBuffer()
+    {
+        // Each material's descriptor set starts at a multiple of minUniformBufferOffsetAlignment
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+        VkDeviceSize alignment {physicalDeviceProperties.limits.minUniformBufferOffsetAlignment};
+        materialUniformStride = (sizeof(MaterialUniformBufferObject) + alignment - 1) / alignment * alignment;
 
-            vkMapMemory(vkDevice, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+        // Small and written once, so it stays host visible instead of going through the staging ring
+        createBuffer(
+            materialUniformStride * meshMaterials.size(),
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            materialUniformBuffer,
+            materialUniformAllocation
+        );
+        char * materialData {static_cast<char *>(materialUniformAllocation.mapped)};
+        for(size_t material {0}; material < meshMaterials.size(); material++)
+        {
+            const float * diffuse {meshMaterials[material].diffuse};
+            MaterialUniformBufferObject materialUbo {};
+            materialUbo.diffuse = glm::vec4(diffuse[0], diffuse[1], diffuse[2], 1.0f);
+            memcpy(materialData + material*materialUniformStride, &materialUbo, sizeof(materialUbo));
         }
     }
 
     void createDescriptorPool()
     {
-        std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes {};
+        std::array<VkDescriptorPoolSize, 4> descriptorPoolSizes {};
+        // The culling sets read the camera uniform buffer too, and each material set has its uniform buffer
+        uint32_t materialCount {static_cast<uint32_t>(meshMaterials.size())};
         descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorPoolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        descriptorPoolSizes[0].descriptorCount = static_cast<uint32_t>(2*MAX_FRAMES_IN_FLIGHT) + materialCount;
         descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         descriptorPoolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        // One object descriptor set, shared by all frames
+        descriptorPoolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorPoolSizes[2].descriptorCount = 1;
+        descriptorPoolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSizes[3].descriptorCount = static_cast<uint32_t>(3*MAX_FRAMES_IN_FLIGHT);
 
         VkDescriptorPoolCreateInfo descriptorPoolCreateInfo {};
         descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
         descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSizes.data();
-        descriptorPoolCreateInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        descriptorPoolCreateInfo.maxSets = static_cast<uint32_t>(2*MAX_FRAMES_IN_FLIGHT) + 1 + materialCount;
 
         VkResult result = vkCreateDescriptorPool(vkDevice, &descriptorPoolCreateInfo, nullptr, &descriptorPool);
         if(result != VK_SUCCESS)
@@ -1744,6 +3870,183 @@ private:
 
             vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
         }
+
+        // The object set covers one object, the dynamic offset selects the frame and object
+        descriptorSetAllocateInfo.descriptorSetCount = 1;
+        descriptorSetAllocateInfo.pSetLayouts = &objectDescriptorSetLayout;
+        result = vkAllocateDescriptorSets(vkDevice, &descriptorSetAllocateInfo, &objectDescriptorSet);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate object descriptor set.");
+        }
+
+        VkDescriptorBufferInfo objectDescriptorBufferInfo {};
+        objectDescriptorBufferInfo.buffer = objectUniformBuffer;
+        objectDescriptorBufferInfo.offset = 0;
+        objectDescriptorBufferInfo.range = sizeof(ObjectUniformBufferObject);
+
+        VkWriteDescriptorSet objectDescriptorWrite {};
+        objectDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        objectDescriptorWrite.dstSet = objectDescriptorSet;
+        objectDescriptorWrite.dstBinding = 0;
+        objectDescriptorWrite.dstArrayElement = 0;
+        objectDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        objectDescriptorWrite.descriptorCount = 1;
+        objectDescriptorWrite.pBufferInfo = &objectDescriptorBufferInfo;
+
+        vkUpdateDescriptorSets(vkDevice, 1, &objectDescriptorWrite, 0, nullptr);
+
+        // One set per material, each covering its part of the material uniform buffer
+        std::vector<VkDescriptorSetLayout> materialDescriptorSetLayouts(meshMaterials.size(), materialDescriptorSetLayout);
+        descriptorSetAllocateInfo.descriptorSetCount = static_cast<uint32_t>(materialDescriptorSetLayouts.size());
+        descriptorSetAllocateInfo.pSetLayouts = materialDescriptorSetLayouts.data();
+        materialDescriptorSets.resize(meshMaterials.size());
+        result = vkAllocateDescriptorSets(vkDevice, &descriptorSetAllocateInfo, materialDescriptorSets.data());
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate material descriptor sets.");
+        }
+
+        std::vector<VkDescriptorBufferInfo> materialDescriptorBufferInfos(meshMaterials.size());
+        std::vector<VkWriteDescriptorSet> materialDescriptorWrites(meshMaterials.size());
+        for(size_t material {0}; material < meshMaterials.size(); material++)
+        {
+            materialDescriptorBufferInfos[material].buffer = materialUniformBuffer;
+            materialDescriptorBufferInfos[material].offset = material*materialUniformStride;
+            materialDescriptorBufferInfos[material].range = sizeof(MaterialUniformBufferObject);
+
+            materialDescriptorWrites[material].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            materialDescriptorWrites[material].dstSet = materialDescriptorSets[material];
+            materialDescriptorWrites[material].dstBinding = 0;
+            materialDescriptorWrites[material].dstArrayElement = 0;
+            materialDescriptorWrites[material].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            materialDescriptorWrites[material].descriptorCount = 1;
+            materialDescriptorWrites[material].pBufferInfo = &materialDescriptorBufferInfos[material];
+        }
+        vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(materialDescriptorWrites.size()), materialDescriptorWrites.data(), 0, nullptr);
+
+        if(useGpuCulling)
+        {
+            createCullDescriptorSets();
+        }
+        if(useBindless)
+        {
+            createBindlessDescriptorSet();
+        }
+    }
+
+    // One set for the whole application, never reallocated, so it is bound once per command buffer
+    // however many textures it holds
+    void createBindlessDescriptorSet()
+    {
+        VkDescriptorPoolSize poolSize {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = bindlessTextureCapacity;
+
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo {};
+        descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &poolSize;
+        descriptorPoolCreateInfo.maxSets = 1;
+
+        VkResult result = vkCreateDescriptorPool(vkDevice, &descriptorPoolCreateInfo, nullptr, &bindlessDescriptorPool);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create bindless descriptor pool.");
+        }
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo {};
+        descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        descriptorSetAllocateInfo.descriptorPool = bindlessDescriptorPool;
+        descriptorSetAllocateInfo.descriptorSetCount = 1;
+        descriptorSetAllocateInfo.pSetLayouts = &bindlessDescriptorSetLayout;
+        result = vkAllocateDescriptorSets(vkDevice, &descriptorSetAllocateInfo, &bindlessDescriptorSet);
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate bindless descriptor set.");
+        }
+
+        for(uint32_t slot {0}; slot < options.bindlessTextureCount; slot++)
+        {
+            addBindlessTexture(textureImageView, textureSampler);
+        }
+    }
+
+    // Writes the texture into the next free slot of the bindless array, and returns the slot.
+    // Update after bind allows this while command buffers using the set are pending.
+    uint32_t addBindlessTexture(VkImageView imageView, VkSampler sampler)
+    {
+        if(bindlessTextureSlots == bindlessTextureCapacity)
+        {
+            throw std::runtime_error("The bindless texture array is full.");
+        }
+
+        VkDescriptorImageInfo descriptorImageInfo {};
+        descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        descriptorImageInfo.imageView = imageView;
+        descriptorImageInfo.sampler = sampler;
+
+        VkWriteDescriptorSet descriptorWrite {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = bindlessDescriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = bindlessTextureSlots;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &descriptorImageInfo;
+        vkUpdateDescriptorSets(vkDevice, 1, &descriptorWrite, 0, nullptr);
+
+        return bindlessTextureSlots++;
+    }
+
+    void createCullDescriptorSets()
+    {
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts = std::vector(MAX_FRAMES_IN_FLIGHT, cullDescriptorSetLayout);
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo {};
+        descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        descriptorSetAllocateInfo.descriptorPool = descriptorPool;
+        descriptorSetAllocateInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        descriptorSetAllocateInfo.pSetLayouts = descriptorSetLayouts.data();
+
+        cullDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        VkResult result = vkAllocateDescriptorSets(vkDevice, &descriptorSetAllocateInfo, cullDescriptorSets.data());
+        if(result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate culling descriptor sets.");
+        }
+
+        for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            std::array<VkDescriptorBufferInfo, 4> descriptorBufferInfos {};
+            descriptorBufferInfos[0].buffer = uniformBuffers[i];
+            descriptorBufferInfos[0].offset = 0;
+            descriptorBufferInfos[0].range = sizeof(UniformBufferObject);
+            descriptorBufferInfos[1].buffer = instanceBuffer;
+            descriptorBufferInfos[1].offset = 0;
+            descriptorBufferInfos[1].range = VK_WHOLE_SIZE;
+            descriptorBufferInfos[2].buffer = visibleInstanceBuffers[i];
+            descriptorBufferInfos[2].offset = 0;
+            descriptorBufferInfos[2].range = VK_WHOLE_SIZE;
+            descriptorBufferInfos[3].buffer = indirectBuffers[i];
+            descriptorBufferInfos[3].offset = 0;
+            descriptorBufferInfos[3].range = VK_WHOLE_SIZE;
+
+            std::array<VkWriteDescriptorSet, 4> descriptorWrites {};
+            for(uint32_t binding {0}; binding < descriptorWrites.size(); binding++)
+            {
+                descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[binding].dstSet = cullDescriptorSets[i];
+                descriptorWrites[binding].dstBinding = binding;
+                descriptorWrites[binding].dstArrayElement = 0;
+                descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[binding].descriptorCount = 1;
+                descriptorWrites[binding].pBufferInfo = &descriptorBufferInfos[binding];
+            }
+
+            vkUpdateDescriptorSets(vkDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
     }
 
     void createImage(
@@ -1756,7 +4059,7 @@ private:
         VkImageUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags,
         VkImage & image,
-        VkDeviceMemory & imageMemory
+        GpuAllocation & imageAllocation
     )
     {
         VkImageCreateInfo imageCreateInfo {};
@@ -1784,21 +4087,14 @@ private:
         VkMemoryRequirements memoryRequirements;
         vkGetImageMemoryRequirements(vkDevice, image, &memoryRequirements);
 
-        VkMemoryAllocateInfo memoryAllocateInfo {};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.allocationSize = memoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags);
-
-        result = vkAllocateMemory(vkDevice, &memoryAllocateInfo, nullptr, &imageMemory);
-        if(result != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to alloc image memory.");
-        }
+        uint32_t memoryTypeIndex {findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags)};
+        imageAllocation = gpuAllocator.allocate(memoryRequirements, memoryTypeIndex, tiling == VK_IMAGE_TILING_LINEAR);
 
-        vkBindImageMemory(vkDevice, image, imageMemory, 0);
+        vkBindImageMemory(vkDevice, image, imageAllocation.memory, imageAllocation.offset);
     }
 
     void transitionImageLayout(
+        VkCommandBuffer commandBuffer,
         VkImage image,
         VkFormat format,
         VkImageLayout oldLayout,
@@ -1806,8 +4102,6 @@ private:
         uint32_t mipLevels
     )
     {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
         VkPipelineStageFlags sourceStage;
         VkPipelineStageFlags destinationStage;
 
@@ -1856,42 +4150,6 @@ private:
             1,
             &barrier
         );
-
-        endSingleTimeCommands(commandBuffer);
-    }
-
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-    {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkBufferImageCopy region {};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-
-        region.imageOffset = {0, 0, 0};
-        region.imageExtent =
-        {
-            width,
-            height,
-            1
-        };
-
-        vkCmdCopyBufferToImage(
-            commandBuffer,
-            buffer,
-            image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &region
-        );
-
-        endSingleTimeCommands(commandBuffer);
     }
 
     VkFormat findSupportedFormat(
@@ -1958,12 +4216,13 @@ private:
             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             depthImage,
-            depthImageMemory
+            depthImageAllocation
         );
         depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
     }
 
     void generateMipmaps(
+        VkCommandBuffer commandBuffer,
         VkImage image,
         VkFormat imageFormat,
         uint32_t textureWidth,
@@ -1971,16 +4230,7 @@ private:
         uint32_t mipLevels
     )
     {
-        // First check if image format supports linear blitting
-        VkFormatProperties formatProperties;
-        vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, imageFormat, &formatProperties);
-        if(!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
-        {
-            throw std::runtime_error("Texture image format doesn't support linear blitting.");
-        }
-
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+        // The caller checks with isLinearBlitSupported that the format supports linear blitting
         VkImageMemoryBarrier barrier {};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.image = image;
@@ -2099,38 +4349,180 @@ private:
             1,
             &barrier
         );
-
-        endSingleTimeCommands(commandBuffer);
     }
 
+    // Uploads the texture decoded by decodeTexture
     void createTextureImage()
     {
-        int textureWidth, textureHeight, textureChannels;
-        // STBI_rgb_alpha forces to load with an alpha channel
-        stbi_uc * pixels {stbi_load(TEXTURE_PATH.c_str(), &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha)};
-        if(!pixels)
+        if(decodedTexture.hasContainer)
         {
-            throw std::runtime_error("Failed to load texture image.");
+            uploadTextureContainer(decodedTexture.container);
+            decodedTexture.containerFile.close();
+            return;
         }
-        
-        VkDeviceSize imageSize = textureWidth*textureHeight*4; // 4 bytes per pixel
-        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(textureWidth, textureHeight)))) + 1;
-
-        // Create a staging buffer to receive the image data
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        VkBufferUsageFlags usageFlags {VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
-        VkMemoryPropertyFlags memoryPropertyFlags {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
-        createBuffer(imageSize, usageFlags, memoryPropertyFlags, stagingBuffer, stagingBufferMemory);
-
-        // Copy the image data to the staging buffer
-        void * data;
-        vkMapMemory(vkDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(vkDevice, stagingBufferMemory);
 
-        // cleanup
-        stbi_image_free(pixels);
+        uploadRgbaTexture(decodedTexture.pixels.data(), decodedTexture.width, decodedTexture.height);
+
+        // cleanup, the pixels were copied into the staging ring
+        decodedTexture.pixels = {};
+    }
+
+    // Maps the texture container when it was made from the current texture image.
+    // Returns false if there is no such container.
+    bool readTextureContainerFile()
+    {
+        MappedFile sourceFile;
+        if(!sourceFile.open(TEXTURE_PATH))
+        {
+            return false;
+        }
+        uint64_t sourceHash {hashBytes(sourceFile.data(), sourceFile.size())};
+        sourceFile.close();
+
+        return decodedTexture.containerFile.open(TEXTURE_CONTAINER_PATH) &&
+            readTextureContainer(decodedTexture.containerFile, sourceHash, decodedTexture.container);
+    }
+
+    void uploadTextureContainer(const TextureContainerView & view)
+    {
+        VkFormat format {textureEncodingFormat(view.encoding)};
+        if(isBlockCompressed(view.encoding) && !isSampledFormatSupported(format))
+        {
+            // Decode every level on the thread pool, which keeps the precomputed mip chain.
+            // This runs on the main thread, so the pool is free to take the blocks.
+            logLine("texture: ", textureEncodingName(view.encoding), " unsupported, decoding to rgba8");
+            std::vector<std::vector<uint8_t>> decodedLevels(view.levelCount);
+            std::vector<ImageLevel> levels(view.levelCount);
+            for(uint32_t level {0}; level < view.levelCount; level++)
+            {
+                decodedLevels[level] = decompressImage(view.levelData(level), view.levels[level].width, view.levels[level].height, view.encoding, threadPool);
+                levels[level] = {view.levels[level].width, view.levels[level].height, decodedLevels[level].data()};
+            }
+            uploadTextureLevels(TextureEncoding::RGBA8, VK_FORMAT_R8G8B8A8_SRGB, levels);
+            return;
+        }
+
+        logLine("texture: ", textureEncodingName(view.encoding), " from ", TEXTURE_CONTAINER_PATH);
+        std::vector<ImageLevel> levels(view.levelCount);
+        for(uint32_t level {0}; level < view.levelCount; level++)
+        {
+            levels[level] = {view.levels[level].width, view.levels[level].height, view.levelData(level)};
+        }
+        uploadTextureLevels(view.encoding, format, levels);
+    }
+
+    static VkFormat textureEncodingFormat(TextureEncoding encoding)
+    {
+        switch(encoding)
+        {
+            case TextureEncoding::RGBA8: return VK_FORMAT_R8G8B8A8_SRGB;
+            case TextureEncoding::BC1: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+            case TextureEncoding::BC3: return VK_FORMAT_BC3_SRGB_BLOCK;
+            case TextureEncoding::BC7: return VK_FORMAT_BC7_SRGB_BLOCK;
+        }
+        throw std::invalid_argument("Unknown texture encoding.");
+    }
+
+    bool isSampledFormatSupported(VkFormat format)
+    {
+        if(!textureCompressionBCSupported)
+        {
+            return false;
+        }
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, format, &formatProperties);
+        return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+    }
+
+    // Blitting mip levels with VK_FILTER_LINEAR needs linear filtering support for the format
+    bool isLinearBlitSupported(VkFormat format)
+    {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, format, &formatProperties);
+        return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+    }
+
+    // Uploads a whole mip chain of the encoding as it is, with one copy command
+    void uploadTextureLevels(TextureEncoding encoding, VkFormat format, const std::vector<ImageLevel> & levels)
+    {
+        mipLevels = static_cast<uint32_t>(levels.size());
+        textureFormat = format;
+        textureEncoding = encoding;
+
+        createImage(
+            levels[0].width,
+            levels[0].height,
+            mipLevels,
+            VK_SAMPLE_COUNT_1_BIT,
+            textureFormat,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            textureImage,
+            textureImageAllocation
+        );
+
+        transitionImageLayout(
+            uploadContext.transferCommandBuffer(),
+            textureImage,
+            textureFormat,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            mipLevels
+        );
+
+        uint32_t blockExtent {isBlockCompressed(encoding) ? TEXTURE_BLOCK_EXTENT : 1};
+        uploadContext.uploadImageLevels(textureImage, levels, textureBlockSize(encoding), blockExtent);
+        textureBytes = 0;
+        for(const ImageLevel & level : levels)
+        {
+            textureBytes += encodedImageSize(encoding, level.width, level.height);
+        }
+
+        VkImageSubresourceRange subresourceRange {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.baseMipLevel = 0;
+        subresourceRange.levelCount = mipLevels;
+        subresourceRange.baseArrayLayer = 0;
+        subresourceRange.layerCount = 1;
+        uploadContext.releaseImage(
+            textureImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            subresourceRange,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT
+        );
+
+        transitionImageLayout(
+            uploadContext.graphicsCommandBuffer(),
+            textureImage,
+            textureFormat,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            mipLevels
+        );
+    }
+
+    // Uploads the largest level, and generates the others with blits.
+    // Without linear blit support the mip chain is generated on the CPU instead.
+    void uploadRgbaTexture(const uint8_t * pixels, uint32_t textureWidth, uint32_t textureHeight)
+    {
+        if(!isLinearBlitSupported(VK_FORMAT_R8G8B8A8_SRGB))
+        {
+            logLine("texture: linear blits unsupported, generating mip levels on the cpu");
+            std::vector<MipLevel> mipChain {generateMipChain(pixels, textureWidth, textureHeight, threadPool)};
+            std::vector<ImageLevel> levels;
+            for(const MipLevel & mip : mipChain)
+            {
+                levels.push_back({mip.width, mip.height, mip.texels.data()});
+            }
+            uploadTextureLevels(TextureEncoding::RGBA8, VK_FORMAT_R8G8B8A8_SRGB, levels);
+            return;
+        }
+
+        textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+        textureEncoding = TextureEncoding::RGBA8;
+        mipLevels = mipLevelCount(textureWidth, textureHeight);
 
         createImage(
             textureWidth,
@@ -2142,11 +4534,12 @@ private:
             VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             textureImage,
-            textureImageMemory
+            textureImageAllocation
         );
 
         // prepare image to copy from staging buffer to image
         transitionImageLayout(
+            uploadContext.transferCommandBuffer(),
             textureImage,
             VK_FORMAT_R8G8B8A8_SRGB,
             VK_IMAGE_LAYOUT_UNDEFINED,
@@ -2154,14 +4547,37 @@ private:
             mipLevels
         );
 
-        copyBufferToImage(
-            stagingBuffer,
+        // Copy the image data through the staging ring, 4 bytes per pixel
+        uploadContext.uploadImage(
             textureImage,
-            static_cast<uint32_t>(textureWidth),
-            static_cast<uint32_t>(textureHeight)
+            0,
+            textureWidth,
+            textureHeight,
+            4,
+            pixels
+        );
+        textureBytes = 0;
+        for(uint32_t level {0}; level < mipLevels; level++)
+        {
+            textureBytes += encodedImageSize(TextureEncoding::RGBA8, std::max(1u, textureWidth >> level), std::max(1u, textureHeight >> level));
+        }
+
+        // Blits need the graphics queue
+        VkImageSubresourceRange subresourceRange {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.baseMipLevel = 0;
+        subresourceRange.levelCount = mipLevels;
+        subresourceRange.baseArrayLayer = 0;
+        subresourceRange.layerCount = 1;
+        uploadContext.releaseImage(
+            textureImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            subresourceRange,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
         );
 
-        generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, textureWidth, textureHeight, mipLevels);
+        generateMipmaps(uploadContext.graphicsCommandBuffer(), textureImage, VK_FORMAT_R8G8B8A8_SRGB, textureWidth, textureHeight, mipLevels);
 
         // The transition to shader read only optimal will be made in generateMipmaps.
         /*
@@ -2173,15 +4589,11 @@ private:
             mipLevels
         );
         */
-
-        // cleanup
-        vkDestroyBuffer(vkDevice, stagingBuffer, nullptr);
-        vkFreeMemory(vkDevice, stagingBufferMemory, nullptr);
     }
 
     void createTextureImageView()
     {
-        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+        textureImageView = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
     }
 
     void createTextureSampler()
@@ -2217,6 +4629,99 @@ private:
     }
 
     void loadModel()
+    {
+        auto startTime {std::chrono::high_resolution_clock::now()};
+
+        // The source file is mapped too, so hashing it doesn't copy it
+        MappedFile sourceFile;
+        if(!sourceFile.open(MODEL_PATH))
+        {
+            throw std::runtime_error("Failed to open model " + MODEL_PATH);
+        }
+        uint64_t sourceHash {hashBytes(sourceFile.data(), sourceFile.size())};
+        // The materials come from the libraries the OBJ file names, so editing one of them rebuilds the cache too
+        for(const std::string & library : objMaterialLibraries(sourceFile.data(), sourceFile.size()))
+        {
+            MappedFile libraryFile;
+            if(libraryFile.open(MODEL_DIRECTORY + library))
+            {
+                sourceHash = hashBytes(libraryFile.data(), libraryFile.size(), sourceHash);
+            }
+            else
+            {
+                // Its materials are missing until the library appears
+                sourceHash = hashBytes(library.data(), library.size(), sourceHash);
+            }
+        }
+        sourceFile.close();
+
+        if(options.useMeshCache && meshCacheFile.open(MESH_CACHE_PATH))
+        {
+            MeshCacheView view {};
+            if(readMeshCache(meshCacheFile, sourceHash, sizeof(Vertex), view))
+            {
+                meshVertices = static_cast<const Vertex *>(view.vertexData);
+                meshVertexCount = view.vertexCount;
+                meshIndices = view.indexData;
+                meshIndexCount = view.indexCount;
+                meshLods.assign(view.lodData, view.lodData + view.lodCount);
+                meshMaterials.assign(view.materialData, view.materialData + view.materialCount);
+                meshMaterialRanges.assign(view.materialRangeData, view.materialRangeData + view.lodCount*view.materialCount);
+
+                logLine("loaded mesh cache in ",
+                    std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count(),
+                    " ms");
+                return;
+            }
+            // Stale or invalid cache
+            meshCacheFile.close();
+        }
+
+        parseModel();
+
+        meshVertices = vertices.data();
+        meshVertexCount = static_cast<uint32_t>(vertices.size());
+        meshIndices = vertexIndices.data();
+        meshIndexCount = static_cast<uint32_t>(vertexIndices.size());
+
+        logLine("parsed model in ",
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count(),
+            " ms");
+
+        if(options.useMeshCache)
+        {
+            // Not fatal, the model is just parsed again next time
+            if(!writeMeshCache(
+                MESH_CACHE_PATH,
+                sourceHash,
+                meshVertices,
+                sizeof(Vertex),
+                meshVertexCount,
+                meshIndices,
+                meshIndexCount,
+                meshLods.data(),
+                static_cast<uint32_t>(meshLods.size()),
+                meshMaterials.data(),
+                static_cast<uint32_t>(meshMaterials.size()),
+                meshMaterialRanges.data()
+            ))
+            {
+                logLine("Failed to write mesh cache ", MESH_CACHE_PATH);
+            }
+        }
+    }
+
+    void computeMeshBoundingRadius()
+    {
+        meshBoundingRadius = 0.0f;
+        for(uint32_t i {0}; i < meshVertexCount; i++)
+        {
+            meshBoundingRadius = std::max(meshBoundingRadius, glm::length(meshVertices[i].pos));
+        }
+    }
+
+    // Reads the OBJ file into vertices and vertexIndices, followed by the indices of the coarser levels of detail
+    void parseModel()
     {
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
@@ -2224,49 +4729,177 @@ private:
         std::string warn;
         std::string err;
 
-        if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+        // The material libraries are read from the directory loadModel hashes them from
+        if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str(), MODEL_DIRECTORY.c_str()))
         {
-            std::cerr << "Failed to load model." << std::endl;
+            logLine("Failed to load model.");
             throw std::runtime_error(err);
         }
 
-        
-        // Stores a unique vertex and its index.
-        // It is used only to verify if a vertex is new and assign a index to new vertices.
-        // New vertices and their indices are then stored in vertices and vertexIndices.
-        std::unordered_map<Vertex, uint32_t> uniqueVertices;
+        // Assigns each unique vertex an index. Unique vertices are stored in vertices.
+        weldObjVertices(attrib, shapes, threadPool, vertices, vertexIndices);
+        VertexCacheStatistics before {analyzeVertexCache(vertexIndices.data(), vertexIndices.size(), vertices.size())};
+        groupTrianglesByMaterial(materials, objTriangleMaterials(shapes));
 
-        for(const tinyobj::shape_t & shape : shapes)
+        // Reorder the triangles of each material for the post-transform vertex cache, then the vertices for fetch locality
+        for(const MeshCacheMaterialRange & range : meshMaterialRanges)
         {
-            for(const tinyobj::index_t & index : shape.mesh.indices)
+            VertexCacheOptimizer::optimize(vertexIndices.data() + range.firstIndex, range.indexCount, vertices.size());
+        }
+        optimizeVertexFetch(vertices, vertexIndices.data(), vertexIndices.size());
+        VertexCacheStatistics after {analyzeVertexCache(vertexIndices.data(), vertexIndices.size(), vertices.size())};
+        logLine("vertex cache ACMR ", before.acmr, " -> ", after.acmr,
+            ", ATVR ", before.atvr, " -> ", after.atvr);
+
+        generateLods();
+    }
+
+    // Sorts the triangles by material, keeping their order within each material, and fills meshMaterials
+    // and the ranges of the full detail level. Only the materials some triangle uses are kept, in the order of
+    // their ids, after a default one when some triangles have none.
+    void groupTrianglesByMaterial(const std::vector<tinyobj::material_t> & materials, const std::vector<int> & triangleMaterials)
+    {
+        std::vector<int> usedIds {triangleMaterials};
+        std::sort(usedIds.begin(), usedIds.end());
+        usedIds.erase(std::unique(usedIds.begin(), usedIds.end()), usedIds.end());
+        if(usedIds.empty())
+        {
+            usedIds.push_back(-1);
+        }
+        // The draw sort key has room for this many
+        if(usedIds.size() > (1u << DRAW_KEY_MATERIAL_BITS))
+        {
+            throw std::runtime_error("The model uses too many materials.");
+        }
+
+        meshMaterials.clear();
+        for(int id : usedIds)
+        {
+            MeshCacheMaterial material {{1.0f, 1.0f, 1.0f}, 0};
+            if(id >= 0 && static_cast<size_t>(id) < materials.size())
             {
-                Vertex vertex {};
+                std::copy(materials[id].diffuse, materials[id].diffuse + 3, material.diffuse);
+            }
+            meshMaterials.push_back(material);
+        }
 
-                // Initialize vertex
-                vertex.pos = {
-                    attrib.vertices[3*index.vertex_index],
-                    attrib.vertices[3*index.vertex_index + 1],
-                    attrib.vertices[3*index.vertex_index + 2]
-                };
+        // Counting sort of the triangles by material
+        std::vector<uint32_t> triangleMaterialIndices(triangleMaterials.size());
+        std::vector<uint32_t> materialIndexCounts(meshMaterials.size(), 0);
+        for(size_t triangle {0}; triangle < triangleMaterials.size(); triangle++)
+        {
+            auto used {std::lower_bound(usedIds.begin(), usedIds.end(), triangleMaterials[triangle])};
+            triangleMaterialIndices[triangle] = static_cast<uint32_t>(used - usedIds.begin());
+            materialIndexCounts[triangleMaterialIndices[triangle]] += 3;
+        }
 
-                vertex.textureCoord = {
-                    attrib.texcoords[2*index.texcoord_index],
-                    1.0f - attrib.texcoords[2*index.texcoord_index+1]
-                };
+        meshMaterialRanges.clear();
+        uint32_t firstIndex {0};
+        for(uint32_t indexCount : materialIndexCounts)
+        {
+            meshMaterialRanges.push_back({firstIndex, indexCount});
+            firstIndex += indexCount;
+        }
 
-                vertex.color = {1.0f, 1.0f, 1.0f};
-            
-                // Only put vertex in vertices vector if it is new
-                if(uniqueVertices.count(vertex) == 0)
-                {
-                    // The index of the unique vertex will autoincrement
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+        std::vector<uint32_t> groupedIndices(vertexIndices.size());
+        std::vector<uint32_t> materialEnds(meshMaterials.size());
+        for(size_t material {0}; material < meshMaterials.size(); material++)
+        {
+            materialEnds[material] = meshMaterialRanges[material].firstIndex;
+        }
+        for(size_t triangle {0}; triangle < triangleMaterialIndices.size(); triangle++)
+        {
+            uint32_t & end {materialEnds[triangleMaterialIndices[triangle]]};
+            std::copy(vertexIndices.begin() + 3*triangle, vertexIndices.begin() + 3*triangle + 3, groupedIndices.begin() + end);
+            end += 3;
+        }
+        vertexIndices = std::move(groupedIndices);
 
-                    vertices.push_back(vertex);
+        logLine(meshMaterials.size(), " materials");
+    }
+
+    // Simplifies each level of detail from the previous one, to about half its triangles.
+    // Each material is simplified on its own, so the borders between materials stay in place.
+    // The levels share the vertices, and their indices are appended to vertexIndices.
+    void generateLods()
+    {
+        size_t materialCount {meshMaterials.size()};
+        meshLods.clear();
+        MeshCacheLod fullDetail {};
+        fullDetail.firstIndex = 0;
+        fullDetail.indexCount = static_cast<uint32_t>(vertexIndices.size());
+        fullDetail.error = 0.0f;
+        meshLods.push_back(fullDetail);
+
+        std::vector<std::vector<uint32_t>> lodIndices(materialCount);
+        for(size_t material {0}; material < materialCount; material++)
+        {
+            const MeshCacheMaterialRange & range {meshMaterialRanges[material]};
+            lodIndices[material].assign(vertexIndices.begin() + range.firstIndex, vertexIndices.begin() + range.firstIndex + range.indexCount);
+        }
+        float lodError {0.0f};
+        while(meshLods.size() < MAX_MESH_LODS)
+        {
+            std::vector<std::vector<uint32_t>> simplified(materialCount);
+            float simplifyError {0.0f};
+            size_t previousIndexCount {0};
+            size_t simplifiedIndexCount {0};
+            for(size_t material {0}; material < materialCount; material++)
+            {
+                const std::vector<uint32_t> & source {lodIndices[material]};
+                previousIndexCount += source.size();
+                if(!source.empty())
+                {
+                    float materialError {0.0f};
+                    simplified[material] = simplifyMesh(
+                        &vertices[0].pos.x,
+                        sizeof(Vertex),
+                        vertices.size(),
+                        source.data(),
+                        source.size(),
+                        source.size() / 6 * 3,
+                        materialError
+                    );
+                    if(simplified[material].empty())
+                    {
+                        // Too small to simplify, it keeps its triangles
+                        simplified[material] = source;
+                    }
+                    else
+                    {
+                        VertexCacheOptimizer::optimize(simplified[material].data(), simplified[material].size(), vertices.size());
+                        simplifyError = std::max(simplifyError, materialError);
+                    }
                 }
-                
-                vertexIndices.push_back(uniqueVertices[vertex]);
+                simplifiedIndexCount += simplified[material].size();
+            }
+            if(simplifiedIndexCount == 0 || simplifiedIndexCount > (1.0f - MIN_LOD_REDUCTION) * previousIndexCount)
+            {
+                break;
             }
+
+            // Estimates the error against the full detail mesh with the sum of the errors of the simplifications
+            lodError += simplifyError;
+            MeshCacheLod lod {};
+            lod.firstIndex = static_cast<uint32_t>(vertexIndices.size());
+            lod.indexCount = static_cast<uint32_t>(simplifiedIndexCount);
+            lod.error = lodError;
+            meshLods.push_back(lod);
+
+            for(size_t material {0}; material < materialCount; material++)
+            {
+                meshMaterialRanges.push_back({
+                    static_cast<uint32_t>(vertexIndices.size()),
+                    static_cast<uint32_t>(simplified[material].size())
+                });
+                vertexIndices.insert(vertexIndices.end(), simplified[material].begin(), simplified[material].end());
+            }
+            lodIndices = std::move(simplified);
+        }
+
+        for(size_t i {0}; i < meshLods.size(); i++)
+        {
+            logLine("lod ", i, ": ", meshLods[i].indexCount / 3, " triangles, error ", meshLods[i].error);
         }
     }
 
@@ -2317,7 +4950,7 @@ private:
             VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             colorImage,
-            colorImageMemory
+            colorImageAllocation
         );
 
         colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
@@ -2335,12 +4968,348 @@ private:
         vkDeviceWaitIdle(vkDevice);
     }
 
+    // Prints the GPU scope statistics of the windowed run, and writes the trace. The device must be idle.
+    void reportGpuProfile()
+    {
+        if(!timestampsEnabled)
+        {
+            return;
+        }
+        // The frames in flight have finished, so collect their timestamps too
+        for(uint32_t frame {0}; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            collectTimestamps(frame);
+        }
+        if(!options.headless)
+        {
+            gpuProfiler.printStatistics(std::cout);
+        }
+        if(!options.gpuTracePath.empty())
+        {
+            // Not fatal, the statistics are still printed or reported
+            if(gpuProfiler.writeChromeTrace(options.gpuTracePath))
+            {
+                logLine("wrote GPU trace ", options.gpuTracePath);
+            }
+            else
+            {
+                logLine("Failed to write GPU trace ", options.gpuTracePath);
+            }
+        }
+    }
+
+    void benchmarkLoop()
+    {
+        if(options.benchmarkInstances)
+        {
+            benchmarkInstancing();
+            return;
+        }
+        if(options.benchmarkRecording)
+        {
+            benchmarkCommandRecording();
+            return;
+        }
+
+        logLine("render ", options.warmupFrames, " warmup frames and ", options.benchmarkFrames, " benchmark frames");
+
+        for(uint32_t i {0}; i < options.warmupFrames; i++)
+        {
+            drawFrame();
+        }
+
+        // Measure re-recording every frame first, as the baseline the pre-recorded command buffers are compared against
+        std::optional<BenchmarkSamples> baselineSamples;
+        if(usePrerecordedCommandBuffers)
+        {
+            usePrerecordedCommandBuffers = false;
+            baselineSamples = measureFrames(options.benchmarkFrames);
+            usePrerecordedCommandBuffers = true;
+        }
+
+        BenchmarkSamples samples {measureFrames(options.benchmarkFrames)};
+
+        writeBenchmarkReport(samples, baselineSamples);
+    }
+
+    // Measures the frame times while the instance count grows from 1 to INSTANCE_BENCHMARK_MAX, by factors of 10
+    void benchmarkInstancing()
+    {
+        std::vector<uint32_t> instanceCounts;
+        for(uint32_t count {1}; count <= INSTANCE_BENCHMARK_MAX; count *= 10)
+        {
+            instanceCounts.push_back(count);
+        }
+
+        std::vector<BenchmarkSamples> sweepSamples;
+        // Triangles of one instance of every object, at the levels of detail of each step
+        std::vector<uint64_t> sweepObjectTriangles;
+        for(uint32_t count : instanceCounts)
+        {
+            logLine("benchmark ", count, " instances");
+            activeInstanceCount = count;
+            // The camera moves back to keep the active instances in view, which changes the levels of detail too
+            updateSceneScale();
+            if(usePrerecordedCommandBuffers)
+            {
+                // The instance count and the levels of detail are part of the recorded draws
+                vkDeviceWaitIdle(vkDevice);
+                freePrerecordedCommandBuffers();
+                createPrerecordedCommandBuffers();
+            }
+
+            for(uint32_t i {0}; i < options.warmupFrames; i++)
+            {
+                drawFrame();
+            }
+            sweepSamples.push_back(measureFrames(options.benchmarkFrames));
+            sweepObjectTriangles.push_back(objectTriangleCount());
+        }
+
+        std::ofstream file;
+        std::ostream & out {openReportStream(options.benchmarkOutputPath, file)};
+
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+
+        out << "{\n";
+        out << "  \"mode\": \"instancing\",\n";
+        out << "  \"device\": \"" << physicalDeviceProperties.deviceName << "\",\n";
+        out << "  \"width\": " << swapChainExtent.width << ",\n";
+        out << "  \"height\": " << swapChainExtent.height << ",\n";
+        out << "  \"objects\": " << options.objectCount << ",\n";
+        out << "  \"mesh_indices\": " << meshLods[0].indexCount << ",\n";
+        out << "  \"lod_threshold_pixels\": " << options.lodThreshold << ",\n";
+        out << "  \"gpu_culling\": " << std::boolalpha << useGpuCulling << std::noboolalpha << ",\n";
+        out << "  \"secondary_command_buffers\": " << recordSliceCount << ",\n";
+        out << "  \"warmup_frames\": " << options.warmupFrames << ",\n";
+        out << "  \"frames\": " << options.benchmarkFrames << ",\n";
+        out << "  \"command_buffers\": \"" << (usePrerecordedCommandBuffers ? "prerecorded" : "recorded_per_frame") << "\",\n";
+        out << "  \"sweep\": [\n";
+        for(size_t i {0}; i < instanceCounts.size(); i++)
+        {
+            out << "    {\n";
+            out << "      \"instances\": " << instanceCounts[i] << ",\n";
+            out << "      \"triangles\": " << instanceCounts[i] * sweepObjectTriangles[i] << ",\n";
+            writeBenchmarkSamplesJson(out, sweepSamples[i], "      ");
+            out << "\n    }" << (i + 1 < instanceCounts.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}" << std::endl;
+    }
+
+    // Measures only the CPU time to record a frame's command buffer, inline and with 1, 2, 4, ... secondary command buffers
+    void benchmarkCommandRecording()
+    {
+        std::vector<uint32_t> sliceCounts {0};
+        for(uint32_t count {1}; count < maxRecordSliceCount; count *= 2)
+        {
+            sliceCounts.push_back(count);
+        }
+        // Without secondary command buffers, only the inline recording is measured
+        if(maxRecordSliceCount > sliceCounts.back())
+        {
+            sliceCounts.push_back(maxRecordSliceCount);
+        }
+
+        // The command buffers are recorded but never submitted, so nothing may be in flight
+        vkDeviceWaitIdle(vkDevice);
+        VkCommandBuffer commandBuffer {commandBuffers[0]};
+
+        std::vector<SampleStatistics> recordStatistics;
+        for(uint32_t sliceCount : sliceCounts)
+        {
+            logLine("benchmark recording with ", sliceCount, " secondary command buffers");
+            recordSliceCount = sliceCount;
+
+            for(uint32_t i {0}; i < options.warmupFrames; i++)
+            {
+                vkResetCommandBuffer(commandBuffer, 0);
+                recordCommandBuffer(commandBuffer, 0, 0, true);
+            }
+
+            std::vector<double> recordTimes;
+            recordTimes.reserve(options.benchmarkFrames);
+            for(uint32_t i {0}; i < options.benchmarkFrames; i++)
+            {
+                auto recordStart {std::chrono::high_resolution_clock::now()};
+                vkResetCommandBuffer(commandBuffer, 0);
+                recordCommandBuffer(commandBuffer, 0, 0, true);
+                auto recordEnd {std::chrono::high_resolution_clock::now()};
+                recordTimes.push_back(std::chrono::duration<double, std::milli>(recordEnd - recordStart).count());
+            }
+            recordStatistics.push_back(computeStatistics(recordTimes));
+        }
+        recordSliceCount = options.recordThreadCount;
+
+        std::ofstream file;
+        std::ostream & out {openReportStream(options.benchmarkOutputPath, file)};
+
+        out << "{\n";
+        out << "  \"mode\": \"command_recording\",\n";
+        out << "  \"objects\": " << options.objectCount << ",\n";
+        out << "  \"pool_threads\": " << threadPool.threadCount() << ",\n";
+        out << "  \"warmup_frames\": " << options.warmupFrames << ",\n";
+        out << "  \"frames\": " << options.benchmarkFrames << ",\n";
+        out << "  \"sweep\": [\n";
+        for(size_t i {0}; i < sliceCounts.size(); i++)
+        {
+            // Relative to recording inline on one thread
+            double speedup {recordStatistics[i].avg > 0.0 ? recordStatistics[0].avg / recordStatistics[i].avg : 0.0};
+            out << "    {\"secondary_command_buffers\": " << sliceCounts[i] << ", \"cpu_record_ms\": ";
+            writeStatisticsJson(out, recordStatistics[i]);
+            out << ", \"speedup\": " << speedup << "}" << (i + 1 < sliceCounts.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}" << std::endl;
+    }
+
+    BenchmarkSamples measureFrames(uint32_t frameCount)
+    {
+        BenchmarkSamples samples {};
+        samples.cpuFrameTimes.reserve(frameCount);
+        samples.cpuRecordTimes.reserve(frameCount);
+        samples.gpuFrameTimes.reserve(frameCount);
+        benchmarkSamples = &samples;
+
+        auto benchmarkStart {std::chrono::high_resolution_clock::now()};
+        for(uint32_t i {0}; i < frameCount; i++)
+        {
+            auto frameStart {std::chrono::high_resolution_clock::now()};
+            drawFrame();
+            auto frameEnd {std::chrono::high_resolution_clock::now()};
+            samples.cpuFrameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        }
+        vkDeviceWaitIdle(vkDevice);
+        auto benchmarkEnd {std::chrono::high_resolution_clock::now()};
+
+        // The last frames in flight have finished now, so collect their timestamps too
+        if(timestampsEnabled)
+        {
+            for(uint32_t frame {0}; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+            {
+                collectTimestamps(frame);
+            }
+        }
+
+        benchmarkSamples = nullptr;
+        samples.totalSeconds = std::chrono::duration<double>(benchmarkEnd - benchmarkStart).count();
+        return samples;
+    }
+
+    // Writes the frame statistics of a benchmark run as the fields of a JSON object
+    void writeBenchmarkSamplesJson(std::ostream & out, const BenchmarkSamples & samples, const std::string & indent)
+    {
+        out << indent << "\"cpu_frame_ms\": ";
+        writeStatisticsJson(out, computeStatistics(samples.cpuFrameTimes));
+        out << ",\n";
+        out << indent << "\"cpu_record_ms\": ";
+        writeStatisticsJson(out, computeStatistics(samples.cpuRecordTimes));
+        out << ",\n";
+        out << indent << "\"gpu_frame_ms\": ";
+        if(timestampsEnabled)
+        {
+            writeStatisticsJson(out, computeStatistics(samples.gpuFrameTimes));
+        }
+        else
+        {
+            out << "null";
+        }
+        out << ",\n";
+        double throughput {samples.totalSeconds > 0.0 ? samples.cpuFrameTimes.size() / samples.totalSeconds : 0.0};
+        out << indent << "\"throughput_fps\": " << throughput;
+    }
+
+    void writeBenchmarkReport(const BenchmarkSamples & samples, const std::optional<BenchmarkSamples> & baselineSamples)
+    {
+        std::ofstream file;
+        std::ostream & out {openReportStream(options.benchmarkOutputPath, file)};
+
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(vkPhysicalDevice, &physicalDeviceProperties);
+
+        out << "{\n";
+        out << "  \"mode\": \"headless\",\n";
+        out << "  \"device\": \"" << physicalDeviceProperties.deviceName << "\",\n";
+        out << "  \"width\": " << swapChainExtent.width << ",\n";
+        out << "  \"height\": " << swapChainExtent.height << ",\n";
+        out << "  \"msaa_samples\": " << msaaSamples << ",\n";
+        out << "  \"objects\": " << options.objectCount << ",\n";
+        out << "  \"instances\": " << options.instanceCount << ",\n";
+        out << "  \"vertex_format\": \"" << (usePackedVertices ? "packed" : "float") << "\",\n";
+        out << "  \"index_type\": \"" << (meshIndexType == VK_INDEX_TYPE_UINT16 ? "uint16" : "uint32") << "\",\n";
+        out << "  \"sub_meshes\": " << subMeshes.size() << ",\n";
+        out << "  \"materials\": " << meshMaterials.size() << ",\n";
+        out << "  \"index_buffer_bytes\": " << (meshIndexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t))*meshIndexCount << ",\n";
+        out << "  \"lods\": [";
+        for(size_t i {0}; i < meshLods.size(); i++)
+        {
+            out << (i == 0 ? "" : ", ") << "{\"triangles\": " << meshLods[i].indexCount / 3 << ", \"error\": " << meshLods[i].error << "}";
+        }
+        out << "],\n";
+        out << "  \"lod_threshold_pixels\": " << options.lodThreshold << ",\n";
+        out << "  \"triangles_per_instance\": " << objectTriangleCount() << ",\n";
+        out << "  \"meshlets\": " << (useMeshlets ? meshlets.size() : 0) << ",\n";
+        out << "  \"meshlets_drawn_fraction\": " << (meshletsTested > 0 ? static_cast<double>(meshletsDrawn) / meshletsTested : 1.0) << ",\n";
+        out << "  \"vertex_buffer_bytes\": " << (usePackedVertices ? sizeof(PackedVertex) : sizeof(Vertex))*meshVertexCount << ",\n";
+        out << "  \"texture_encoding\": \"" << textureEncodingName(textureEncoding) << "\",\n";
+        out << "  \"texture_bytes\": " << textureBytes << ",\n";
+        out << "  \"bindless_textures\": " << bindlessTextureSlots << ",\n";
+        out << "  \"gpu_culling\": " << std::boolalpha << useGpuCulling << std::noboolalpha << ",\n";
+        out << "  \"secondary_command_buffers\": " << recordSliceCount << ",\n";
+        out << "  \"state_changes_per_frame\": {"
+            << "\"draws\": " << drawStateChanges.draws
+            << ", \"pipeline_binds\": " << drawStateChanges.bindCount(DrawState::Pipeline)
+            << ", \"vertex_buffer_binds\": " << drawStateChanges.bindCount(DrawState::VertexBuffer)
+            << ", \"material_binds\": " << drawStateChanges.bindCount(DrawState::Material)
+            << ", \"object_binds\": " << drawStateChanges.bindCount(DrawState::Object)
+            << ", \"redundant_binds_skipped\": " << drawStateChanges.redundantBinds
+            << "},\n";
+        out << "  \"warmup_frames\": " << options.warmupFrames << ",\n";
+        out << "  \"frames\": " << options.benchmarkFrames << ",\n";
+        out << "  \"command_buffers\": \"" << (usePrerecordedCommandBuffers ? "prerecorded" : "recorded_per_frame") << "\",\n";
+        out << "  \"pipeline_cache\": \"" << pipelineCacheState << "\",\n";
+        out << "  \"pipeline_creation_ms\": " << pipelineCreationMilliseconds << ",\n";
+        out << "  \"startup\": ";
+        startupTimeline.writeJson(out, "  ");
+        out << ",\n";
+        out << "  \"gpu_scopes_ms\": ";
+        if(timestampsEnabled)
+        {
+            gpuProfiler.writeStatisticsJson(out, "  ");
+        }
+        else
+        {
+            out << "null";
+        }
+        out << ",\n";
+        writeBenchmarkSamplesJson(out, samples, "  ");
+        if(baselineSamples.has_value())
+        {
+            SampleStatistics recordStatistics {computeStatistics(samples.cpuRecordTimes)};
+            SampleStatistics baselineRecordStatistics {computeStatistics(baselineSamples->cpuRecordTimes)};
+            SampleStatistics frameStatistics {computeStatistics(samples.cpuFrameTimes)};
+            SampleStatistics baselineFrameStatistics {computeStatistics(baselineSamples->cpuFrameTimes)};
+
+            out << ",\n";
+            out << "  \"recorded_per_frame_baseline\": {\n";
+            writeBenchmarkSamplesJson(out, *baselineSamples, "    ");
+            out << "\n  },\n";
+            out << "  \"cpu_record_saving_ms\": " << baselineRecordStatistics.avg - recordStatistics.avg << ",\n";
+            out << "  \"cpu_frame_saving_ms\": " << baselineFrameStatistics.avg - frameStatistics.avg;
+        }
+        out << ",\n";
+        out << "  \"gpu_memory_heaps\": ";
+        gpuAllocator.writeStatisticsJson(out, "  ");
+        out << "\n}" << std::endl;
+    }
+
     void cleanupSwapChain()
     {
         // Destroy resources for MSAA
-        vkFreeMemory(vkDevice, colorImageMemory, nullptr);
         vkDestroyImageView(vkDevice, colorImageView, nullptr);
         vkDestroyImage(vkDevice, colorImage, nullptr);
+        gpuAllocator.free(colorImageAllocation);
 
         // Destroy framebuffers
         for(VkFramebuffer & framebuffer : swapChainFramebuffers)
@@ -2349,9 +5318,9 @@ private:
         }
         
         // Destroy depth buffer
-        vkFreeMemory(vkDevice, depthImageMemory, nullptr);
         vkDestroyImageView(vkDevice, depthImageView, nullptr);
         vkDestroyImage(vkDevice, depthImage, nullptr);
+        gpuAllocator.free(depthImageAllocation);
 
         // Destroy the swap chain image views
         for(VkImageView & imageView : swapChainImageViews)
@@ -2359,8 +5328,20 @@ private:
             vkDestroyImageView(vkDevice, imageView, nullptr);
         }
 
-        // Destroy the swap chain
-        vkDestroySwapchainKHR(vkDevice, swapChain, nullptr);
+        if(options.headless)
+        {
+            // Destroy the offscreen images, which were created in place of the swap chain
+            for(size_t i {0}; i < swapChainImages.size(); i++)
+            {
+                vkDestroyImage(vkDevice, swapChainImages[i], nullptr);
+                gpuAllocator.free(offscreenImagesAllocations[i]);
+            }
+        }
+        else
+        {
+            // Destroy the swap chain
+            vkDestroySwapchainKHR(vkDevice, swapChain, nullptr);
+        }
     }
 
     void cleanup()
@@ -2371,7 +5352,25 @@ private:
         for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
             vkDestroyBuffer(vkDevice, uniformBuffers[i], nullptr);
-            vkFreeMemory(vkDevice, uniformBuffersMemory[i], nullptr);
+            gpuAllocator.free(uniformBuffersAllocations[i]);
+        }
+        vkDestroyBuffer(vkDevice, objectUniformBuffer, nullptr);
+        gpuAllocator.free(objectUniformAllocation);
+        vkDestroyBuffer(vkDevice, materialUniformBuffer, nullptr);
+        gpuAllocator.free(materialUniformAllocation);
+        vkDestroyBuffer(vkDevice, instanceBuffer, nullptr);
+        gpuAllocator.free(instanceBufferAllocation);
+        for(size_t i {0}; i < visibleInstanceBuffers.size(); i++)
+        {
+            vkDestroyBuffer(vkDevice, visibleInstanceBuffers[i], nullptr);
+            gpuAllocator.free(visibleInstanceBuffersAllocations[i]);
+            vkDestroyBuffer(vkDevice, indirectBuffers[i], nullptr);
+            gpuAllocator.free(indirectBuffersAllocations[i]);
+        }
+        for(size_t i {0}; i < meshletDrawBuffers.size(); i++)
+        {
+            vkDestroyBuffer(vkDevice, meshletDrawBuffers[i], nullptr);
+            gpuAllocator.free(meshletDrawBuffersAllocations[i]);
         }
 
         // Destroy texture sampler
@@ -2384,19 +5383,25 @@ private:
         vkDestroyImage(vkDevice, textureImage, nullptr);
 
         // Destroy texture image memory
-        vkFreeMemory(vkDevice, textureImageMemory, nullptr);
+        gpuAllocator.free(textureImageAllocation);
 
         // Destroy index buffer
         vkDestroyBuffer(vkDevice, indexBuffer, nullptr);
 
         // Free index buffer memory
-        vkFreeMemory(vkDevice, indexBufferMemory, nullptr);
+        gpuAllocator.free(indexBufferAllocation);
 
         // Destroy the vertex buffer
         vkDestroyBuffer(vkDevice, vertexBuffer, nullptr);
 
         // Free vertex buffer memory
-        vkFreeMemory(vkDevice, vertexBufferMemory, nullptr);
+        gpuAllocator.free(vertexBufferAllocation);
+
+        // Destroy the profiler's query pools
+        if(timestampsEnabled)
+        {
+            gpuProfiler.destroy();
+        }
 
         // Destroy semaphores and fences
         for(size_t i {0}; i < MAX_FRAMES_IN_FLIGHT; i++)
@@ -2409,20 +5414,41 @@ private:
         // Don't need to destroy the command buffer.
         // It is destroyed when the command pool is destroyed.
 
-        // Destroy command pool
+        // Destroy command pools
         vkDestroyCommandPool(vkDevice, commandPool, nullptr);
+        for(VkCommandPool & secondaryCommandPool : secondaryCommandPools)
+        {
+            vkDestroyCommandPool(vkDevice, secondaryCommandPool, nullptr);
+        }
 
         // Destroy the graphics pipeline
         vkDestroyPipeline(vkDevice, pipeline, nullptr);
+        if(cullPipeline != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(vkDevice, cullPipeline, nullptr);
+        }
+
+        // Save and destroy the pipeline cache
+        if(pipelineCache != VK_NULL_HANDLE)
+        {
+            savePipelineCache();
+            vkDestroyPipelineCache(vkDevice, pipelineCache, nullptr);
+        }
 
         // Destroy the pipeline layout
         vkDestroyPipelineLayout(vkDevice, pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(vkDevice, cullPipelineLayout, nullptr);
 
         // Destroy descriptor pool
         vkDestroyDescriptorPool(vkDevice, descriptorPool, nullptr);
+        vkDestroyDescriptorPool(vkDevice, bindlessDescriptorPool, nullptr);
 
         // Destroy descriptor set layout
         vkDestroyDescriptorSetLayout(vkDevice, descriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(vkDevice, objectDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(vkDevice, materialDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(vkDevice, cullDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(vkDevice, bindlessDescriptorSetLayout, nullptr);
 
         // Destroy the render pass
         vkDestroyRenderPass(vkDevice, renderPass, nullptr);
@@ -2432,6 +5458,14 @@ private:
         // Don't need to cleanup the graphics queue.
         // it is destroyed when the (logical?) device is destroyed
 
+        // Destroy the upload command pools and the staging ring
+        uploadContext.destroy();
+        vkDestroyBuffer(vkDevice, stagingRingBuffer, nullptr);
+        gpuAllocator.free(stagingRingAllocation);
+
+        // Free the memory blocks, after every buffer and image was destroyed
+        gpuAllocator.destroy();
+
         // Destroy the logical device
         vkDestroyDevice(vkDevice, nullptr);
 
@@ -2439,24 +5473,531 @@ private:
         // it is already destroyed together with the Vulkan instance
 
         // Destroy the window surface
-        vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+        if(!options.headless)
+        {
+            vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+        }
 
         // Destroy the Vulkan instance
         // The nullptr refers to the callback allocator
         vkDestroyInstance(vkInstance, nullptr);
 
         // Destroy the GLFW window
-        glfwDestroyWindow(window);
-        glfwTerminate();
+        if(!options.headless)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
     }
 };
 
-int main()
+uint32_t parseCount(const std::string & option, const std::string & value)
+{
+    try
+    {
+        unsigned long count {std::stoul(value)};
+        if(count > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::out_of_range(value);
+        }
+        return static_cast<uint32_t>(count);
+    }
+    catch(const std::logic_error &)
+    {
+        throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    }
+}
+
+float parsePixels(const std::string & option, const std::string & value)
+{
+    try
+    {
+        float pixels {std::stof(value)};
+        if(!(pixels >= 0.0f))
+        {
+            throw std::out_of_range(value);
+        }
+        return pixels;
+    }
+    catch(const std::logic_error &)
+    {
+        throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    }
+}
+
+ApplicationOptions parseCommandLine(int argc, char ** argv)
+{
+    ApplicationOptions options {};
+
+    for(int i {1}; i < argc; i++)
+    {
+        std::string argument {argv[i]};
+
+        // Options which take a value
+        auto nextValue = [&]() -> std::string
+        {
+            if(i + 1 >= argc)
+            {
+                throw std::invalid_argument("Missing value for " + argument);
+            }
+            i++;
+            return argv[i];
+        };
+
+        if(argument == "--headless")
+        {
+            options.headless = true;
+        }
+        else if(argument == "--frames")
+        {
+            options.benchmarkFrames = parseCount(argument, nextValue());
+        }
+        else if(argument == "--warmup-frames")
+        {
+            options.warmupFrames = parseCount(argument, nextValue());
+        }
+        else if(argument == "--benchmark-output")
+        {
+            options.benchmarkOutputPath = nextValue();
+        }
+        else if(argument == "--prerecorded")
+        {
+            options.prerecordCommandBuffers = true;
+        }
+        else if(argument == "--no-mesh-cache")
+        {
+            options.useMeshCache = false;
+        }
+        else if(argument == "--bench-dedup")
+        {
+            options.benchmarkDedup = true;
+        }
+        else if(argument == "--mesh-report")
+        {
+            options.meshReportPath = nextValue();
+        }
+        else if(argument == "--compress-texture")
+        {
+            options.compressTextureEncoding = nextValue();
+            // Fails early on unknown names
+            parseTextureEncoding(options.compressTextureEncoding);
+        }
+        else if(argument == "--no-texture-container")
+        {
+            options.useTextureContainer = false;
+        }
+        else if(argument == "--objects")
+        {
+            options.objectCount = parseCount(argument, nextValue());
+            if(options.objectCount == 0)
+            {
+                throw std::invalid_argument("There must be at least one object.");
+            }
+        }
+        else if(argument == "--instances")
+        {
+            options.instanceCount = parseCount(argument, nextValue());
+            if(options.instanceCount == 0)
+            {
+                throw std::invalid_argument("There must be at least one instance.");
+            }
+        }
+        else if(argument == "--bench-instances")
+        {
+            options.benchmarkInstances = true;
+            options.headless = true;
+        }
+        else if(argument == "--record-threads")
+        {
+            options.recordThreadCount = parseCount(argument, nextValue());
+        }
+        else if(argument == "--bench-recording")
+        {
+            options.benchmarkRecording = true;
+            options.headless = true;
+        }
+        else if(argument == "--no-short-indices")
+        {
+            options.shortIndices = false;
+        }
+        else if(argument == "--lod-threshold")
+        {
+            options.lodThreshold = parsePixels(argument, nextValue());
+        }
+        else if(argument == "--no-lod")
+        {
+            options.lodThreshold = 0.0f;
+        }
+        else if(argument == "--meshlets")
+        {
+            options.meshlets = true;
+        }
+        else if(argument == "--gpu-profile")
+        {
+            options.gpuProfile = true;
+        }
+        else if(argument == "--gpu-trace")
+        {
+            options.gpuTracePath = nextValue();
+        }
+        else if(argument == "--bindless")
+        {
+            options.bindless = true;
+        }
+        else if(argument == "--bindless-textures")
+        {
+            options.bindless = true;
+            options.bindlessTextureCount = parseCount(argument, nextValue());
+            if(options.bindlessTextureCount == 0)
+            {
+                throw std::invalid_argument("There must be at least one bindless texture.");
+            }
+        }
+        else if(argument == "--packed-vertices")
+        {
+            options.packedVertices = true;
+        }
+        else if(argument == "--no-gpu-culling")
+        {
+            options.useGpuCulling = false;
+        }
+        else if(argument == "--no-pipeline-cache")
+        {
+            options.usePipelineCache = false;
+        }
+        else if(argument == "--no-transfer-queue")
+        {
+            options.useTransferQueue = false;
+        }
+        else if(argument == "--staging-ring-kb")
+        {
+            options.stagingRingKilobytes = parseCount(argument, nextValue());
+            if(options.stagingRingKilobytes == 0)
+            {
+                throw std::invalid_argument("The staging ring can't be empty.");
+            }
+        }
+        else if(argument == "--threads")
+        {
+            options.threadCount = parseCount(argument, nextValue());
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option: " + argument);
+        }
+    }
+
+    return options;
+}
+
+// Compares VertexDeduplicator with the std::unordered_map based deduplication it replaced,
+// on the vertices of the model
+void benchmarkVertexDeduplication(const ApplicationOptions & options)
+{
+    const uint32_t runs {5};
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    std::string err;
+    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+    {
+        throw std::runtime_error(err);
+    }
+
+    // Build the vertices up front, so only the deduplication is timed
+    std::vector<Vertex> objVertices;
+    objVertices.reserve(objIndexCount(shapes));
+    for(const tinyobj::shape_t & shape : shapes)
+    {
+        for(const tinyobj::index_t & index : shape.mesh.indices)
+        {
+            objVertices.push_back(objVertex(attrib, index));
+        }
+    }
+
+    std::vector<double> mapTimes;
+    std::vector<double> flatTimes;
+    std::vector<Vertex> mapVertices;
+    std::vector<uint32_t> mapIndices;
+    std::vector<Vertex> flatVertices;
+    std::vector<uint32_t> flatIndices;
+    for(uint32_t run {0}; run < runs; run++)
+    {
+        mapVertices.clear();
+        mapIndices.clear();
+        auto startTime {std::chrono::high_resolution_clock::now()};
+        {
+            std::unordered_map<Vertex, uint32_t> uniqueVertices;
+            for(const Vertex & vertex : objVertices)
+            {
+                if(uniqueVertices.count(vertex) == 0)
+                {
+                    uniqueVertices[vertex] = static_cast<uint32_t>(mapVertices.size());
+                    mapVertices.push_back(vertex);
+                }
+                mapIndices.push_back(uniqueVertices[vertex]);
+            }
+        }
+        auto endTime {std::chrono::high_resolution_clock::now()};
+        mapTimes.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+
+        flatVertices.clear();
+        flatIndices.clear();
+        startTime = std::chrono::high_resolution_clock::now();
+        {
+            flatIndices.reserve(objVertices.size());
+            VertexDeduplicator<Vertex, VertexBytesHash> deduplicator {flatVertices, objVertices.size()};
+            for(const Vertex & vertex : objVertices)
+            {
+                flatIndices.push_back(deduplicator.insert(vertex));
+            }
+        }
+        endTime = std::chrono::high_resolution_clock::now();
+        flatTimes.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+    }
+
+    if(mapVertices != flatVertices || mapIndices != flatIndices)
+    {
+        throw std::runtime_error("Vertex deduplication results differ.");
+    }
+
+    // Whole welding, including building the vertices, with increasing thread counts
+    uint32_t maxThreadCount {options.threadCount};
+    if(maxThreadCount == 0)
+    {
+        maxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<uint32_t> threadCounts;
+    for(uint32_t threadCount {1}; threadCount < maxThreadCount; threadCount *= 2)
+    {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(maxThreadCount);
+
+    std::vector<SampleStatistics> weldStatistics;
+    for(uint32_t threadCount : threadCounts)
+    {
+        ThreadPool threadPool {threadCount};
+        std::vector<double> weldTimes;
+        for(uint32_t run {0}; run < runs; run++)
+        {
+            std::vector<Vertex> weldVertices;
+            std::vector<uint32_t> weldIndices;
+            auto startTime {std::chrono::high_resolution_clock::now()};
+            weldObjVertices(attrib, shapes, threadPool, weldVertices, weldIndices);
+            auto endTime {std::chrono::high_resolution_clock::now()};
+            weldTimes.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+
+            // Must be bit-identical to the serial result
+            if(
+                weldVertices.size() != flatVertices.size() ||
+                memcmp(weldVertices.data(), flatVertices.data(), sizeof(Vertex) * flatVertices.size()) != 0 ||
+                weldIndices != flatIndices
+            )
+            {
+                throw std::runtime_error("Parallel vertex welding result differs from the serial one.");
+            }
+        }
+        weldStatistics.push_back(computeStatistics(weldTimes));
+    }
+
+    SampleStatistics mapStatistics {computeStatistics(mapTimes)};
+    SampleStatistics flatStatistics {computeStatistics(flatTimes)};
+
+    std::ofstream file;
+    std::ostream & out {openReportStream(options.benchmarkOutputPath, file)};
+
+    out << "{\n";
+    out << "  \"benchmark\": \"vertex_dedup\",\n";
+    out << "  \"indices\": " << objVertices.size() << ",\n";
+    out << "  \"unique_vertices\": " << flatVertices.size() << ",\n";
+    out << "  \"unordered_map_ms\": ";
+    writeStatisticsJson(out, mapStatistics);
+    out << ",\n";
+    out << "  \"flat_table_ms\": ";
+    writeStatisticsJson(out, flatStatistics);
+    out << ",\n";
+    out << "  \"speedup\": " << (flatStatistics.p50 > 0.0 ? mapStatistics.p50 / flatStatistics.p50 : 0.0) << ",\n";
+    out << "  \"parallel_weld\": [\n";
+    for(size_t i {0}; i < threadCounts.size(); i++)
+    {
+        double speedup {weldStatistics[i].p50 > 0.0 ? weldStatistics[0].p50 / weldStatistics[i].p50 : 0.0};
+        out << "    {\"threads\": " << threadCounts[i] << ", \"ms\": ";
+        writeStatisticsJson(out, weldStatistics[i]);
+        out << ", \"speedup\": " << speedup << "}" << (i + 1 < threadCounts.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}" << std::endl;
+}
+
+void writeVertexCacheStatisticsJson(std::ostream & out, const VertexCacheStatistics & statistics)
+{
+    out << "{\"cache_size\": " << statistics.cacheSize
+        << ", \"transformed_vertices\": " << statistics.transformedVertices
+        << ", \"acmr\": " << statistics.acmr
+        << ", \"atvr\": " << statistics.atvr
+        << "}";
+}
+
+// Runs the mesh optimization of the loader on an OBJ file, and reports the vertex cache efficiency
+// before and after, for a FIFO cache of 16 and of 32 vertices
+void reportMeshOptimization(const ApplicationOptions & options)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    std::string err;
+    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, options.meshReportPath.c_str()))
+    {
+        throw std::runtime_error(err);
+    }
+
+    ThreadPool threadPool {options.threadCount};
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    weldObjVertices(attrib, shapes, threadPool, vertices, indices);
+
+    const std::array<size_t, 2> cacheSizes {16, 32};
+    std::vector<VertexCacheStatistics> before;
+    for(size_t cacheSize : cacheSizes)
+    {
+        before.push_back(analyzeVertexCache(indices.data(), indices.size(), vertices.size(), cacheSize));
+    }
+
+    auto startTime {std::chrono::high_resolution_clock::now()};
+    VertexCacheOptimizer::optimize(indices.data(), indices.size(), vertices.size());
+    auto cacheEndTime {std::chrono::high_resolution_clock::now()};
+    optimizeVertexFetch(vertices, indices.data(), indices.size());
+    auto fetchEndTime {std::chrono::high_resolution_clock::now()};
+
+    std::vector<VertexCacheStatistics> after;
+    for(size_t cacheSize : cacheSizes)
+    {
+        after.push_back(analyzeVertexCache(indices.data(), indices.size(), vertices.size(), cacheSize));
+    }
+
+    std::ofstream file;
+    std::ostream & out {openReportStream(options.benchmarkOutputPath, file)};
+
+    out << "{\n";
+    out << "  \"benchmark\": \"mesh_optimization\",\n";
+    out << "  \"mesh\": \"" << options.meshReportPath << "\",\n";
+    out << "  \"triangles\": " << indices.size() / 3 << ",\n";
+    out << "  \"vertices\": " << vertices.size() << ",\n";
+    out << "  \"vertex_cache_ms\": " << std::chrono::duration<double, std::milli>(cacheEndTime - startTime).count() << ",\n";
+    out << "  \"vertex_fetch_ms\": " << std::chrono::duration<double, std::milli>(fetchEndTime - cacheEndTime).count() << ",\n";
+    out << "  \"fifo\": [\n";
+    for(size_t i {0}; i < cacheSizes.size(); i++)
+    {
+        out << "    {\"before\": ";
+        writeVertexCacheStatisticsJson(out, before[i]);
+        out << ", \"after\": ";
+        writeVertexCacheStatisticsJson(out, after[i]);
+        out << "}" << (i + 1 < cacheSizes.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}" << std::endl;
+}
+
+// Encodes TEXTURE_PATH into TEXTURE_CONTAINER_PATH, and reports the time taken and the quality
+void compressTexture(const ApplicationOptions & options)
 {
-    HelloTriangleApplication app;
+    TextureEncoding encoding {parseTextureEncoding(options.compressTextureEncoding)};
+
+    MappedFile sourceFile;
+    if(!sourceFile.open(TEXTURE_PATH))
+    {
+        throw std::runtime_error("Failed to open texture " + TEXTURE_PATH);
+    }
+    uint64_t sourceHash {hashBytes(sourceFile.data(), sourceFile.size())};
+    sourceFile.close();
+
+    int width, height, channels;
+    stbi_uc * pixels {stbi_load(TEXTURE_PATH.c_str(), &width, &height, &channels, STBI_rgb_alpha)};
+    if(!pixels)
+    {
+        throw std::runtime_error("Failed to load texture image.");
+    }
+
+    ThreadPool threadPool {options.threadCount};
+    auto startTime {std::chrono::high_resolution_clock::now()};
+    std::vector<MipLevel> mipChain {generateMipChain(pixels, width, height, threadPool)};
+    auto mipsTime {std::chrono::high_resolution_clock::now()};
+    std::vector<std::vector<uint8_t>> encodedLevels;
+    size_t encodedBytes {0};
+    size_t rgba8Bytes {0};
+    for(const MipLevel & level : mipChain)
+    {
+        encodedLevels.push_back(compressImage(level.texels.data(), level.width, level.height, encoding, threadPool));
+        encodedBytes += encodedLevels.back().size();
+        rgba8Bytes += level.texels.size();
+    }
+    double mipMilliseconds {std::chrono::duration<double, std::milli>(mipsTime - startTime).count()};
+    double encodeMilliseconds {std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mipsTime).count()};
+
+    // Quality of the largest level, which dominates what is seen up close
+    std::vector<uint8_t> decoded {decompressImage(encodedLevels[0].data(), width, height, encoding, threadPool)};
+    double psnr {rgbPsnr(pixels, decoded.data(), static_cast<size_t>(width) * height)};
+    stbi_image_free(pixels);
 
+    if(!writeTextureContainer(TEXTURE_CONTAINER_PATH, sourceHash, encoding, width, height, encodedLevels))
+    {
+        throw std::runtime_error("Failed to write texture container " + TEXTURE_CONTAINER_PATH);
+    }
+
+    std::ofstream file;
+    std::ostream & out {openReportStream(options.benchmarkOutputPath, file)};
+
+    out << "{\n";
+    out << "  \"benchmark\": \"texture_compression\",\n";
+    out << "  \"texture\": \"" << TEXTURE_PATH << "\",\n";
+    out << "  \"encoding\": \"" << textureEncodingName(encoding) << "\",\n";
+    out << "  \"width\": " << width << ",\n";
+    out << "  \"height\": " << height << ",\n";
+    out << "  \"threads\": " << threadPool.threadCount() << ",\n";
+    out << "  \"levels\": " << mipChain.size() << ",\n";
+    out << "  \"mip_ms\": " << mipMilliseconds << ",\n";
+    out << "  \"encode_ms\": " << encodeMilliseconds << ",\n";
+    out << "  \"rgba8_bytes\": " << rgba8Bytes << ",\n";
+    out << "  \"encoded_bytes\": " << encodedBytes << ",\n";
+    // Lossless encodings have no finite PSNR, which JSON can't represent
+    out << "  \"rgb_psnr_db\": ";
+    if(std::isinf(psnr))
+    {
+        out << "null\n";
+    }
+    else
+    {
+        out << psnr << "\n";
+    }
+    out << "}" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
     try
     {
+        ApplicationOptions options {parseCommandLine(argc, argv)};
+        if(options.benchmarkDedup)
+        {
+            benchmarkVertexDeduplication(options);
+            return EXIT_SUCCESS;
+        }
+        if(!options.meshReportPath.empty())
+        {
+            reportMeshOptimization(options);
+            return EXIT_SUCCESS;
+        }
+        if(!options.compressTextureEncoding.empty())
+        {
+            compressTexture(options);
+            return EXIT_SUCCESS;
+        }
+
+        HelloTriangleApplication app {options};
         app.run();
     }
     catch (const std::exception& e)
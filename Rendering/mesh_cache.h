@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // for memcmp
+#include <cstdio> // for std::rename, std::remove
+#include <string>
+#include <fstream>
+#include <utility> // for std::swap
+#include <algorithm> // for std::max
+// POSIX memory mapping
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile && other) noexcept
+    {
+        std::swap(mapping, other.mapping);
+        std::swap(mappingSize, other.mappingSize);
+    }
+
+    MappedFile & operator=(MappedFile && other) noexcept
+    {
+        std::swap(mapping, other.mapping);
+        std::swap(mappingSize, other.mappingSize);
+        return *this;
+    }
+
+    // Returns false if the file doesn't exist or can't be mapped
+    bool open(const std::string & path)
+    {
+        close();
+
+        int fileDescriptor {::open(path.c_str(), O_RDONLY)};
+        if(fileDescriptor < 0)
+        {
+            return false;
+        }
+
+        struct stat fileStatus {};
+        if(fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size <= 0)
+        {
+            ::close(fileDescriptor);
+            return false;
+        }
+
+        size_t fileSize {static_cast<size_t>(fileStatus.st_size)};
+        void * address {mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0)};
+        // The mapping stays valid after the file descriptor is closed
+        ::close(fileDescriptor);
+        if(address == MAP_FAILED)
+        {
+            return false;
+        }
+
+        mapping = address;
+        mappingSize = fileSize;
+        return true;
+    }
+
+    void close()
+    {
+        if(mapping != nullptr)
+        {
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+            mappingSize = 0;
+        }
+    }
+
+    bool isOpen() const
+    {
+        return mapping != nullptr;
+    }
+
+    const unsigned char * data() const
+    {
+        return static_cast<const unsigned char *>(mapping);
+    }
+
+    size_t size() const
+    {
+        return mappingSize;
+    }
+
+private:
+    void * mapping {nullptr};
+    size_t mappingSize {0};
+};
+
+// Opens a temporary file next to path, lets writeBody fill it, and then renames it to path,
+// so an interrupted write never leaves a truncated file behind. writeBody takes the std::ofstream.
+template<typename WriteBody>
+bool writeFileAtomically(const std::string & path, WriteBody writeBody)
+{
+    std::string temporaryPath {path + ".tmp"};
+    std::ofstream file {temporaryPath, std::ios::binary | std::ios::trunc};
+    if(!file.is_open())
+    {
+        return false;
+    }
+    writeBody(file);
+    file.close();
+
+    if(!file || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Binary mesh cache file:
+// a MeshCacheHeader, followed by the packed vertex array, followed by the uint32_t index array,
+// followed by the MeshCacheLod table, the MeshCacheMaterial table and the MeshCacheMaterialRange table.
+// The index array starts at the first 4 byte aligned offset after the vertices.
+const char MESH_CACHE_MAGIC[8] {'V', 'K', 'M', 'E', 'S', 'H', '\0', '\0'};
+// Increment whenever the file layout, or the way loadModel builds the mesh, changes
+const uint32_t MESH_CACHE_VERSION {4};
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    // sizeof(Vertex) when the cache was written, so a changed vertex layout invalidates it
+    uint32_t vertexSize;
+    // Hash of the source OBJ file contents
+    uint64_t sourceHash;
+    uint32_t vertexCount;
+    // Indices of all the levels of detail together
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint32_t materialCount;
+};
+
+// Range of the index array holding one level of detail, finest first
+struct MeshCacheLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Estimated distance, in model units, between this level and the full detail mesh: the sum over the
+    // simplification steps of their largest quadric error, the square root of an area weighted mean of squared
+    // plane distances. An estimate to select levels with, not a bound on the distance.
+    float error;
+    uint32_t reserved;
+};
+
+// Surface parameters of one material of the mesh, from the material library of the OBJ file
+struct MeshCacheMaterial
+{
+    float diffuse[3];
+    uint32_t reserved;
+};
+
+// Range of the index array drawn with one material. Each level of detail has one range per material,
+// the one of material m of level l at l*materialCount + m. A level's ranges are in material order,
+// cover all of its indices, and can be empty.
+struct MeshCacheMaterialRange
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// Mesh data inside a mapped mesh cache file
+struct MeshCacheView
+{
+    const void * vertexData {nullptr};
+    uint32_t vertexCount {0};
+    const uint32_t * indexData {nullptr};
+    uint32_t indexCount {0};
+    const MeshCacheLod * lodData {nullptr};
+    uint32_t lodCount {0};
+    const MeshCacheMaterial * materialData {nullptr};
+    uint32_t materialCount {0};
+    // lodCount*materialCount ranges
+    const MeshCacheMaterialRange * materialRangeData {nullptr};
+};
+
+inline size_t meshCacheIndexOffset(uint32_t vertexSize, uint32_t vertexCount)
+{
+    size_t vertexEnd {sizeof(MeshCacheHeader) + static_cast<size_t>(vertexSize) * vertexCount};
+    return (vertexEnd + alignof(uint32_t) - 1) & ~(alignof(uint32_t) - 1);
+}
+
+inline size_t meshCacheLodOffset(uint32_t vertexSize, uint32_t vertexCount, uint32_t indexCount)
+{
+    return meshCacheIndexOffset(vertexSize, vertexCount) + sizeof(uint32_t) * static_cast<size_t>(indexCount);
+}
+
+// Returns false if the file isn't a valid cache of the given source, in which case it has to be rebuilt
+inline bool readMeshCache(const MappedFile & file, uint64_t sourceHash, uint32_t vertexSize, MeshCacheView & view)
+{
+    if(!file.isOpen() || file.size() < sizeof(MeshCacheHeader))
+    {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if(
+        memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+        header.version != MESH_CACHE_VERSION ||
+        header.vertexSize != vertexSize ||
+        header.sourceHash != sourceHash
+    )
+    {
+        return false;
+    }
+
+    size_t indexOffset {meshCacheIndexOffset(header.vertexSize, header.vertexCount)};
+    size_t lodOffset {meshCacheLodOffset(header.vertexSize, header.vertexCount, header.indexCount)};
+    size_t materialOffset {lodOffset + sizeof(MeshCacheLod) * static_cast<size_t>(header.lodCount)};
+    size_t materialRangeOffset {materialOffset + sizeof(MeshCacheMaterial) * static_cast<size_t>(header.materialCount)};
+    size_t materialRangeCount {static_cast<size_t>(header.lodCount) * header.materialCount};
+    if(
+        header.vertexCount == 0 ||
+        header.lodCount == 0 ||
+        header.materialCount == 0 ||
+        file.size() != materialRangeOffset + sizeof(MeshCacheMaterialRange) * materialRangeCount
+    )
+    {
+        return false;
+    }
+    const MeshCacheLod * lods {reinterpret_cast<const MeshCacheLod *>(file.data() + lodOffset)};
+    const MeshCacheMaterialRange * ranges {reinterpret_cast<const MeshCacheMaterialRange *>(file.data() + materialRangeOffset)};
+    for(uint32_t i {0}; i < header.lodCount; i++)
+    {
+        if(static_cast<uint64_t>(lods[i].firstIndex) + lods[i].indexCount > header.indexCount)
+        {
+            return false;
+        }
+        // The level's material ranges must follow each other and cover it
+        uint64_t end {lods[i].firstIndex};
+        for(uint32_t material {0}; material < header.materialCount; material++)
+        {
+            const MeshCacheMaterialRange & range {ranges[static_cast<size_t>(i) * header.materialCount + material]};
+            if(range.firstIndex != end)
+            {
+                return false;
+            }
+            end += range.indexCount;
+        }
+        if(end != static_cast<uint64_t>(lods[i].firstIndex) + lods[i].indexCount)
+        {
+            return false;
+        }
+    }
+
+    // Every index must be a vertex, since the cached arrays are used without further checks
+    const uint32_t * indices {reinterpret_cast<const uint32_t *>(file.data() + indexOffset)};
+    uint32_t maxIndex {0};
+    for(uint32_t i {0}; i < header.indexCount; i++)
+    {
+        maxIndex = std::max(maxIndex, indices[i]);
+    }
+    if(maxIndex >= header.vertexCount)
+    {
+        return false;
+    }
+
+    view.vertexData = file.data() + sizeof(MeshCacheHeader);
+    view.vertexCount = header.vertexCount;
+    view.indexData = indices;
+    view.indexCount = header.indexCount;
+    view.lodData = lods;
+    view.lodCount = header.lodCount;
+    view.materialData = reinterpret_cast<const MeshCacheMaterial *>(file.data() + materialOffset);
+    view.materialCount = header.materialCount;
+    view.materialRangeData = ranges;
+    return true;
+}
+
+// Writes the cache with writeFileAtomically, so an interrupted write never leaves a truncated cache behind
+inline bool writeMeshCache(
+    const std::string & path,
+    uint64_t sourceHash,
+    const void * vertexData,
+    uint32_t vertexSize,
+    uint32_t vertexCount,
+    const uint32_t * indexData,
+    uint32_t indexCount,
+    const MeshCacheLod * lodData,
+    uint32_t lodCount,
+    const MeshCacheMaterial * materialData,
+    uint32_t materialCount,
+    const MeshCacheMaterialRange * materialRangeData
+)
+{
+    MeshCacheHeader header {};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = vertexSize;
+    header.sourceHash = sourceHash;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.lodCount = lodCount;
+    header.materialCount = materialCount;
+
+    size_t vertexBytes {static_cast<size_t>(vertexSize) * vertexCount};
+    size_t paddingBytes {meshCacheIndexOffset(vertexSize, vertexCount) - sizeof(MeshCacheHeader) - vertexBytes};
+    const char padding[alignof(uint32_t)] {};
+
+    return writeFileAtomically(path, [&](std::ofstream & file)
+    {
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(static_cast<const char *>(vertexData), vertexBytes);
+        file.write(padding, paddingBytes);
+        file.write(reinterpret_cast<const char *>(indexData), sizeof(uint32_t) * static_cast<size_t>(indexCount));
+        file.write(reinterpret_cast<const char *>(lodData), sizeof(MeshCacheLod) * static_cast<size_t>(lodCount));
+        file.write(reinterpret_cast<const char *>(materialData), sizeof(MeshCacheMaterial) * static_cast<size_t>(materialCount));
+        file.write(
+            reinterpret_cast<const char *>(materialRangeData),
+            sizeof(MeshCacheMaterialRange) * static_cast<size_t>(lodCount) * materialCount
+        );
+    });
+}
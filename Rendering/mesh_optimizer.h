@@ -0,0 +1,383 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <cmath> // for std::pow
+#include <algorithm> // for std::copy
+#include <stdexcept>
+
+// Post-transform vertex cache efficiency of an index buffer, simulated with a FIFO cache
+struct VertexCacheStatistics
+{
+    size_t cacheSize {0};
+    size_t transformedVertices {0};
+    // Average cache miss ratio: transformed vertices per triangle. 0.5 is the best possible for a large regular grid, 3 the worst.
+    double acmr {0.0};
+    // Average transform to vertex ratio: transformed vertices per unique vertex. 1 is the best possible.
+    double atvr {0.0};
+};
+
+inline VertexCacheStatistics analyzeVertexCache(const uint32_t * indices, size_t indexCount, size_t vertexCount, size_t cacheSize = 16)
+{
+    VertexCacheStatistics statistics {};
+    statistics.cacheSize = cacheSize;
+
+    // Time each vertex entered the cache. A vertex is cached if it entered within the last cacheSize misses.
+    std::vector<size_t> entryTimes(vertexCount, 0);
+    size_t time {cacheSize + 1};
+    for(size_t i {0}; i < indexCount; i++)
+    {
+        uint32_t index {indices[i]};
+        if(time - entryTimes[index] > cacheSize)
+        {
+            entryTimes[index] = time;
+            time++;
+            statistics.transformedVertices++;
+        }
+    }
+
+    if(indexCount > 0)
+    {
+        statistics.acmr = static_cast<double>(statistics.transformedVertices) / (indexCount / 3);
+    }
+    if(vertexCount > 0)
+    {
+        statistics.atvr = static_cast<double>(statistics.transformedVertices) / vertexCount;
+    }
+    return statistics;
+}
+
+// Reorders the triangles of an indexed triangle list for post-transform vertex cache locality,
+// with Tom Forsyth's linear-speed vertex cache optimization. Greedily emits the triangle whose
+// vertices score highest, where vertices score higher the more recently they were used
+// and the fewer triangles still reference them. Only the order of the triangles changes.
+class VertexCacheOptimizer
+{
+public:
+    static constexpr size_t CACHE_SIZE {32};
+
+    static void optimize(uint32_t * indices, size_t indexCount, size_t vertexCount)
+    {
+        if(indexCount % 3 != 0)
+        {
+            throw std::invalid_argument("The index count of a triangle list must be a multiple of 3.");
+        }
+        size_t triangleCount {indexCount / 3};
+        if(triangleCount == 0)
+        {
+            return;
+        }
+
+        // Triangles of each vertex, as ranges of one flat array
+        std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+        for(size_t i {0}; i < indexCount; i++)
+        {
+            if(indices[i] >= vertexCount)
+            {
+                throw std::out_of_range("Vertex index out of range.");
+            }
+            triangleOffsets[indices[i] + 1]++;
+        }
+        for(size_t vertex {0}; vertex < vertexCount; vertex++)
+        {
+            triangleOffsets[vertex + 1] += triangleOffsets[vertex];
+        }
+        std::vector<uint32_t> vertexTriangles(indexCount);
+        std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for(size_t i {0}; i < indexCount; i++)
+        {
+            vertexTriangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Triangles not emitted yet, per vertex. Emitted triangles are swapped to the end of each vertex's range.
+        std::vector<uint32_t> activeTriangleCounts(vertexCount);
+        std::vector<int32_t> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for(size_t vertex {0}; vertex < vertexCount; vertex++)
+        {
+            activeTriangleCounts[vertex] = triangleOffsets[vertex + 1] - triangleOffsets[vertex];
+            vertexScores[vertex] = vertexScore(-1, activeTriangleCounts[vertex]);
+        }
+
+        std::vector<float> triangleScores(triangleCount);
+        for(size_t triangle {0}; triangle < triangleCount; triangle++)
+        {
+            triangleScores[triangle] =
+                vertexScores[indices[3*triangle]] +
+                vertexScores[indices[3*triangle + 1]] +
+                vertexScores[indices[3*triangle + 2]];
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> output;
+        output.reserve(indexCount);
+
+        // Least recently used first out. Holds up to 3 extra vertices while a triangle is added.
+        std::vector<uint32_t> cache;
+        cache.reserve(CACHE_SIZE + 3);
+        std::vector<uint32_t> newCache;
+        newCache.reserve(CACHE_SIZE + 3);
+
+        size_t nextUnemitted {0};
+        size_t bestTriangle {nextUnemittedTriangle(emitted, nextUnemitted)};
+        while(bestTriangle < triangleCount)
+        {
+            emitted[bestTriangle] = true;
+            std::array<uint32_t, 3> triangleVertices {
+                indices[3*bestTriangle],
+                indices[3*bestTriangle + 1],
+                indices[3*bestTriangle + 2]
+            };
+
+            // Move the triangle's vertices to the front of the cache
+            newCache.clear();
+            for(uint32_t vertex : triangleVertices)
+            {
+                output.push_back(vertex);
+                newCache.push_back(vertex);
+                removeActiveTriangle(vertexTriangles, triangleOffsets, activeTriangleCounts, vertex, static_cast<uint32_t>(bestTriangle));
+            }
+            for(uint32_t vertex : cache)
+            {
+                if(vertex != triangleVertices[0] && vertex != triangleVertices[1] && vertex != triangleVertices[2])
+                {
+                    newCache.push_back(vertex);
+                }
+            }
+            std::swap(cache, newCache);
+
+            // Vertices pushed out of the cache lose their cache score
+            for(size_t position {CACHE_SIZE}; position < cache.size(); position++)
+            {
+                cachePositions[cache[position]] = -1;
+                updateVertexScore(vertexTriangles, triangleOffsets, activeTriangleCounts, cachePositions, vertexScores, triangleScores, cache[position]);
+            }
+            if(cache.size() > CACHE_SIZE)
+            {
+                cache.resize(CACHE_SIZE);
+            }
+
+            // Rescore the cached vertices, and pick the best triangle using them
+            float bestScore {-1.0f};
+            bestTriangle = triangleCount;
+            for(size_t position {0}; position < cache.size(); position++)
+            {
+                uint32_t vertex {cache[position]};
+                cachePositions[vertex] = static_cast<int32_t>(position);
+                updateVertexScore(vertexTriangles, triangleOffsets, activeTriangleCounts, cachePositions, vertexScores, triangleScores, vertex);
+            }
+            for(uint32_t vertex : cache)
+            {
+                uint32_t begin {triangleOffsets[vertex]};
+                for(uint32_t i {begin}; i < begin + activeTriangleCounts[vertex]; i++)
+                {
+                    uint32_t triangle {vertexTriangles[i]};
+                    if(triangleScores[triangle] > bestScore)
+                    {
+                        bestScore = triangleScores[triangle];
+                        bestTriangle = triangle;
+                    }
+                }
+            }
+
+            // No cached vertex has triangles left, continue elsewhere
+            if(bestTriangle == triangleCount)
+            {
+                bestTriangle = nextUnemittedTriangle(emitted, nextUnemitted);
+            }
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+private:
+    static float vertexScore(int32_t cachePosition, uint32_t activeTriangleCount)
+    {
+        // Vertices with no triangles left don't need to be kept
+        if(activeTriangleCount == 0)
+        {
+            return -1.0f;
+        }
+
+        float score {0.0f};
+        if(cachePosition >= 0)
+        {
+            if(cachePosition < 3)
+            {
+                // The last triangle's vertices get a fixed score, so the next triangle isn't
+                // biased towards the order they were added in
+                score = 0.75f;
+            }
+            else
+            {
+                float scaler {1.0f / (CACHE_SIZE - 3)};
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+            }
+        }
+
+        // Boost vertices with few triangles left, so lone triangles don't get left behind
+        score += 2.0f * std::pow(static_cast<float>(activeTriangleCount), -0.5f);
+        return score;
+    }
+
+    static void removeActiveTriangle(
+        std::vector<uint32_t> & vertexTriangles,
+        const std::vector<uint32_t> & triangleOffsets,
+        std::vector<uint32_t> & activeTriangleCounts,
+        uint32_t vertex,
+        uint32_t triangle
+    )
+    {
+        uint32_t begin {triangleOffsets[vertex]};
+        uint32_t last {begin + activeTriangleCounts[vertex] - 1};
+        for(uint32_t i {begin}; i <= last; i++)
+        {
+            if(vertexTriangles[i] == triangle)
+            {
+                std::swap(vertexTriangles[i], vertexTriangles[last]);
+                activeTriangleCounts[vertex]--;
+                return;
+            }
+        }
+    }
+
+    static void updateVertexScore(
+        const std::vector<uint32_t> & vertexTriangles,
+        const std::vector<uint32_t> & triangleOffsets,
+        const std::vector<uint32_t> & activeTriangleCounts,
+        const std::vector<int32_t> & cachePositions,
+        std::vector<float> & vertexScores,
+        std::vector<float> & triangleScores,
+        uint32_t vertex
+    )
+    {
+        float score {vertexScore(cachePositions[vertex], activeTriangleCounts[vertex])};
+        float difference {score - vertexScores[vertex]};
+        if(difference == 0.0f)
+        {
+            return;
+        }
+        vertexScores[vertex] = score;
+
+        uint32_t begin {triangleOffsets[vertex]};
+        for(uint32_t i {begin}; i < begin + activeTriangleCounts[vertex]; i++)
+        {
+            triangleScores[vertexTriangles[i]] += difference;
+        }
+    }
+
+    // First triangle not emitted yet, in the original order. Only needed when the cached vertices
+    // have no triangles left, so the scan resumes where the last one stopped.
+    static size_t nextUnemittedTriangle(const std::vector<bool> & emitted, size_t & nextUnemitted)
+    {
+        while(nextUnemitted < emitted.size() && emitted[nextUnemitted])
+        {
+            nextUnemitted++;
+        }
+        return nextUnemitted;
+    }
+};
+
+// Reorders the vertices in the order the indices first use them, and remaps the indices.
+// After the vertex cache optimization this makes the vertex fetches nearly sequential.
+// Vertices no index uses are dropped. Returns the number of vertices kept.
+template<typename VertexType>
+size_t optimizeVertexFetch(std::vector<VertexType> & vertices, uint32_t * indices, size_t indexCount)
+{
+    const uint32_t unused {UINT32_MAX};
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    std::vector<VertexType> reordered;
+    reordered.reserve(vertices.size());
+
+    for(size_t i {0}; i < indexCount; i++)
+    {
+        uint32_t & newIndex {remap[indices[i]]};
+        if(newIndex == unused)
+        {
+            newIndex = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[indices[i]]);
+        }
+        indices[i] = newIndex;
+    }
+
+    vertices = std::move(reordered);
+    return vertices.size();
+}
+
+// A run of triangles drawn with one draw call. Its indices are relative to vertexOffset.
+struct SubMesh
+{
+    uint32_t firstIndex {0};
+    uint32_t indexCount {0};
+    int32_t vertexOffset {0};
+    // Material of all its triangles
+    uint32_t material {0};
+};
+
+// Number of vertices a 16 bit index can address
+const size_t SHORT_INDEX_VERTEX_COUNT {65536};
+
+// Splits the triangles, in order, into sub-meshes whose vertices are at most SHORT_INDEX_VERTEX_COUNT apart,
+// and writes their indices as 16 bit offsets from each sub-mesh's lowest vertex. A single sub-mesh when
+// the mesh has few enough vertices. After optimizeVertexFetch the triangles use the vertices nearly in order,
+// so the runs stay long. Returns false, splitting nothing, if a single triangle's vertices are too far apart.
+inline bool splitForShortIndices(
+    const uint32_t * indices,
+    size_t indexCount,
+    std::vector<SubMesh> & subMeshes,
+    std::vector<uint16_t> & shortIndices
+)
+{
+    if(indexCount % 3 != 0)
+    {
+        throw std::invalid_argument("The index count of a triangle list must be a multiple of 3.");
+    }
+
+    subMeshes.clear();
+    shortIndices.resize(indexCount);
+
+    size_t first {0};
+    uint32_t low {UINT32_MAX};
+    uint32_t high {0};
+    auto closeSubMesh = [&](size_t end)
+    {
+        SubMesh subMesh {};
+        subMesh.firstIndex = static_cast<uint32_t>(first);
+        subMesh.indexCount = static_cast<uint32_t>(end - first);
+        subMesh.vertexOffset = static_cast<int32_t>(low);
+        for(size_t i {first}; i < end; i++)
+        {
+            shortIndices[i] = static_cast<uint16_t>(indices[i] - low);
+        }
+        subMeshes.push_back(subMesh);
+    };
+
+    for(size_t triangle {0}; triangle < indexCount; triangle += 3)
+    {
+        uint32_t triangleLow {std::min({indices[triangle], indices[triangle + 1], indices[triangle + 2]})};
+        uint32_t triangleHigh {std::max({indices[triangle], indices[triangle + 1], indices[triangle + 2]})};
+        if(triangleHigh - triangleLow >= SHORT_INDEX_VERTEX_COUNT)
+        {
+            subMeshes.clear();
+            shortIndices.clear();
+            return false;
+        }
+
+        if(triangle > first && std::max(high, triangleHigh) - std::min(low, triangleLow) >= SHORT_INDEX_VERTEX_COUNT)
+        {
+            closeSubMesh(triangle);
+            first = triangle;
+            low = UINT32_MAX;
+            high = 0;
+        }
+        low = std::min(low, triangleLow);
+        high = std::max(high, triangleHigh);
+    }
+    if(indexCount > first)
+    {
+        closeSubMesh(indexCount);
+    }
+    return true;
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // for memcpy
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+// Symmetric 4x4 error quadric of Garland and Heckbert, as its 10 distinct coefficients,
+// plus the total area of the planes summed into it
+struct Quadric
+{
+    std::array<double, 10> coefficients {};
+    double weight {0.0};
+
+    // Adds the squared distance to the plane ax + by + cz + d = 0, with (a, b, c) of unit length
+    void addPlane(double a, double b, double c, double d, double planeWeight)
+    {
+        std::array<double, 4> plane {a, b, c, d};
+        size_t k {0};
+        for(size_t i {0}; i < 4; i++)
+        {
+            for(size_t j {i}; j < 4; j++)
+            {
+                coefficients[k++] += planeWeight * plane[i] * plane[j];
+            }
+        }
+        weight += planeWeight;
+    }
+
+    void add(const Quadric & other)
+    {
+        for(size_t k {0}; k < coefficients.size(); k++)
+        {
+            coefficients[k] += other.coefficients[k];
+        }
+        weight += other.weight;
+    }
+
+    // Weighted mean of the squared distances from the point to the planes
+    double error(const std::array<double, 3> & point) const
+    {
+        std::array<double, 4> v {point[0], point[1], point[2], 1.0};
+        double sum {0.0};
+        size_t k {0};
+        for(size_t i {0}; i < 4; i++)
+        {
+            for(size_t j {i}; j < 4; j++)
+            {
+                // Off-diagonal coefficients stand for both halves of the matrix
+                sum += (i == j ? 1.0 : 2.0) * coefficients[k++] * v[i] * v[j];
+            }
+        }
+        return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+    }
+};
+
+// Simplifies an indexed triangle list by collapsing edges in order of their quadric error.
+// A vertex only ever moves onto one of its neighbours, so the simplified triangles keep using the
+// original vertex buffer. Vertices on open borders and on attribute seams (several vertices with the
+// same position) never move, which keeps the outline and the texture coordinates intact.
+// Stops at targetIndexCount indices, or when no edge can be collapsed. error receives the largest
+// collapse error, the square root of its quadric error, as an estimated distance in model units.
+inline std::vector<uint32_t> simplifyMesh(
+    const float * positions,
+    size_t positionStride,
+    size_t vertexCount,
+    const uint32_t * indices,
+    size_t indexCount,
+    size_t targetIndexCount,
+    float & error
+)
+{
+    error = 0.0f;
+    std::vector<uint32_t> result(indices, indices + indexCount);
+
+    auto position = [&](uint32_t vertex)
+    {
+        const float * p {reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + vertex*positionStride)};
+        return std::array<double, 3> {p[0], p[1], p[2]};
+    };
+    auto subtract = [](const std::array<double, 3> & a, const std::array<double, 3> & b)
+    {
+        return std::array<double, 3> {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    };
+    auto cross = [](const std::array<double, 3> & a, const std::array<double, 3> & b)
+    {
+        return std::array<double, 3> {a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]};
+    };
+    auto dot = [](const std::array<double, 3> & a, const std::array<double, 3> & b)
+    {
+        return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+    };
+
+    // Vertices sharing a position get the same position id
+    std::vector<uint32_t> positionIds(vertexCount);
+    std::vector<uint32_t> positionUses;
+    {
+        struct PositionHash
+        {
+            size_t operator()(const std::array<float, 3> & p) const
+            {
+                uint32_t bits[3];
+                memcpy(bits, p.data(), sizeof(bits));
+                return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+            }
+        };
+        std::unordered_map<std::array<float, 3>, uint32_t, PositionHash> ids;
+        ids.reserve(vertexCount);
+        for(uint32_t vertex {0}; vertex < vertexCount; vertex++)
+        {
+            std::array<double, 3> p {position(vertex)};
+            std::array<float, 3> key {static_cast<float>(p[0]) + 0.0f, static_cast<float>(p[1]) + 0.0f, static_cast<float>(p[2]) + 0.0f};
+            auto inserted {ids.emplace(key, static_cast<uint32_t>(ids.size()))};
+            positionIds[vertex] = inserted.first->second;
+            if(inserted.second)
+            {
+                positionUses.push_back(0);
+            }
+            positionUses[positionIds[vertex]]++;
+        }
+    }
+
+    // Seam vertices, and the ends of edges that only one triangle uses
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::unordered_set<uint64_t> edges;
+        edges.reserve(indexCount);
+        auto edgeKey = [](uint32_t from, uint32_t to)
+        {
+            return (static_cast<uint64_t>(from) << 32) | to;
+        };
+        for(size_t i {0}; i < indexCount; i++)
+        {
+            uint32_t from {positionIds[indices[i]]};
+            uint32_t to {positionIds[indices[i - i % 3 + (i + 1) % 3]]};
+            edges.insert(edgeKey(from, to));
+        }
+        for(size_t i {0}; i < indexCount; i++)
+        {
+            uint32_t a {indices[i]};
+            uint32_t b {indices[i - i % 3 + (i + 1) % 3]};
+            if(edges.count(edgeKey(positionIds[b], positionIds[a])) == 0)
+            {
+                locked[a] = true;
+                locked[b] = true;
+            }
+        }
+        for(uint32_t vertex {0}; vertex < vertexCount; vertex++)
+        {
+            if(positionUses[positionIds[vertex]] > 1)
+            {
+                locked[vertex] = true;
+            }
+        }
+    }
+
+    // Quadric of the planes of each vertex's triangles, weighted by their area
+    std::vector<Quadric> quadrics(vertexCount);
+    for(size_t i {0}; i < indexCount; i += 3)
+    {
+        std::array<double, 3> p0 {position(indices[i])};
+        std::array<double, 3> normal {cross(subtract(position(indices[i + 1]), p0), subtract(position(indices[i + 2]), p0))};
+        double length {std::sqrt(dot(normal, normal))};
+        if(length == 0.0)
+        {
+            continue;
+        }
+        double a {normal[0] / length};
+        double b {normal[1] / length};
+        double c {normal[2] / length};
+        double d {-(a*p0[0] + b*p0[1] + c*p0[2])};
+        for(size_t corner {0}; corner < 3; corner++)
+        {
+            quadrics[indices[i + corner]].addPlane(a, b, c, d, 0.5 * length);
+        }
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<Collapse> collapses;
+
+    // Each pass collapses the cheapest edges whose vertices no other collapse of the pass has changed,
+    // so the costs computed at the start of the pass stay exact
+    while(result.size() > targetIndexCount)
+    {
+        // Triangles of each vertex
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for(uint32_t vertex : result)
+        {
+            triangleOffsets[vertex + 1]++;
+        }
+        for(size_t vertex {0}; vertex < vertexCount; vertex++)
+        {
+            triangleOffsets[vertex + 1] += triangleOffsets[vertex];
+        }
+        vertexTriangles.resize(result.size());
+        std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for(size_t i {0}; i < result.size(); i++)
+        {
+            vertexTriangles[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        collapses.clear();
+        for(size_t i {0}; i < result.size(); i++)
+        {
+            uint32_t from {result[i]};
+            uint32_t to {result[i - i % 3 + (i + 1) % 3]};
+            // Both directions of every edge, through the two triangles sharing it
+            if(!locked[from])
+            {
+                Quadric quadric {quadrics[from]};
+                quadric.add(quadrics[to]);
+                collapses.push_back({from, to, quadric.error(position(to))});
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse & a, const Collapse & b)
+        {
+            return a.cost < b.cost;
+        });
+
+        for(uint32_t vertex {0}; vertex < vertexCount; vertex++)
+        {
+            remap[vertex] = vertex;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t remainingIndexCount {result.size()};
+        size_t collapseCount {0};
+        for(const Collapse & collapse : collapses)
+        {
+            if(remainingIndexCount <= targetIndexCount)
+            {
+                break;
+            }
+            if(touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            // Reject collapses that would flip a triangle. Corners may have moved earlier in the pass.
+            std::array<double, 3> target {position(collapse.to)};
+            bool flips {false};
+            size_t removedTriangles {0};
+            for(uint32_t k {triangleOffsets[collapse.from]}; k < triangleOffsets[collapse.from + 1]; k++)
+            {
+                uint32_t triangle {vertexTriangles[k]};
+                std::array<uint32_t, 3> corners {
+                    remap[result[3*triangle]],
+                    remap[result[3*triangle + 1]],
+                    remap[result[3*triangle + 2]]
+                };
+                if(corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to)
+                {
+                    removedTriangles++;
+                    continue;
+                }
+                if(corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0])
+                {
+                    // Already degenerate from an earlier collapse of the pass
+                    continue;
+                }
+
+                std::array<std::array<double, 3>, 3> before {position(corners[0]), position(corners[1]), position(corners[2])};
+                std::array<std::array<double, 3>, 3> after {before};
+                for(size_t corner {0}; corner < 3; corner++)
+                {
+                    if(corners[corner] == collapse.from)
+                    {
+                        after[corner] = target;
+                    }
+                }
+                std::array<double, 3> normalBefore {cross(subtract(before[1], before[0]), subtract(before[2], before[0]))};
+                std::array<double, 3> normalAfter {cross(subtract(after[1], after[0]), subtract(after[2], after[0]))};
+                if(dot(normalBefore, normalAfter) <= 0.0)
+                {
+                    flips = true;
+                    break;
+                }
+            }
+            if(flips || removedTriangles == 0)
+            {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            touched[collapse.from] = true;
+            touched[collapse.to] = true;
+            error = std::max(error, static_cast<float>(std::sqrt(collapse.cost)));
+            remainingIndexCount -= 3*removedTriangles;
+            collapseCount++;
+        }
+
+        if(collapseCount == 0)
+        {
+            break;
+        }
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t writeIndex {0};
+        for(size_t i {0}; i < result.size(); i += 3)
+        {
+            uint32_t a {remap[result[i]]};
+            uint32_t b {remap[result[i + 1]]};
+            uint32_t c {remap[result[i + 2]]};
+            if(a != b && b != c && c != a)
+            {
+                result[writeIndex++] = a;
+                result[writeIndex++] = b;
+                result[writeIndex++] = c;
+            }
+        }
+        result.resize(writeIndex);
+    }
+
+    return result;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+// Size limits of a meshlet, the same as the usual mesh shader limits
+const size_t MESHLET_MAX_VERTICES {64};
+const size_t MESHLET_MAX_TRIANGLES {124};
+
+// Cluster of neighbouring triangles, drawn as a range of the index array
+struct Meshlet
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Added to the indices when drawing, like SubMesh::vertexOffset
+    int32_t vertexOffset;
+    // Sphere bounding the meshlet's vertices
+    std::array<float, 3> center;
+    float radius;
+    // All triangle normals lie in the cone around coneAxis whose half angle has coneCutoff as sine.
+    // coneCutoff is 1 when the normals spread too much for the cone to cull anything.
+    std::array<float, 3> coneAxis;
+    float coneCutoff;
+};
+
+// True if all the triangles of a meshlet, with the given bounds in the camera's space, face away from the camera.
+// Conservative for any position of the triangles inside the bounding sphere.
+inline bool isMeshletBackfacing(
+    const std::array<float, 3> & center,
+    float radius,
+    const std::array<float, 3> & coneAxis,
+    float coneCutoff,
+    const std::array<float, 3> & camera
+)
+{
+    std::array<float, 3> direction {center[0] - camera[0], center[1] - camera[1], center[2] - camera[2]};
+    float distance {std::sqrt(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2])};
+    float alignment {direction[0]*coneAxis[0] + direction[1]*coneAxis[1] + direction[2]*coneAxis[2]};
+    return alignment >= coneCutoff * distance + radius;
+}
+
+// Splits the triangles in [firstIndex, firstIndex + indexCount) into meshlets, in index order, and appends them to meshlets.
+// The indices should already be ordered for the vertex cache, so consecutive triangles are neighbours.
+inline void buildMeshlets(
+    const float * positions,
+    size_t positionStride,
+    size_t vertexCount,
+    const uint32_t * indices,
+    uint32_t firstIndex,
+    uint32_t indexCount,
+    int32_t vertexOffset,
+    std::vector<Meshlet> & meshlets
+)
+{
+    if(indexCount % 3 != 0)
+    {
+        throw std::invalid_argument("The index count of a triangle list must be a multiple of 3.");
+    }
+
+    auto position = [&](uint32_t vertex)
+    {
+        const float * p {reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + vertex*positionStride)};
+        return std::array<float, 3> {p[0], p[1], p[2]};
+    };
+
+    // Stamp of the last meshlet which used each vertex, to count the unique vertices of the current one
+    std::vector<uint32_t> vertexStamps(vertexCount, UINT32_MAX);
+    uint32_t stamp {0};
+
+    auto closeMeshlet = [&](uint32_t begin, uint32_t end)
+    {
+        Meshlet meshlet {};
+        meshlet.firstIndex = begin;
+        meshlet.indexCount = end - begin;
+        meshlet.vertexOffset = vertexOffset;
+
+        // Sphere around the center of the bounding box
+        std::array<float, 3> low {position(indices[begin])};
+        std::array<float, 3> high {low};
+        for(uint32_t i {begin}; i < end; i++)
+        {
+            std::array<float, 3> p {position(indices[i])};
+            for(size_t axis {0}; axis < 3; axis++)
+            {
+                low[axis] = std::min(low[axis], p[axis]);
+                high[axis] = std::max(high[axis], p[axis]);
+            }
+        }
+        for(size_t axis {0}; axis < 3; axis++)
+        {
+            meshlet.center[axis] = (low[axis] + high[axis]) / 2.0f;
+        }
+        float radiusSquared {0.0f};
+        for(uint32_t i {begin}; i < end; i++)
+        {
+            std::array<float, 3> p {position(indices[i])};
+            float dx {p[0] - meshlet.center[0]};
+            float dy {p[1] - meshlet.center[1]};
+            float dz {p[2] - meshlet.center[2]};
+            radiusSquared = std::max(radiusSquared, dx*dx + dy*dy + dz*dz);
+        }
+        meshlet.radius = std::sqrt(radiusSquared);
+
+        // The cone axis is the mean of the unit triangle normals, and its angle reaches the farthest normal
+        std::vector<std::array<float, 3>> normals;
+        normals.reserve((end - begin) / 3);
+        std::array<float, 3> axisSum {0.0f, 0.0f, 0.0f};
+        for(uint32_t i {begin}; i < end; i += 3)
+        {
+            std::array<float, 3> p0 {position(indices[i])};
+            std::array<float, 3> p1 {position(indices[i + 1])};
+            std::array<float, 3> p2 {position(indices[i + 2])};
+            std::array<float, 3> e1 {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            std::array<float, 3> e2 {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            std::array<float, 3> normal {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+            float length {std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2])};
+            if(length == 0.0f)
+            {
+                // Degenerate triangles are never drawn, so they don't widen the cone
+                continue;
+            }
+            for(size_t axis {0}; axis < 3; axis++)
+            {
+                normal[axis] /= length;
+                axisSum[axis] += normal[axis];
+            }
+            normals.push_back(normal);
+        }
+
+        meshlet.coneAxis = {0.0f, 0.0f, 1.0f};
+        meshlet.coneCutoff = 1.0f;
+        float axisLength {std::sqrt(axisSum[0]*axisSum[0] + axisSum[1]*axisSum[1] + axisSum[2]*axisSum[2])};
+        if(axisLength > 0.0f)
+        {
+            for(size_t axis {0}; axis < 3; axis++)
+            {
+                meshlet.coneAxis[axis] = axisSum[axis] / axisLength;
+            }
+            float minAlignment {1.0f};
+            for(const std::array<float, 3> & normal : normals)
+            {
+                minAlignment = std::min(minAlignment, normal[0]*meshlet.coneAxis[0] + normal[1]*meshlet.coneAxis[1] + normal[2]*meshlet.coneAxis[2]);
+            }
+            // A cone wider than a half space can't be entirely backfacing
+            if(minAlignment > 0.0f)
+            {
+                meshlet.coneCutoff = std::sqrt(1.0f - minAlignment*minAlignment);
+            }
+        }
+
+        meshlets.push_back(meshlet);
+    };
+
+    uint32_t begin {firstIndex};
+    uint32_t end {firstIndex + indexCount};
+    size_t meshletVertexCount {0};
+    for(uint32_t triangle {firstIndex}; triangle < end; triangle += 3)
+    {
+        size_t newVertexCount {0};
+        for(uint32_t corner {0}; corner < 3; corner++)
+        {
+            uint32_t vertex {indices[triangle + corner]};
+            bool repeated {(corner > 0 && indices[triangle] == vertex) || (corner > 1 && indices[triangle + 1] == vertex)};
+            if(vertexStamps[vertex] != stamp && !repeated)
+            {
+                newVertexCount++;
+            }
+        }
+
+        if(
+            meshletVertexCount + newVertexCount > MESHLET_MAX_VERTICES ||
+            (triangle - begin) / 3 >= MESHLET_MAX_TRIANGLES
+        )
+        {
+            closeMeshlet(begin, triangle);
+            begin = triangle;
+            stamp++;
+            meshletVertexCount = 0;
+        }
+
+        for(uint32_t corner {0}; corner < 3; corner++)
+        {
+            uint32_t vertex {indices[triangle + corner]};
+            if(vertexStamps[vertex] != stamp)
+            {
+                vertexStamps[vertex] = stamp;
+                meshletVertexCount++;
+            }
+        }
+    }
+    if(end > begin)
+    {
+        closeMeshlet(begin, end);
+    }
+}
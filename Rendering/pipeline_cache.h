@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstring> // for memcpy, memcmp
+#include <string>
+#include <vector>
+#include <fstream>
+#include "mesh_cache.h" // for writeFileAtomically
+
+// Pipeline cache data starts with a header written by the driver (VkPipelineCacheHeaderVersionOne):
+// header size, header version, vendor ID, device ID and pipeline cache UUID.
+// Data from another driver or device is rejected here, instead of relying on every driver to reject it.
+inline bool isPipelineCacheCompatible(const std::vector<char> & data, const VkPhysicalDeviceProperties & properties)
+{
+    const size_t HEADER_SIZE {16 + VK_UUID_SIZE};
+    if(data.size() < HEADER_SIZE)
+    {
+        return false;
+    }
+
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    memcpy(&headerSize, data.data(), sizeof(uint32_t));
+    memcpy(&headerVersion, data.data() + 4, sizeof(uint32_t));
+    memcpy(&vendorID, data.data() + 8, sizeof(uint32_t));
+    memcpy(&deviceID, data.data() + 12, sizeof(uint32_t));
+
+    return
+        headerSize >= HEADER_SIZE &&
+        headerSize <= data.size() &&
+        headerVersion == static_cast<uint32_t>(VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+        vendorID == properties.vendorID &&
+        deviceID == properties.deviceID &&
+        memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Returns no data if the file doesn't exist
+inline std::vector<char> readPipelineCacheFile(const std::string & path)
+{
+    std::ifstream file {path, std::ios::ate | std::ios::binary};
+    if(!file.is_open())
+    {
+        return {};
+    }
+
+    std::vector<char> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    if(!file)
+    {
+        return {};
+    }
+    return data;
+}
+
+// Written with writeFileAtomically, so a crash never leaves a truncated cache behind
+inline bool writePipelineCacheFile(const std::string & path, const std::vector<char> & data)
+{
+    return writeFileAtomically(path, [&](std::ofstream & file)
+    {
+        file.write(data.data(), data.size());
+    });
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // for memcpy
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// One draw of the render queue: a sub-mesh of an object, with the key it is sorted by
+struct DrawItem
+{
+    uint64_t key;
+    uint32_t object;
+    uint32_t subMesh;
+};
+
+// Bits of the draw sort key, from the most significant. The state which costs the most to change comes first,
+// so sorting the keys groups the draws which share it. The remaining 32 low bits hold the depth.
+const uint32_t DRAW_KEY_PIPELINE_BITS {8};
+const uint32_t DRAW_KEY_MATERIAL_BITS {16};
+const uint32_t DRAW_KEY_VERTEX_BUFFER_BITS {8};
+
+const uint32_t DRAW_KEY_VERTEX_BUFFER_SHIFT {32};
+const uint32_t DRAW_KEY_MATERIAL_SHIFT {DRAW_KEY_VERTEX_BUFFER_SHIFT + DRAW_KEY_VERTEX_BUFFER_BITS};
+const uint32_t DRAW_KEY_PIPELINE_SHIFT {DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS};
+
+// Packs the state of a draw into its sort key. The bits of a non-negative float sort in the same order
+// as its value, so the draws sharing all the state are drawn front to back.
+inline uint64_t drawSortKey(uint32_t pipeline, uint32_t material, uint32_t vertexBuffer, float depth)
+{
+    if(
+        pipeline >= (1u << DRAW_KEY_PIPELINE_BITS) ||
+        material >= (1u << DRAW_KEY_MATERIAL_BITS) ||
+        vertexBuffer >= (1u << DRAW_KEY_VERTEX_BUFFER_BITS)
+    )
+    {
+        throw std::invalid_argument("Draw state id too large for the bits of its sort key.");
+    }
+    uint32_t depthBits {0};
+    if(depth > 0.0f)
+    {
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+    }
+    return
+        static_cast<uint64_t>(pipeline) << DRAW_KEY_PIPELINE_SHIFT |
+        static_cast<uint64_t>(material) << DRAW_KEY_MATERIAL_SHIFT |
+        static_cast<uint64_t>(vertexBuffer) << DRAW_KEY_VERTEX_BUFFER_SHIFT |
+        depthBits;
+}
+
+inline uint32_t drawKeyPipeline(uint64_t key)
+{
+    return static_cast<uint32_t>(key >> DRAW_KEY_PIPELINE_SHIFT) & ((1u << DRAW_KEY_PIPELINE_BITS) - 1);
+}
+
+inline uint32_t drawKeyMaterial(uint64_t key)
+{
+    return static_cast<uint32_t>(key >> DRAW_KEY_MATERIAL_SHIFT) & ((1u << DRAW_KEY_MATERIAL_BITS) - 1);
+}
+
+inline uint32_t drawKeyVertexBuffer(uint64_t key)
+{
+    return static_cast<uint32_t>(key >> DRAW_KEY_VERTEX_BUFFER_SHIFT) & ((1u << DRAW_KEY_VERTEX_BUFFER_BITS) - 1);
+}
+
+// Sorts by key. Equal keys keep the object and sub-mesh order, so the recorded commands don't change between frames.
+inline void sortDrawItems(std::vector<DrawItem> & items)
+{
+    std::sort(items.begin(), items.end(), [](const DrawItem & a, const DrawItem & b)
+    {
+        if(a.key != b.key)
+        {
+            return a.key < b.key;
+        }
+        return a.object != b.object ? a.object < b.object : a.subMesh < b.subMesh;
+    });
+}
+
+// The state bound for a draw
+enum class DrawState
+{
+    Pipeline,
+    Material,
+    VertexBuffer,
+    // The dynamic offset of the object uniforms
+    Object
+};
+
+const size_t DRAW_STATE_COUNT {4};
+
+// Binds and draws recorded into command buffers
+struct DrawStateChanges
+{
+    std::array<uint64_t, DRAW_STATE_COUNT> binds {};
+    // Binds left out because the state was already bound
+    uint64_t redundantBinds {0};
+    uint64_t draws {0};
+
+    uint64_t bindCount(DrawState state) const
+    {
+        return binds[static_cast<size_t>(state)];
+    }
+
+    DrawStateChanges & operator+=(const DrawStateChanges & other)
+    {
+        for(size_t i {0}; i < DRAW_STATE_COUNT; i++)
+        {
+            binds[i] += other.binds[i];
+        }
+        redundantBinds += other.redundantBinds;
+        draws += other.draws;
+        return *this;
+    }
+};
+
+// Remembers the state bound in one command buffer, to only bind what changes.
+// Secondary command buffers inherit no state, so each one needs its own tracker.
+class DrawStateTracker
+{
+public:
+    DrawStateTracker()
+    {
+        bound.fill(UNBOUND);
+    }
+
+    // Returns whether the value must be bound, which is when it differs from the bound one
+    bool bind(DrawState state, uint32_t value)
+    {
+        uint32_t & current {bound[static_cast<size_t>(state)]};
+        if(current == value)
+        {
+            changes.redundantBinds++;
+            return false;
+        }
+        current = value;
+        changes.binds[static_cast<size_t>(state)]++;
+        return true;
+    }
+
+    void countDraw()
+    {
+        changes.draws++;
+    }
+
+    const DrawStateChanges & stateChanges() const
+    {
+        return changes;
+    }
+
+private:
+    static constexpr uint32_t UNBOUND {UINT32_MAX};
+
+    std::array<uint32_t, DRAW_STATE_COUNT> bound;
+    DrawStateChanges changes;
+};
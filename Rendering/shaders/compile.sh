@@ -1,3 +1,6 @@
 echo "Compiling shaders..."
 glslc shader.vert -o vert.spv
-glslc shader.frag -o frag.spv
\ No newline at end of file
+glslc -DPACKED_VERTICES shader.vert -o vert_packed.spv
+glslc shader.frag -o frag.spv
+glslc -DBINDLESS shader.frag -o frag_bindless.spv
+glslc cull.comp -o cull.spv
\ No newline at end of file
@@ -1,17 +1,44 @@
 #version 450
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 textureCoord;
+layout(location = 2) in vec4 tint;
 
 // location is the frame buffer index.
 // out declares the variable as the one for output of the fragment shader.
 layout(location = 0) out vec4 outColor;
 
+// Per-material data, the set changes between the draws of different materials
+layout(set = 2, binding = 0) uniform MaterialUniformBufferObject
+{
+    vec4 diffuse;
+} material;
+
+#ifdef BINDLESS
+// Per-object data, the same block as in the vertex shader
+layout(set = 1, binding = 0) uniform ObjectUniformBufferObject
+{
+    mat4 model;
+    uint textureIndex;
+} object;
+
+// Every texture of the scene. The index is the same for the whole draw, so it needs no nonuniformEXT.
+layout(set = 3, binding = 0) uniform sampler2D textures[];
+#else
 layout(binding = 1) uniform sampler2D textureSampler;
+#endif
 
 void main()
 {
     //outColor = vec4(textureCoord, 0.0, 1.0); // render texture coordinates as color
-    outColor = texture(textureSampler, textureCoord); // render texture
+#ifdef BINDLESS
+    outColor = tint * material.diffuse * texture(textures[object.textureIndex], textureCoord);
+#else
+    outColor = tint * material.diffuse * texture(textureSampler, textureCoord); // render texture, tinted per instance and material
+#endif
     //outColor = vec4(fragColor * texture(textureSampler, textureCoord).rgb, 1.0); // render texture with color modified by fragColor
 }
\ No newline at end of file
@@ -1,25 +1,58 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject
+// Per-frame camera data
+layout(set = 0, binding = 0) uniform UniformBufferObject
 {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+// Per-object data, selected with a dynamic offset
+layout(set = 1, binding = 0) uniform ObjectUniformBufferObject
+{
+    mat4 model;
+    // Slot in the bindless texture array, read by the bindless fragment shader
+    uint textureIndex;
+} object;
+
+#ifdef PACKED_VERTICES
+// Quantized to 16 bit unsigned normalized values inside the mesh's bounds, see PackedVertex
+layout(location = 0) in vec4 inQuantizedPosition;
+layout(location = 2) in vec2 inQuantizedTextureCoord;
+
+layout(push_constant) uniform VertexDequantization
+{
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 textureCoordOffsetScale;
+    vec4 color;
+} dequantization;
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTextureCoord;
+#endif
+// Per-instance data, the transform takes locations 3 to 6
+layout(location = 3) in mat4 inInstanceTransform;
+layout(location = 7) in vec4 inInstanceTint;
 
 // Output variable for the vertex color
 layout(location = 0) out vec3 vertexColor;
 layout(location = 1) out vec2 outTextureCoord;
+layout(location = 2) out vec4 outTint;
 
 // Main function for the vexter shader.
 // It is called for each vertex.
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+#ifdef PACKED_VERTICES
+    // The unorm formats give values in [0, 1], scaled back to 65535 steps over the bounds
+    vec3 inPosition = dequantization.positionOffset.xyz + inQuantizedPosition.xyz * 65535.0 * dequantization.positionScale.xyz;
+    vec2 inTextureCoord = dequantization.textureCoordOffsetScale.xy + inQuantizedTextureCoord * 65535.0 * dequantization.textureCoordOffsetScale.zw;
+    vec3 inColor = dequantization.color.rgb;
+#endif
+    gl_Position = ubo.proj * ubo.view * inInstanceTransform * object.model * vec4(inPosition, 1.0);
     vertexColor = inColor;
     outTextureCoord = inTextureCoord;
+    outTint = inInstanceTint;
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <deque>
+#include <algorithm> // for std::max
+
+// Hands out regions of a persistently mapped staging buffer in ring order.
+// Regions are tagged with the upload batch that reads them, and are reused once that batch completed.
+class StagingRing
+{
+public:
+    void init(void * mapped, VkDeviceSize size)
+    {
+        this->mapped = static_cast<char *>(mapped);
+        ringSize = size;
+        regions.clear();
+        nextBatch = 1;
+    }
+
+    VkDeviceSize size() const
+    {
+        return ringSize;
+    }
+
+    void * pointer(VkDeviceSize offset) const
+    {
+        return mapped + offset;
+    }
+
+    // Largest region allocate() can currently return with the given alignment
+    VkDeviceSize largestFreeRegion(VkDeviceSize alignment) const
+    {
+        if(regions.empty())
+        {
+            return ringSize;
+        }
+
+        const Region & oldest {regions.front()};
+        const Region & newest {regions.back()};
+        VkDeviceSize afterNewest {alignUp(newest.end, alignment)};
+        if(newest.begin < oldest.begin)
+        {
+            // Wrapped: the free space is between the newest and the oldest region
+            return afterNewest < oldest.begin ? oldest.begin - afterNewest : 0;
+        }
+        VkDeviceSize atEnd {afterNewest < ringSize ? ringSize - afterNewest : 0};
+        return std::max(atEnd, oldest.begin);
+    }
+
+    // Returns false if there is no contiguous free region of size bytes right now
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize & offset)
+    {
+        if(size == 0 || size > ringSize)
+        {
+            return false;
+        }
+
+        if(regions.empty())
+        {
+            offset = 0;
+        }
+        else
+        {
+            const Region & oldest {regions.front()};
+            const Region & newest {regions.back()};
+            VkDeviceSize afterNewest {alignUp(newest.end, alignment)};
+            if(newest.begin < oldest.begin)
+            {
+                if(afterNewest + size > oldest.begin)
+                {
+                    return false;
+                }
+                offset = afterNewest;
+            }
+            else if(afterNewest + size <= ringSize)
+            {
+                offset = afterNewest;
+            }
+            // Wrap around, leaving the end of the ring unused
+            else if(size <= oldest.begin)
+            {
+                offset = 0;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        regions.push_back({offset, offset + size, OPEN_BATCH});
+        return true;
+    }
+
+    // Tags the regions allocated since the last call with a new batch, and returns it
+    uint64_t closeBatch()
+    {
+        uint64_t batch {nextBatch++};
+        for(std::deque<Region>::reverse_iterator region {regions.rbegin()}; region != regions.rend() && region->batch == OPEN_BATCH; region++)
+        {
+            region->batch = batch;
+        }
+        return batch;
+    }
+
+    // Frees the regions of the batch and of every batch before it
+    void releaseBatch(uint64_t batch)
+    {
+        while(!regions.empty() && regions.front().batch <= batch)
+        {
+            regions.pop_front();
+        }
+    }
+
+private:
+    // Regions which weren't submitted yet
+    static constexpr uint64_t OPEN_BATCH {UINT64_MAX};
+
+    struct Region
+    {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        uint64_t batch;
+    };
+
+    char * mapped {nullptr};
+    VkDeviceSize ringSize {0};
+    // In allocation order, so the oldest region is at the front
+    std::deque<Region> regions;
+    uint64_t nextBatch {1};
+
+    static VkDeviceSize alignUp(VkDeviceSize offset, VkDeviceSize alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+// Spans of startup work on the main thread and on worker threads, each with the spans it waited for.
+// The critical path runs back from the span which ended last, at each step through the dependency
+// which ended last. Shortening a span which isn't on it doesn't make startup any faster.
+// Spans can be begun and ended from any thread.
+class StartupTimeline
+{
+public:
+    StartupTimeline() :
+        origin {std::chrono::high_resolution_clock::now()}
+    {
+    }
+
+    // Returns the id of the new span, to end it and to depend on it
+    size_t begin(const std::string & name, const std::string & lane, const std::vector<size_t> & dependencies = {})
+    {
+        double start {now()};
+        std::lock_guard<std::mutex> lock {mutex};
+        spans.push_back({name, lane, dependencies, start, start, false});
+        return spans.size() - 1;
+    }
+
+    void end(size_t span)
+    {
+        double finish {now()};
+        std::lock_guard<std::mutex> lock {mutex};
+        spans[span].end = finish;
+        spans[span].finished = true;
+    }
+
+    // For each span, whether it is on the critical path. Only finished spans count.
+    std::vector<bool> criticalPath() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        std::vector<bool> critical(spans.size(), false);
+        size_t current {spans.size()};
+        for(size_t span {0}; span < spans.size(); span++)
+        {
+            if(spans[span].finished && (current == spans.size() || spans[span].end > spans[current].end))
+            {
+                current = span;
+            }
+        }
+        while(current < spans.size())
+        {
+            critical[current] = true;
+            size_t next {spans.size()};
+            for(size_t dependency : spans[current].dependencies)
+            {
+                if(spans[dependency].finished && (next == spans.size() || spans[dependency].end > spans[next].end))
+                {
+                    next = dependency;
+                }
+            }
+            current = next;
+        }
+        return critical;
+    }
+
+    // Milliseconds from the creation of the timeline to the end of the last span
+    double totalMilliseconds() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        double total {0.0};
+        for(const Span & span : spans)
+        {
+            total = std::max(total, span.end);
+        }
+        return total;
+    }
+
+    // One line per span in start order, with the critical ones marked by a *
+    void print(std::ostream & out) const
+    {
+        std::vector<bool> critical {criticalPath()};
+        std::lock_guard<std::mutex> lock {mutex};
+        out << "startup timeline (ms, * on the critical path):" << std::endl;
+        for(size_t span {0}; span < spans.size(); span++)
+        {
+            out << (critical[span] ? " * " : "   ")
+                << std::fixed << std::setprecision(1)
+                << std::setw(8) << spans[span].start << " " << std::setw(8) << spans[span].end << " "
+                << std::setw(8) << spans[span].end - spans[span].start << "  "
+                << "[" << spans[span].lane << "] " << spans[span].name << std::endl;
+        }
+        out << std::defaultfloat << std::setprecision(6);
+    }
+
+    // Writes the spans as a JSON object whose fields start at the given indent
+    void writeJson(std::ostream & out, const std::string & indent) const
+    {
+        std::vector<bool> critical {criticalPath()};
+        double total {totalMilliseconds()};
+        std::lock_guard<std::mutex> lock {mutex};
+        out << "{\n";
+        out << indent << "  \"total_ms\": " << total << ",\n";
+        out << indent << "  \"spans\": [\n";
+        for(size_t span {0}; span < spans.size(); span++)
+        {
+            out << indent << "    {\"name\": \"" << spans[span].name << "\", \"lane\": \"" << spans[span].lane << "\""
+                << ", \"start_ms\": " << spans[span].start << ", \"end_ms\": " << spans[span].end
+                << ", \"critical\": " << (critical[span] ? "true" : "false") << "}"
+                << (span + 1 < spans.size() ? "," : "") << "\n";
+        }
+        out << indent << "  ]\n";
+        out << indent << "}";
+    }
+
+private:
+    struct Span
+    {
+        std::string name;
+        std::string lane;
+        std::vector<size_t> dependencies;
+        // Milliseconds since the creation of the timeline
+        double start;
+        double end;
+        bool finished;
+    };
+
+    std::chrono::high_resolution_clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Span> spans;
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - origin).count();
+    }
+};
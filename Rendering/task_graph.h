@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include "thread_pool.h"
+#include "startup_timeline.h"
+#include "log.h"
+
+// Tasks with explicit dependencies, each started as soon as all of its dependencies have finished.
+// Tasks run on the thread pool, except those added with mainThread set, which run on the thread calling run().
+// Those are the tasks which must stay on the main thread, like GLFW window calls, and the tasks which use
+// the thread pool themselves, since a pool task must not wait for other pool tasks.
+class TaskGraph
+{
+public:
+    // Returns the id of the task, to depend on it. Dependencies must have been added before, so there are no cycles.
+    size_t add(const std::string & name, std::function<void()> task, const std::vector<size_t> & dependencies = {}, bool mainThread = false)
+    {
+        size_t node {nodes.size()};
+        for(size_t dependency : dependencies)
+        {
+            if(dependency >= node)
+            {
+                throw std::invalid_argument("Task dependencies must be added before the task.");
+            }
+        }
+        nodes.push_back({name, std::move(task), dependencies, {}, mainThread});
+        for(size_t dependency : dependencies)
+        {
+            nodes[dependency].dependents.push_back(node);
+        }
+        return node;
+    }
+
+    // Runs every task, logging each one when it starts and timing it on the timeline, with its dependencies.
+    // If a task throws, no more tasks start, and the exception is rethrown once the running ones have finished.
+    void run(ThreadPool & threadPool, StartupTimeline & timeline)
+    {
+        std::vector<size_t> remainingDependencies(nodes.size());
+        std::vector<size_t> spans(nodes.size(), SIZE_MAX);
+        std::vector<size_t> mainThreadReady;
+        std::vector<size_t> finished;
+        std::exception_ptr exception;
+        size_t poolTasksRunning {0};
+        size_t finishedCount {0};
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        // Each span is written by the thread running its task, before the task is reported as finished
+        auto execute = [&](size_t node, const char * lane, const std::vector<size_t> & dependencySpans)
+        {
+            logLine(nodes[node].name);
+            size_t span {timeline.begin(nodes[node].name, lane, dependencySpans)};
+            try
+            {
+                nodes[node].task();
+            }
+            catch(...)
+            {
+                timeline.end(span);
+                throw;
+            }
+            timeline.end(span);
+            spans[node] = span;
+        };
+
+        auto dependencySpansOf = [&](size_t node)
+        {
+            std::vector<size_t> dependencySpans;
+            for(size_t dependency : nodes[node].dependencies)
+            {
+                dependencySpans.push_back(spans[dependency]);
+            }
+            return dependencySpans;
+        };
+
+        // Called with the mutex locked
+        auto start = [&](size_t node)
+        {
+            if(nodes[node].mainThread)
+            {
+                mainThreadReady.push_back(node);
+                return;
+            }
+            poolTasksRunning++;
+            threadPool.submit([&, node, dependencySpans = dependencySpansOf(node)]()
+            {
+                std::exception_ptr taskException;
+                try
+                {
+                    execute(node, "pool", dependencySpans);
+                }
+                catch(...)
+                {
+                    taskException = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock {mutex};
+                if(taskException)
+                {
+                    if(!exception)
+                    {
+                        exception = taskException;
+                    }
+                }
+                else
+                {
+                    finished.push_back(node);
+                }
+                poolTasksRunning--;
+                condition.notify_one();
+            });
+        };
+
+        std::unique_lock<std::mutex> lock {mutex};
+        for(size_t node {0}; node < nodes.size(); node++)
+        {
+            remainingDependencies[node] = nodes[node].dependencies.size();
+            if(remainingDependencies[node] == 0)
+            {
+                start(node);
+            }
+        }
+
+        while(true)
+        {
+            if(exception)
+            {
+                // The pool tasks reference this stack frame
+                if(poolTasksRunning == 0)
+                {
+                    break;
+                }
+                condition.wait(lock);
+                continue;
+            }
+
+            // The dependents of finished tasks may be ready now
+            while(!finished.empty())
+            {
+                size_t node {finished.back()};
+                finished.pop_back();
+                finishedCount++;
+                for(size_t dependent : nodes[node].dependents)
+                {
+                    if(--remainingDependencies[dependent] == 0)
+                    {
+                        start(dependent);
+                    }
+                }
+            }
+            if(finishedCount == nodes.size())
+            {
+                break;
+            }
+
+            if(!mainThreadReady.empty())
+            {
+                size_t node {mainThreadReady.front()};
+                mainThreadReady.erase(mainThreadReady.begin());
+                std::vector<size_t> dependencySpans {dependencySpansOf(node)};
+                lock.unlock();
+                std::exception_ptr taskException;
+                try
+                {
+                    execute(node, "main", dependencySpans);
+                }
+                catch(...)
+                {
+                    taskException = std::current_exception();
+                }
+                lock.lock();
+                if(taskException)
+                {
+                    if(!exception)
+                    {
+                        exception = taskException;
+                    }
+                }
+                else
+                {
+                    finished.push_back(node);
+                }
+                continue;
+            }
+
+            condition.wait(lock);
+        }
+        lock.unlock();
+
+        if(exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+private:
+    struct Node
+    {
+        std::string name;
+        std::function<void()> task;
+        std::vector<size_t> dependencies;
+        std::vector<size_t> dependents;
+        bool mainThread;
+    };
+
+    std::vector<Node> nodes;
+};
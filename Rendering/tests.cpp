@@ -0,0 +1,629 @@
+// Tests of the CPU-only modules, which need no GPU or window. Run with make test.
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef> // for offsetof
+#include <cstring> // for memcpy
+#include <vector>
+#include <string>
+#include <utility> // for std::pair
+#include <algorithm> // for std::sort
+#include <random>
+#include <array>
+#include <stdexcept>
+#include <limits>
+#include <cmath> // for std::abs
+#include <fstream>
+#include <cstdio> // for std::remove
+#include "hash.h"
+#include "vertex_dedup.h"
+#include "staging_ring.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
+#include "texture_container.h"
+
+int failureCount {0};
+
+void check(bool condition, const char * expression, const char * file, int line)
+{
+    if(!condition)
+    {
+        std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+        failureCount++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+struct TestVertex
+{
+    float x;
+    float y;
+
+    bool operator==(const TestVertex & other) const
+    {
+        return x == other.x && y == other.y;
+    }
+};
+
+struct TestVertexHash
+{
+    uint64_t operator()(const TestVertex & vertex) const
+    {
+        return hashBytes(&vertex, sizeof(vertex));
+    }
+};
+
+// Every hash is equal, so every lookup has to probe past the other vertices
+struct CollidingHash
+{
+    uint64_t operator()(const TestVertex &) const
+    {
+        return 0;
+    }
+};
+
+template<typename Hash>
+void checkDeduplication(size_t expectedVertexCount)
+{
+    std::vector<TestVertex> vertices;
+    VertexDeduplicator<TestVertex, Hash> deduplicator {vertices, expectedVertexCount};
+    // 100 unique vertices, each inserted three times in different orders
+    for(uint32_t pass {0}; pass < 3; pass++)
+    {
+        for(uint32_t i {0}; i < 100; i++)
+        {
+            uint32_t vertex {pass == 1 ? 99 - i : i};
+            uint32_t index {deduplicator.insert({static_cast<float>(vertex), 0.5f})};
+            CHECK(index == (pass == 1 ? 99 - i : i));
+        }
+    }
+    CHECK(vertices.size() == 100);
+    for(uint32_t i {0}; i < vertices.size(); i++)
+    {
+        CHECK(vertices[i].x == static_cast<float>(i));
+    }
+}
+
+void testVertexDeduplication()
+{
+    checkDeduplication<TestVertexHash>(300);
+    // The table grows past its expected size
+    checkDeduplication<TestVertexHash>(1);
+    checkDeduplication<CollidingHash>(1);
+}
+
+void testStagingRing()
+{
+    std::vector<char> memory(100);
+    StagingRing ring;
+    ring.init(memory.data(), memory.size());
+    VkDeviceSize offset {0};
+
+    CHECK(!ring.allocate(0, 1, offset));
+    CHECK(!ring.allocate(101, 1, offset));
+    CHECK(ring.largestFreeRegion(1) == 100);
+
+    CHECK(ring.allocate(40, 1, offset) && offset == 0);
+    uint64_t first {ring.closeBatch()};
+    CHECK(ring.allocate(40, 1, offset) && offset == 40);
+    uint64_t second {ring.closeBatch()};
+    // Neither the end of the ring nor its start is free while the first batch is in flight
+    CHECK(ring.largestFreeRegion(1) == 20);
+    CHECK(!ring.allocate(30, 1, offset));
+
+    // Wraps around once the first batch is released, leaving the end of the ring unused
+    ring.releaseBatch(first);
+    CHECK(ring.largestFreeRegion(1) == 40);
+    CHECK(ring.allocate(30, 1, offset) && offset == 0);
+    // Wrapped regions stop at the oldest region
+    CHECK(!ring.allocate(20, 1, offset));
+    CHECK(ring.allocate(5, 16, offset) && offset == 32);
+    CHECK(ring.largestFreeRegion(1) == 3);
+    CHECK(ring.pointer(offset) == memory.data() + 32);
+    uint64_t third {ring.closeBatch()};
+    CHECK(third > second);
+
+    // Releasing a batch releases the batches before it too
+    ring.releaseBatch(third);
+    CHECK(ring.largestFreeRegion(1) == 100);
+    CHECK(ring.allocate(100, 1, offset) && offset == 0);
+}
+
+// Two triangles per cell of a size by size grid, with (size + 1) * (size + 1) vertices in rows
+std::vector<uint32_t> gridIndices(uint32_t size)
+{
+    std::vector<uint32_t> indices;
+    for(uint32_t y {0}; y < size; y++)
+    {
+        for(uint32_t x {0}; x < size; x++)
+        {
+            uint32_t corner {y*(size + 1) + x};
+            indices.insert(indices.end(), {corner, corner + 1, corner + size + 1});
+            indices.insert(indices.end(), {corner + 1, corner + size + 2, corner + size + 1});
+        }
+    }
+    return indices;
+}
+
+std::vector<std::array<uint32_t, 3>> sortedTriangles(const std::vector<uint32_t> & indices)
+{
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for(size_t i {0}; i < indices.size(); i += 3)
+    {
+        triangles.push_back({indices[i], indices[i + 1], indices[i + 2]});
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+void testVertexCacheOptimizer()
+{
+    const uint32_t size {64};
+    const size_t vertexCount {(size + 1)*(size + 1)};
+    std::vector<uint32_t> indices {gridIndices(size)};
+
+    // Shuffle the triangles, so the original order has almost no locality
+    std::vector<std::array<uint32_t, 3>> triangles {sortedTriangles(indices)};
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937 {1});
+    for(size_t triangle {0}; triangle < triangles.size(); triangle++)
+    {
+        std::copy(triangles[triangle].begin(), triangles[triangle].end(), indices.begin() + 3*triangle);
+    }
+
+    for(const std::vector<uint32_t> & original : {gridIndices(size), indices})
+    {
+        std::vector<uint32_t> optimized {original};
+        VertexCacheOptimizer::optimize(optimized.data(), optimized.size(), vertexCount);
+        // Only the order of the triangles changes
+        CHECK(sortedTriangles(optimized) == sortedTriangles(original));
+
+        VertexCacheStatistics before {analyzeVertexCache(original.data(), original.size(), vertexCount)};
+        VertexCacheStatistics after {analyzeVertexCache(optimized.data(), optimized.size(), vertexCount)};
+        CHECK(after.acmr <= before.acmr);
+        CHECK(after.acmr < 0.8);
+        CHECK(after.atvr >= 1.0);
+    }
+
+    bool threw {false};
+    try
+    {
+        VertexCacheOptimizer::optimize(indices.data(), 4, vertexCount);
+    }
+    catch(const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+// The sub-meshes cover the indices in order, and each 16 bit index plus its vertex offset is the original index
+void checkShortIndices(const std::vector<uint32_t> & indices, const std::vector<SubMesh> & subMeshes, const std::vector<uint16_t> & shortIndices)
+{
+    CHECK(shortIndices.size() == indices.size());
+    size_t next {0};
+    for(const SubMesh & subMesh : subMeshes)
+    {
+        CHECK(subMesh.firstIndex == next);
+        CHECK(subMesh.indexCount > 0 && subMesh.indexCount % 3 == 0);
+        CHECK(subMesh.vertexOffset >= 0);
+        for(size_t i {subMesh.firstIndex}; i < subMesh.firstIndex + subMesh.indexCount && i < indices.size(); i++)
+        {
+            CHECK(shortIndices[i] + static_cast<uint32_t>(subMesh.vertexOffset) == indices[i]);
+        }
+        next = subMesh.firstIndex + subMesh.indexCount;
+    }
+    CHECK(next == indices.size());
+}
+
+void testShortIndexSplit()
+{
+    std::vector<SubMesh> subMeshes;
+    std::vector<uint16_t> shortIndices;
+
+    // Few enough vertices for a single sub-mesh
+    std::vector<uint32_t> indices {gridIndices(100)};
+    CHECK(splitForShortIndices(indices.data(), indices.size(), subMeshes, shortIndices));
+    CHECK(subMeshes.size() == 1 && subMeshes[0].vertexOffset == 0);
+    checkShortIndices(indices, subMeshes, shortIndices);
+
+    // 90601 vertices, used in order
+    indices = gridIndices(300);
+    CHECK(splitForShortIndices(indices.data(), indices.size(), subMeshes, shortIndices));
+    CHECK(subMeshes.size() == 2);
+    checkShortIndices(indices, subMeshes, shortIndices);
+
+    // A triangle as far apart as 16 bit indices allow
+    indices = {0, 1, SHORT_INDEX_VERTEX_COUNT - 1, 2, 3, SHORT_INDEX_VERTEX_COUNT};
+    CHECK(splitForShortIndices(indices.data(), indices.size(), subMeshes, shortIndices));
+    CHECK(subMeshes.size() == 2);
+    checkShortIndices(indices, subMeshes, shortIndices);
+
+    // A triangle too far apart splits nothing
+    indices.insert(indices.end(), {0, 1, SHORT_INDEX_VERTEX_COUNT});
+    CHECK(!splitForShortIndices(indices.data(), indices.size(), subMeshes, shortIndices));
+    CHECK(subMeshes.empty() && shortIndices.empty());
+}
+
+// Positions of the vertices of gridIndices, in the z = 0 plane with one unit per cell
+std::vector<std::array<float, 3>> gridPositions(uint32_t size)
+{
+    std::vector<std::array<float, 3>> positions;
+    for(uint32_t y {0}; y <= size; y++)
+    {
+        for(uint32_t x {0}; x <= size; x++)
+        {
+            positions.push_back({static_cast<float>(x), static_cast<float>(y), 0.0f});
+        }
+    }
+    return positions;
+}
+
+void testMeshSimplifier()
+{
+    // A flat open grid, whose border vertices are locked
+    const uint32_t size {32};
+    const size_t vertexCount {(size + 1)*(size + 1)};
+    std::vector<std::array<float, 3>> positions {gridPositions(size)};
+    std::vector<uint32_t> indices {gridIndices(size)};
+
+    float error {-1.0f};
+    std::vector<uint32_t> unchanged {simplifyMesh(positions[0].data(), sizeof(positions[0]), vertexCount, indices.data(), indices.size(), indices.size(), error)};
+    CHECK(unchanged == indices);
+    CHECK(error == 0.0f);
+
+    const size_t targetIndexCount {indices.size() / 4};
+    std::vector<uint32_t> simplified {simplifyMesh(positions[0].data(), sizeof(positions[0]), vertexCount, indices.data(), indices.size(), targetIndexCount, error)};
+    CHECK(simplified.size() % 3 == 0);
+    CHECK(simplified.size() <= targetIndexCount);
+    // Each collapse removes at most two triangles of the grid
+    CHECK(simplified.size() + 6 > targetIndexCount);
+    // Collapses within a plane cost nothing
+    CHECK(error < 1e-3f);
+
+    std::vector<bool> used(vertexCount, false);
+    double area {0.0};
+    for(size_t i {0}; i < simplified.size(); i += 3)
+    {
+        uint32_t a {simplified[i]};
+        uint32_t b {simplified[i + 1]};
+        uint32_t c {simplified[i + 2]};
+        CHECK(a < vertexCount && b < vertexCount && c < vertexCount);
+        if(a >= vertexCount || b >= vertexCount || c >= vertexCount)
+        {
+            return;
+        }
+        CHECK(a != b && b != c && c != a);
+        used[a] = true;
+        used[b] = true;
+        used[c] = true;
+        // Twice the signed area, which no flipped triangle reduces
+        area += (positions[b][0] - positions[a][0])*(positions[c][1] - positions[a][1]) -
+            (positions[b][1] - positions[a][1])*(positions[c][0] - positions[a][0]);
+    }
+    CHECK(std::abs(area - 2.0*size*size) < 1e-6);
+
+    // The outline is intact
+    for(uint32_t y {0}; y <= size; y++)
+    {
+        for(uint32_t x {0}; x <= size; x++)
+        {
+            if(x == 0 || y == 0 || x == size || y == size)
+            {
+                CHECK(used[y*(size + 1) + x]);
+            }
+        }
+    }
+}
+
+// The meshlets cover the range in order, within the size limits, and bound their vertices
+void checkMeshlets(
+    const std::vector<std::array<float, 3>> & positions,
+    const std::vector<uint32_t> & indices,
+    uint32_t firstIndex,
+    uint32_t indexCount,
+    const std::vector<Meshlet> & meshlets
+)
+{
+    uint32_t next {firstIndex};
+    for(const Meshlet & meshlet : meshlets)
+    {
+        CHECK(meshlet.firstIndex == next);
+        CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+        CHECK(meshlet.indexCount / 3 <= MESHLET_MAX_TRIANGLES);
+        CHECK(meshlet.vertexOffset == 7);
+
+        std::vector<uint32_t> vertices(indices.begin() + meshlet.firstIndex, indices.begin() + meshlet.firstIndex + meshlet.indexCount);
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+        CHECK(vertices.size() <= MESHLET_MAX_VERTICES);
+        for(uint32_t vertex : vertices)
+        {
+            float dx {positions[vertex][0] - meshlet.center[0]};
+            float dy {positions[vertex][1] - meshlet.center[1]};
+            float dz {positions[vertex][2] - meshlet.center[2]};
+            CHECK(std::sqrt(dx*dx + dy*dy + dz*dz) <= meshlet.radius + 1e-4f);
+        }
+        next = meshlet.firstIndex + meshlet.indexCount;
+    }
+    CHECK(next == firstIndex + indexCount);
+}
+
+void testMeshlets()
+{
+    const uint32_t size {32};
+    std::vector<std::array<float, 3>> positions {gridPositions(size)};
+    std::vector<uint32_t> indices {gridIndices(size)};
+    VertexCacheOptimizer::optimize(indices.data(), indices.size(), positions.size());
+
+    // Limited by the vertex count. Starts after the first triangle to check the range is respected.
+    std::vector<Meshlet> meshlets;
+    const uint32_t indexCount {static_cast<uint32_t>(indices.size()) - 3};
+    buildMeshlets(positions[0].data(), sizeof(positions[0]), positions.size(), indices.data(), 3, indexCount, 7, meshlets);
+    CHECK(meshlets.size() > 1);
+    checkMeshlets(positions, indices, 3, indexCount, meshlets);
+
+    // The grid faces +z, so every meshlet is backfacing from far below and front facing from far above
+    for(const Meshlet & meshlet : meshlets)
+    {
+        CHECK(meshlet.coneCutoff < 1e-3f);
+        CHECK(isMeshletBackfacing(meshlet.center, meshlet.radius, meshlet.coneAxis, meshlet.coneCutoff, {16.0f, 16.0f, -100.0f}));
+        CHECK(!isMeshletBackfacing(meshlet.center, meshlet.radius, meshlet.coneAxis, meshlet.coneCutoff, {16.0f, 16.0f, 100.0f}));
+    }
+
+    // Limited by the triangle count: one quad repeated, so its 4 vertices never fill a meshlet
+    const std::vector<uint32_t> quad {gridIndices(size)};
+    std::vector<uint32_t> quads;
+    for(uint32_t i {0}; i < 300; i++)
+    {
+        quads.insert(quads.end(), quad.begin(), quad.begin() + 6);
+    }
+    meshlets.clear();
+    buildMeshlets(positions[0].data(), sizeof(positions[0]), positions.size(), quads.data(), 0, static_cast<uint32_t>(quads.size()), 7, meshlets);
+    CHECK(meshlets.size() == (600 + MESHLET_MAX_TRIANGLES - 1) / MESHLET_MAX_TRIANGLES);
+    checkMeshlets(positions, quads, 0, static_cast<uint32_t>(quads.size()), meshlets);
+}
+
+// A smooth gradient with varying alpha, whose size isn't a multiple of the block size
+std::vector<uint8_t> gradientImage(uint32_t width, uint32_t height)
+{
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    for(uint32_t y {0}; y < height; y++)
+    {
+        for(uint32_t x {0}; x < width; x++)
+        {
+            uint8_t * texel {rgba.data() + (static_cast<size_t>(y) * width + x) * 4};
+            texel[0] = static_cast<uint8_t>(x * 255 / width);
+            texel[1] = static_cast<uint8_t>(y * 255 / height);
+            texel[2] = static_cast<uint8_t>((x + y) * 127 / (width + height));
+            texel[3] = static_cast<uint8_t>(255 - y * 255 / height);
+        }
+    }
+    return rgba;
+}
+
+void testTextureCompression()
+{
+    ThreadPool threadPool {2};
+    const uint32_t width {30};
+    const uint32_t height {30};
+    const size_t texelCount {static_cast<size_t>(width) * height};
+    std::vector<uint8_t> rgba {gradientImage(width, height)};
+
+    // Largest alpha error of each encoding. BC1 is opaque, so its alpha is compared to 255.
+    const std::vector<std::pair<TextureEncoding, int>> encodings {
+        {TextureEncoding::RGBA8, 0},
+        {TextureEncoding::BC1, 0},
+        {TextureEncoding::BC3, 4},
+        {TextureEncoding::BC7, 8}
+    };
+    for(const auto & [encoding, alphaTolerance] : encodings)
+    {
+        std::vector<uint8_t> encoded {compressImage(rgba.data(), width, height, encoding, threadPool)};
+        CHECK(encoded.size() == encodedImageSize(encoding, width, height));
+        std::vector<uint8_t> decoded {decompressImage(encoded.data(), width, height, encoding, threadPool)};
+        CHECK(decoded.size() == rgba.size());
+        if(decoded.size() != rgba.size())
+        {
+            continue;
+        }
+
+        double psnr {rgbPsnr(rgba.data(), decoded.data(), texelCount)};
+        CHECK(encoding == TextureEncoding::RGBA8 ? psnr == std::numeric_limits<double>::infinity() : psnr > 30.0);
+        int alphaError {0};
+        for(size_t i {0}; i < texelCount; i++)
+        {
+            int expected {encoding == TextureEncoding::BC1 ? 255 : rgba[4 * i + 3]};
+            alphaError = std::max(alphaError, std::abs(decoded[4 * i + 3] - expected));
+        }
+        CHECK(alphaError <= alphaTolerance);
+    }
+}
+
+std::vector<char> readFileBytes(const std::string & path)
+{
+    std::ifstream file {path, std::ios::binary};
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFileBytes(const std::string & path, const std::vector<char> & bytes)
+{
+    std::ofstream file {path, std::ios::binary | std::ios::trunc};
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+void testTextureContainer()
+{
+    ThreadPool threadPool {2};
+    const std::string path {"tests_texture.vktex"};
+    const uint64_t sourceHash {0x1234};
+    const uint32_t width {30};
+    const uint32_t height {30};
+    std::vector<uint8_t> rgba {gradientImage(width, height)};
+    std::vector<std::vector<uint8_t>> levelData;
+    for(const MipLevel & level : generateMipChain(rgba.data(), width, height, threadPool))
+    {
+        levelData.push_back(compressImage(level.texels.data(), level.width, level.height, TextureEncoding::BC7, threadPool));
+    }
+    CHECK(writeTextureContainer(path, sourceHash, TextureEncoding::BC7, width, height, levelData));
+
+    MappedFile file;
+    TextureContainerView view;
+    CHECK(file.open(path));
+    CHECK(readTextureContainer(file, sourceHash, view));
+    CHECK(view.encoding == TextureEncoding::BC7 && view.width == width && view.height == height);
+    CHECK(view.levelCount == levelData.size());
+    for(uint32_t level {0}; level < view.levelCount && level < levelData.size(); level++)
+    {
+        CHECK(view.levels[level].size == levelData[level].size());
+        CHECK(std::equal(levelData[level].begin(), levelData[level].end(), view.levelData(level)));
+    }
+    CHECK(!readTextureContainer(file, sourceHash + 1, view));
+    file.close();
+
+    const std::vector<char> bytes {readFileBytes(path)};
+    auto rejects = [&](const std::vector<char> & corrupted)
+    {
+        writeFileBytes(path, corrupted);
+        MappedFile corruptedFile;
+        TextureContainerView corruptedView;
+        return !corruptedFile.open(path) || !readTextureContainer(corruptedFile, sourceHash, corruptedView);
+    };
+    // Truncated in the header, in the level table and in the last level
+    for(size_t size : {sizeof(TextureContainerHeader) - 1, sizeof(TextureContainerHeader) + 4, bytes.size() - 1})
+    {
+        CHECK(rejects(std::vector<char>(bytes.begin(), bytes.begin() + size)));
+    }
+    std::vector<char> corrupted {bytes};
+    corrupted[0] = 'X';
+    CHECK(rejects(corrupted));
+    // The first level's size
+    corrupted = bytes;
+    corrupted[sizeof(TextureContainerHeader) + offsetof(TextureContainerLevel, size)]++;
+    CHECK(rejects(corrupted));
+    // More levels than the mip chain
+    corrupted = bytes;
+    uint32_t levelCount {mipLevelCount(width, height) + 1};
+    memcpy(corrupted.data() + offsetof(TextureContainerHeader, levelCount), &levelCount, sizeof(levelCount));
+    CHECK(rejects(corrupted));
+    CHECK(!rejects(bytes));
+
+    std::remove(path.c_str());
+}
+
+void testMeshCache()
+{
+    const std::string path {"tests_mesh.vkmesh"};
+    const uint64_t sourceHash {0x5678};
+    // Two levels of detail of a quad, with one triangle of each material in the finest
+    const std::vector<std::array<float, 3>> vertices {{0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
+    const uint32_t vertexSize {sizeof(vertices[0])};
+    const std::vector<uint32_t> indices {0, 1, 2, 0, 2, 3, 0, 1, 2};
+    const std::vector<MeshCacheLod> lods {{0, 6, 0.0f, 0}, {6, 3, 0.5f, 0}};
+    const std::vector<MeshCacheMaterial> materials {{{1.0f, 0.0f, 0.0f}, 0}, {{0.0f, 1.0f, 0.0f}, 0}};
+    const std::vector<MeshCacheMaterialRange> ranges {{0, 3}, {3, 3}, {6, 3}, {9, 0}};
+    auto write = [&](uint32_t vertexCount, uint32_t indexCount, const MeshCacheLod * lodData, const MeshCacheMaterialRange * rangeData)
+    {
+        return writeMeshCache(
+            path, sourceHash,
+            vertices.data(), vertexSize, vertexCount,
+            indices.data(), indexCount,
+            lodData, static_cast<uint32_t>(lods.size()),
+            materials.data(), static_cast<uint32_t>(materials.size()),
+            rangeData
+        );
+    };
+    auto reads = [&](uint64_t hash, uint32_t size)
+    {
+        MappedFile file;
+        MeshCacheView view;
+        return file.open(path) && readMeshCache(file, hash, size, view);
+    };
+
+    CHECK(write(static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()), lods.data(), ranges.data()));
+    {
+        MappedFile file;
+        MeshCacheView view;
+        CHECK(file.open(path));
+        CHECK(readMeshCache(file, sourceHash, vertexSize, view));
+        CHECK(view.vertexCount == vertices.size() && view.indexCount == indices.size());
+        CHECK(view.lodCount == lods.size() && view.materialCount == materials.size());
+        CHECK(memcmp(view.vertexData, vertices.data(), vertices.size() * vertexSize) == 0);
+        CHECK(std::equal(indices.begin(), indices.end(), view.indexData));
+        CHECK(view.lodData[1].firstIndex == 6 && view.lodData[1].error == 0.5f);
+        CHECK(view.materialData[1].diffuse[1] == 1.0f);
+        CHECK(view.materialRangeData[3].firstIndex == 9);
+    }
+    CHECK(!reads(sourceHash + 1, vertexSize));
+    CHECK(!reads(sourceHash, vertexSize + 4));
+
+    const std::vector<char> bytes {readFileBytes(path)};
+    auto rejects = [&](const std::vector<char> & corrupted)
+    {
+        writeFileBytes(path, corrupted);
+        return !reads(sourceHash, vertexSize);
+    };
+    // Truncated in the header and in the material ranges
+    for(size_t size : {sizeof(MeshCacheHeader) - 1, bytes.size() - 1})
+    {
+        CHECK(rejects(std::vector<char>(bytes.begin(), bytes.begin() + size)));
+    }
+    // Too long
+    std::vector<char> corrupted {bytes};
+    corrupted.push_back(0);
+    CHECK(rejects(corrupted));
+    corrupted = bytes;
+    corrupted[0] = 'X';
+    CHECK(rejects(corrupted));
+    // An index past the last vertex
+    corrupted = bytes;
+    uint32_t index {static_cast<uint32_t>(vertices.size())};
+    memcpy(corrupted.data() + meshCacheIndexOffset(vertexSize, static_cast<uint32_t>(vertices.size())) + 5 * sizeof(uint32_t), &index, sizeof(index));
+    CHECK(rejects(corrupted));
+    CHECK(!rejects(bytes));
+
+    // A gap between the material ranges of a level
+    std::vector<MeshCacheMaterialRange> gapRanges {ranges};
+    gapRanges[1].firstIndex = 4;
+    gapRanges[1].indexCount = 2;
+    CHECK(write(static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()), lods.data(), gapRanges.data()));
+    CHECK(!reads(sourceHash, vertexSize));
+    // A level past the end of the indices
+    std::vector<MeshCacheLod> longLods {lods};
+    longLods[1].indexCount = 6;
+    std::vector<MeshCacheMaterialRange> longRanges {ranges};
+    longRanges[2].indexCount = 6;
+    longRanges[3].firstIndex = 12;
+    CHECK(write(static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()), longLods.data(), longRanges.data()));
+    CHECK(!reads(sourceHash, vertexSize));
+    // No vertices and no indices, with empty levels
+    const std::vector<MeshCacheLod> emptyLods {{0, 0, 0.0f, 0}, {0, 0, 0.0f, 0}};
+    const std::vector<MeshCacheMaterialRange> emptyRanges(4, {0, 0});
+    CHECK(write(0, 0, emptyLods.data(), emptyRanges.data()));
+    CHECK(!reads(sourceHash, vertexSize));
+
+    std::remove(path.c_str());
+}
+
+int main()
+{
+    const std::vector<std::pair<std::string, void (*)()>> tests {
+        {"vertex deduplication", testVertexDeduplication},
+        {"staging ring", testStagingRing},
+        {"vertex cache optimizer", testVertexCacheOptimizer},
+        {"16 bit index split", testShortIndexSplit},
+        {"mesh simplifier", testMeshSimplifier},
+        {"meshlets", testMeshlets},
+        {"texture compression", testTextureCompression},
+        {"texture container", testTextureContainer},
+        {"mesh cache", testMeshCache}
+    };
+    for(const auto & [name, test] : tests)
+    {
+        int failuresBefore {failureCount};
+        test();
+        std::cout << (failureCount == failuresBefore ? "passed: " : "FAILED: ") << name << std::endl;
+    }
+    return failureCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
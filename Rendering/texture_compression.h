@@ -0,0 +1,825 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "thread_pool.h"
+
+// Block compression of RGBA8 images into BC1, BC3 and BC7, and decompression back to RGBA8.
+// Every format stores 4x4 texel blocks. The blocks on the right and bottom edges of an image whose size
+// isn't a multiple of 4 repeat the edge texels.
+enum class TextureEncoding : uint32_t
+{
+    RGBA8 = 0,
+    // RGB in 8 bytes per block, opaque
+    BC1 = 1,
+    // BC1 colors plus interpolated alpha, 16 bytes per block
+    BC3 = 2,
+    // RGBA in 16 bytes per block, in mode 6 (one pair of endpoints, 16 levels), which is also the only mode decoded
+    BC7 = 3
+};
+
+const uint32_t TEXTURE_BLOCK_EXTENT {4};
+
+// Bytes per block, or per texel for RGBA8
+inline size_t textureBlockSize(TextureEncoding encoding)
+{
+    switch(encoding)
+    {
+        case TextureEncoding::RGBA8: return 4;
+        case TextureEncoding::BC1: return 8;
+        case TextureEncoding::BC3: return 16;
+        case TextureEncoding::BC7: return 16;
+    }
+    throw std::invalid_argument("Unknown texture encoding.");
+}
+
+inline bool isBlockCompressed(TextureEncoding encoding)
+{
+    return encoding != TextureEncoding::RGBA8;
+}
+
+// Size of a width x height image in the encoding
+inline size_t encodedImageSize(TextureEncoding encoding, uint32_t width, uint32_t height)
+{
+    if(!isBlockCompressed(encoding))
+    {
+        return static_cast<size_t>(width) * height * textureBlockSize(encoding);
+    }
+    size_t blockColumns {(width + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT};
+    size_t blockRows {(height + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT};
+    return blockColumns * blockRows * textureBlockSize(encoding);
+}
+
+inline TextureEncoding parseTextureEncoding(const std::string & name)
+{
+    if(name == "rgba8") return TextureEncoding::RGBA8;
+    if(name == "bc1") return TextureEncoding::BC1;
+    if(name == "bc3") return TextureEncoding::BC3;
+    if(name == "bc7") return TextureEncoding::BC7;
+    throw std::invalid_argument("Unknown texture encoding: " + name);
+}
+
+inline const char * textureEncodingName(TextureEncoding encoding)
+{
+    switch(encoding)
+    {
+        case TextureEncoding::RGBA8: return "rgba8";
+        case TextureEncoding::BC1: return "bc1";
+        case TextureEncoding::BC3: return "bc3";
+        case TextureEncoding::BC7: return "bc7";
+    }
+    return "unknown";
+}
+
+// The 16 texels of a block, row by row
+using TexelBlock = std::array<std::array<uint8_t, 4>, 16>;
+
+namespace block_compression
+{
+    inline TexelBlock loadBlock(const uint8_t * rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY)
+    {
+        TexelBlock block;
+        for(uint32_t y {0}; y < TEXTURE_BLOCK_EXTENT; y++)
+        {
+            uint32_t sourceY {std::min(blockY * TEXTURE_BLOCK_EXTENT + y, height - 1)};
+            for(uint32_t x {0}; x < TEXTURE_BLOCK_EXTENT; x++)
+            {
+                uint32_t sourceX {std::min(blockX * TEXTURE_BLOCK_EXTENT + x, width - 1)};
+                const uint8_t * texel {rgba + 4 * (static_cast<size_t>(sourceY) * width + sourceX)};
+                block[y * TEXTURE_BLOCK_EXTENT + x] = {texel[0], texel[1], texel[2], texel[3]};
+            }
+        }
+        return block;
+    }
+
+    inline void storeBlock(const TexelBlock & block, uint8_t * rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY)
+    {
+        for(uint32_t y {0}; y < TEXTURE_BLOCK_EXTENT; y++)
+        {
+            uint32_t targetY {blockY * TEXTURE_BLOCK_EXTENT + y};
+            for(uint32_t x {0}; x < TEXTURE_BLOCK_EXTENT; x++)
+            {
+                uint32_t targetX {blockX * TEXTURE_BLOCK_EXTENT + x};
+                if(targetX < width && targetY < height)
+                {
+                    uint8_t * texel {rgba + 4 * (static_cast<size_t>(targetY) * width + targetX)};
+                    for(size_t channel {0}; channel < 4; channel++)
+                    {
+                        texel[channel] = block[y * TEXTURE_BLOCK_EXTENT + x][channel];
+                    }
+                }
+            }
+        }
+    }
+
+    // Principal axis of the texels' first channelCount channels, by power iteration on their covariance
+    template<size_t channelCount>
+    void principalAxis(const TexelBlock & block, std::array<float, channelCount> & mean, std::array<float, channelCount> & axis)
+    {
+        mean.fill(0.0f);
+        for(const std::array<uint8_t, 4> & texel : block)
+        {
+            for(size_t c {0}; c < channelCount; c++)
+            {
+                mean[c] += texel[c] / 16.0f;
+            }
+        }
+
+        std::array<std::array<float, channelCount>, channelCount> covariance {};
+        for(const std::array<uint8_t, 4> & texel : block)
+        {
+            for(size_t i {0}; i < channelCount; i++)
+            {
+                for(size_t j {0}; j < channelCount; j++)
+                {
+                    covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+                }
+            }
+        }
+
+        // Start from the covariance column of the channel which varies most, which is never orthogonal to the result
+        size_t widestChannel {0};
+        for(size_t i {1}; i < channelCount; i++)
+        {
+            if(covariance[i][i] > covariance[widestChannel][widestChannel])
+            {
+                widestChannel = i;
+            }
+        }
+        axis.fill(0.0f);
+        axis[widestChannel] = 1.0f;
+        for(int iteration {0}; iteration < 8; iteration++)
+        {
+            std::array<float, channelCount> next {};
+            for(size_t i {0}; i < channelCount; i++)
+            {
+                for(size_t j {0}; j < channelCount; j++)
+                {
+                    next[i] += covariance[i][j] * axis[j];
+                }
+            }
+            float length {0.0f};
+            for(float value : next)
+            {
+                length += value * value;
+            }
+            length = std::sqrt(length);
+            if(length < 1e-6f)
+            {
+                // All texels are (almost) the same color, any axis works
+                break;
+            }
+            for(size_t i {0}; i < channelCount; i++)
+            {
+                axis[i] = next[i] / length;
+            }
+        }
+    }
+
+    // Endpoints at the extremes of the texels' projections onto the principal axis
+    template<size_t channelCount>
+    void principalEndpoints(const TexelBlock & block, std::array<float, channelCount> & low, std::array<float, channelCount> & high)
+    {
+        std::array<float, channelCount> mean;
+        std::array<float, channelCount> axis;
+        principalAxis<channelCount>(block, mean, axis);
+
+        float minProjection {std::numeric_limits<float>::max()};
+        float maxProjection {std::numeric_limits<float>::lowest()};
+        for(const std::array<uint8_t, 4> & texel : block)
+        {
+            float projection {0.0f};
+            for(size_t c {0}; c < channelCount; c++)
+            {
+                projection += (texel[c] - mean[c]) * axis[c];
+            }
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        for(size_t c {0}; c < channelCount; c++)
+        {
+            low[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+            high[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+        }
+    }
+
+    // Solves for the endpoints minimizing the squared error of the texels, given their interpolation weights
+    // towards the second endpoint. Returns false if all weights are equal.
+    template<size_t channelCount>
+    bool leastSquaresEndpoints(
+        const TexelBlock & block,
+        const std::array<float, 16> & weights,
+        std::array<float, channelCount> & first,
+        std::array<float, channelCount> & second
+    )
+    {
+        float aa {0.0f};
+        float ab {0.0f};
+        float bb {0.0f};
+        std::array<float, channelCount> ax {};
+        std::array<float, channelCount> bx {};
+        for(size_t i {0}; i < 16; i++)
+        {
+            float a {1.0f - weights[i]};
+            float b {weights[i]};
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for(size_t c {0}; c < channelCount; c++)
+            {
+                ax[c] += a * block[i][c];
+                bx[c] += b * block[i][c];
+            }
+        }
+        float determinant {aa * bb - ab * ab};
+        if(std::abs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+        for(size_t c {0}; c < channelCount; c++)
+        {
+            first[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+            second[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    inline uint16_t packRgb565(const std::array<float, 3> & color)
+    {
+        uint16_t r {static_cast<uint16_t>(std::lround(color[0] * 31.0f / 255.0f))};
+        uint16_t g {static_cast<uint16_t>(std::lround(color[1] * 63.0f / 255.0f))};
+        uint16_t b {static_cast<uint16_t>(std::lround(color[2] * 31.0f / 255.0f))};
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    // Expands by replicating the high bits, like the hardware
+    inline std::array<int, 3> unpackRgb565(uint16_t packed)
+    {
+        int r {(packed >> 11) & 31};
+        int g {(packed >> 5) & 63};
+        int b {packed & 31};
+        return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+    }
+
+    // The four colors of a block in four color mode
+    inline std::array<std::array<int, 3>, 4> bc1Palette(uint16_t color0, uint16_t color1)
+    {
+        std::array<int, 3> c0 {unpackRgb565(color0)};
+        std::array<int, 3> c1 {unpackRgb565(color1)};
+        std::array<std::array<int, 3>, 4> palette {c0, c1, {}, {}};
+        for(size_t c {0}; c < 3; c++)
+        {
+            palette[2][c] = (2 * c0[c] + c1[c]) / 3;
+            palette[3][c] = (c0[c] + 2 * c1[c]) / 3;
+        }
+        return palette;
+    }
+
+    // Picks the nearest palette color for every texel, returns the squared error
+    inline int bc1Indices(const TexelBlock & block, uint16_t color0, uint16_t color1, std::array<uint8_t, 16> & indices)
+    {
+        std::array<std::array<int, 3>, 4> palette {bc1Palette(color0, color1)};
+        int totalError {0};
+        for(size_t i {0}; i < 16; i++)
+        {
+            int bestError {std::numeric_limits<int>::max()};
+            for(uint8_t index {0}; index < 4; index++)
+            {
+                int error {0};
+                for(size_t c {0}; c < 3; c++)
+                {
+                    int difference {block[i][c] - palette[index][c]};
+                    error += difference * difference;
+                }
+                if(error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = index;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    // 8 bytes of BC1 color, always in four color mode
+    inline void encodeBc1Color(const TexelBlock & block, uint8_t * output)
+    {
+        std::array<float, 3> low;
+        std::array<float, 3> high;
+        principalEndpoints<3>(block, low, high);
+
+        uint16_t bestColor0 {packRgb565(high)};
+        uint16_t bestColor1 {packRgb565(low)};
+        std::array<uint8_t, 16> bestIndices {};
+        int bestError {bc1Indices(block, bestColor0, bestColor1, bestIndices)};
+
+        // Refit the endpoints to the chosen indices, while it helps
+        const std::array<float, 4> paletteWeights {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        for(int iteration {0}; iteration < 2; iteration++)
+        {
+            std::array<float, 16> weights;
+            for(size_t i {0}; i < 16; i++)
+            {
+                weights[i] = paletteWeights[bestIndices[i]];
+            }
+            std::array<float, 3> first;
+            std::array<float, 3> second;
+            if(!leastSquaresEndpoints<3>(block, weights, first, second))
+            {
+                break;
+            }
+            uint16_t color0 {packRgb565(first)};
+            uint16_t color1 {packRgb565(second)};
+            std::array<uint8_t, 16> indices;
+            int error {bc1Indices(block, color0, color1, indices)};
+            if(error >= bestError)
+            {
+                break;
+            }
+            bestColor0 = color0;
+            bestColor1 = color1;
+            bestIndices = indices;
+            bestError = error;
+        }
+
+        // Four color mode needs color0 > color1
+        if(bestColor0 < bestColor1)
+        {
+            std::swap(bestColor0, bestColor1);
+            for(uint8_t & index : bestIndices)
+            {
+                index ^= 1;
+            }
+        }
+        else if(bestColor0 == bestColor1)
+        {
+            bestIndices.fill(0);
+        }
+
+        uint32_t packedIndices {0};
+        for(size_t i {0}; i < 16; i++)
+        {
+            packedIndices |= static_cast<uint32_t>(bestIndices[i]) << (2 * i);
+        }
+        output[0] = static_cast<uint8_t>(bestColor0);
+        output[1] = static_cast<uint8_t>(bestColor0 >> 8);
+        output[2] = static_cast<uint8_t>(bestColor1);
+        output[3] = static_cast<uint8_t>(bestColor1 >> 8);
+        for(size_t i {0}; i < 4; i++)
+        {
+            output[4 + i] = static_cast<uint8_t>(packedIndices >> (8 * i));
+        }
+    }
+
+    // BC1 blocks with color0 <= color1 have three colors and transparent black, unless alwaysFourColors, as in BC3
+    inline void decodeBc1Color(const uint8_t * input, TexelBlock & block, bool alwaysFourColors)
+    {
+        uint16_t color0 {static_cast<uint16_t>(input[0] | (input[1] << 8))};
+        uint16_t color1 {static_cast<uint16_t>(input[2] | (input[3] << 8))};
+        uint32_t packedIndices {static_cast<uint32_t>(input[4] | (input[5] << 8) | (input[6] << 16)) | (static_cast<uint32_t>(input[7]) << 24)};
+
+        std::array<std::array<int, 3>, 4> palette {bc1Palette(color0, color1)};
+        std::array<uint8_t, 4> alphas {255, 255, 255, 255};
+        if(!alwaysFourColors && color0 <= color1)
+        {
+            std::array<int, 3> c0 {unpackRgb565(color0)};
+            std::array<int, 3> c1 {unpackRgb565(color1)};
+            for(size_t c {0}; c < 3; c++)
+            {
+                palette[2][c] = (c0[c] + c1[c]) / 2;
+                palette[3][c] = 0;
+            }
+            alphas[3] = 0;
+        }
+
+        for(size_t i {0}; i < 16; i++)
+        {
+            uint32_t index {(packedIndices >> (2 * i)) & 3};
+            block[i] = {
+                static_cast<uint8_t>(palette[index][0]),
+                static_cast<uint8_t>(palette[index][1]),
+                static_cast<uint8_t>(palette[index][2]),
+                alphas[index]
+            };
+        }
+    }
+
+    inline std::array<int, 8> bc3AlphaPalette(int alpha0, int alpha1)
+    {
+        std::array<int, 8> palette {alpha0, alpha1};
+        if(alpha0 > alpha1)
+        {
+            for(int i {2}; i < 8; i++)
+            {
+                palette[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+            }
+        }
+        else
+        {
+            for(int i {2}; i < 6; i++)
+            {
+                palette[i] = ((6 - i) * alpha0 + (i - 1) * alpha1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+        return palette;
+    }
+
+    // 8 bytes of BC3 alpha, with the block's alpha range as endpoints
+    inline void encodeBc3Alpha(const TexelBlock & block, uint8_t * output)
+    {
+        int alpha0 {0};
+        int alpha1 {255};
+        for(const std::array<uint8_t, 4> & texel : block)
+        {
+            alpha0 = std::max<int>(alpha0, texel[3]);
+            alpha1 = std::min<int>(alpha1, texel[3]);
+        }
+
+        uint64_t packedIndices {0};
+        if(alpha0 > alpha1)
+        {
+            std::array<int, 8> palette {bc3AlphaPalette(alpha0, alpha1)};
+            for(size_t i {0}; i < 16; i++)
+            {
+                uint64_t bestIndex {0};
+                int bestError {std::numeric_limits<int>::max()};
+                for(uint64_t index {0}; index < 8; index++)
+                {
+                    int error {std::abs(block[i][3] - palette[index])};
+                    if(error < bestError)
+                    {
+                        bestError = error;
+                        bestIndex = index;
+                    }
+                }
+                packedIndices |= bestIndex << (3 * i);
+            }
+        }
+
+        output[0] = static_cast<uint8_t>(alpha0);
+        output[1] = static_cast<uint8_t>(alpha1);
+        for(size_t i {0}; i < 6; i++)
+        {
+            output[2 + i] = static_cast<uint8_t>(packedIndices >> (8 * i));
+        }
+    }
+
+    inline void decodeBc3Alpha(const uint8_t * input, TexelBlock & block)
+    {
+        std::array<int, 8> palette {bc3AlphaPalette(input[0], input[1])};
+        uint64_t packedIndices {0};
+        for(size_t i {0}; i < 6; i++)
+        {
+            packedIndices |= static_cast<uint64_t>(input[2 + i]) << (8 * i);
+        }
+        for(size_t i {0}; i < 16; i++)
+        {
+            block[i][3] = static_cast<uint8_t>(palette[(packedIndices >> (3 * i)) & 7]);
+        }
+    }
+
+    // Interpolation weights of 4 bit BC7 indices, out of 64
+    const std::array<int, 16> BC7_WEIGHTS {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    inline int bc7Interpolate(int first, int second, int index)
+    {
+        return ((64 - BC7_WEIGHTS[index]) * first + BC7_WEIGHTS[index] * second + 32) >> 6;
+    }
+
+    // Mode 6 endpoints: 7 bits per channel plus a shared lowest bit per endpoint
+    struct Bc7Endpoints
+    {
+        std::array<std::array<int, 4>, 2> values;
+        std::array<int, 2> pBits;
+
+        int expanded(size_t endpoint, size_t channel) const
+        {
+            return (values[endpoint][channel] << 1) | pBits[endpoint];
+        }
+    };
+
+    inline Bc7Endpoints quantizeBc7Endpoints(const std::array<float, 4> & first, const std::array<float, 4> & second, int pBit0, int pBit1)
+    {
+        Bc7Endpoints endpoints {};
+        endpoints.pBits = {pBit0, pBit1};
+        for(size_t c {0}; c < 4; c++)
+        {
+            endpoints.values[0][c] = std::clamp(static_cast<int>(std::lround((first[c] - pBit0) / 2.0f)), 0, 127);
+            endpoints.values[1][c] = std::clamp(static_cast<int>(std::lround((second[c] - pBit1) / 2.0f)), 0, 127);
+        }
+        return endpoints;
+    }
+
+    inline int bc7Indices(const TexelBlock & block, const Bc7Endpoints & endpoints, std::array<uint8_t, 16> & indices)
+    {
+        std::array<std::array<int, 4>, 16> palette;
+        for(int index {0}; index < 16; index++)
+        {
+            for(size_t c {0}; c < 4; c++)
+            {
+                palette[index][c] = bc7Interpolate(endpoints.expanded(0, c), endpoints.expanded(1, c), index);
+            }
+        }
+
+        int totalError {0};
+        for(size_t i {0}; i < 16; i++)
+        {
+            int bestError {std::numeric_limits<int>::max()};
+            for(uint8_t index {0}; index < 16; index++)
+            {
+                int error {0};
+                for(size_t c {0}; c < 4; c++)
+                {
+                    int difference {block[i][c] - palette[index][c]};
+                    error += difference * difference;
+                }
+                if(error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = index;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    // Tries every pair of p-bits for the endpoints, keeps the best
+    inline int bestBc7Endpoints(
+        const TexelBlock & block,
+        const std::array<float, 4> & first,
+        const std::array<float, 4> & second,
+        Bc7Endpoints & bestEndpoints,
+        std::array<uint8_t, 16> & bestIndices
+    )
+    {
+        int bestError {std::numeric_limits<int>::max()};
+        for(int pBits {0}; pBits < 4; pBits++)
+        {
+            Bc7Endpoints endpoints {quantizeBc7Endpoints(first, second, pBits & 1, pBits >> 1)};
+            std::array<uint8_t, 16> indices;
+            int error {bc7Indices(block, endpoints, indices)};
+            if(error < bestError)
+            {
+                bestError = error;
+                bestEndpoints = endpoints;
+                bestIndices = indices;
+            }
+        }
+        return bestError;
+    }
+
+    // Writes bits from the least significant bit of the block up
+    class BlockBitWriter
+    {
+    public:
+        explicit BlockBitWriter(uint8_t * output) : output {output}
+        {
+            std::fill(output, output + 16, 0);
+        }
+
+        void write(uint32_t value, uint32_t bitCount)
+        {
+            for(uint32_t bit {0}; bit < bitCount; bit++, position++)
+            {
+                output[position / 8] |= static_cast<uint8_t>(((value >> bit) & 1) << (position % 8));
+            }
+        }
+
+    private:
+        uint8_t * output;
+        uint32_t position {0};
+    };
+
+    class BlockBitReader
+    {
+    public:
+        explicit BlockBitReader(const uint8_t * input) : input {input} {}
+
+        uint32_t read(uint32_t bitCount)
+        {
+            uint32_t value {0};
+            for(uint32_t bit {0}; bit < bitCount; bit++, position++)
+            {
+                value |= static_cast<uint32_t>((input[position / 8] >> (position % 8)) & 1) << bit;
+            }
+            return value;
+        }
+
+    private:
+        const uint8_t * input;
+        uint32_t position {0};
+    };
+
+    // 16 bytes of BC7 in mode 6
+    inline void encodeBc7(const TexelBlock & block, uint8_t * output)
+    {
+        std::array<float, 4> low;
+        std::array<float, 4> high;
+        principalEndpoints<4>(block, low, high);
+
+        Bc7Endpoints endpoints {};
+        std::array<uint8_t, 16> indices {};
+        int error {bestBc7Endpoints(block, low, high, endpoints, indices)};
+
+        // Refit the endpoints to the chosen indices, while it helps
+        for(int iteration {0}; iteration < 2 && error > 0; iteration++)
+        {
+            std::array<float, 16> weights;
+            for(size_t i {0}; i < 16; i++)
+            {
+                weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+            }
+            std::array<float, 4> first;
+            std::array<float, 4> second;
+            if(!leastSquaresEndpoints<4>(block, weights, first, second))
+            {
+                break;
+            }
+            Bc7Endpoints refitEndpoints {};
+            std::array<uint8_t, 16> refitIndices;
+            int refitError {bestBc7Endpoints(block, first, second, refitEndpoints, refitIndices)};
+            if(refitError >= error)
+            {
+                break;
+            }
+            endpoints = refitEndpoints;
+            indices = refitIndices;
+            error = refitError;
+        }
+
+        // The first index is stored without its highest bit, which must be 0
+        if(indices[0] >= 8)
+        {
+            std::swap(endpoints.values[0], endpoints.values[1]);
+            std::swap(endpoints.pBits[0], endpoints.pBits[1]);
+            for(uint8_t & index : indices)
+            {
+                index = static_cast<uint8_t>(15 - index);
+            }
+        }
+
+        BlockBitWriter writer {output};
+        // Mode 6 is 6 zero bits followed by a one
+        writer.write(1u << 6, 7);
+        for(size_t c {0}; c < 4; c++)
+        {
+            writer.write(static_cast<uint32_t>(endpoints.values[0][c]), 7);
+            writer.write(static_cast<uint32_t>(endpoints.values[1][c]), 7);
+        }
+        writer.write(static_cast<uint32_t>(endpoints.pBits[0]), 1);
+        writer.write(static_cast<uint32_t>(endpoints.pBits[1]), 1);
+        writer.write(indices[0], 3);
+        for(size_t i {1}; i < 16; i++)
+        {
+            writer.write(indices[i], 4);
+        }
+    }
+
+    inline void decodeBc7(const uint8_t * input, TexelBlock & block)
+    {
+        BlockBitReader reader {input};
+        if(reader.read(7) != (1u << 6))
+        {
+            throw std::runtime_error("Only BC7 mode 6 blocks can be decoded.");
+        }
+        Bc7Endpoints endpoints {};
+        for(size_t c {0}; c < 4; c++)
+        {
+            endpoints.values[0][c] = static_cast<int>(reader.read(7));
+            endpoints.values[1][c] = static_cast<int>(reader.read(7));
+        }
+        endpoints.pBits[0] = static_cast<int>(reader.read(1));
+        endpoints.pBits[1] = static_cast<int>(reader.read(1));
+        for(size_t i {0}; i < 16; i++)
+        {
+            int index {static_cast<int>(reader.read(i == 0 ? 3 : 4))};
+            for(size_t c {0}; c < 4; c++)
+            {
+                block[i][c] = static_cast<uint8_t>(bc7Interpolate(endpoints.expanded(0, c), endpoints.expanded(1, c), index));
+            }
+        }
+    }
+}
+
+// Compresses a width x height RGBA8 image, one row of blocks per task on the thread pool
+inline std::vector<uint8_t> compressImage(
+    const uint8_t * rgba,
+    uint32_t width,
+    uint32_t height,
+    TextureEncoding encoding,
+    ThreadPool & threadPool
+)
+{
+    if(!isBlockCompressed(encoding))
+    {
+        return std::vector<uint8_t>(rgba, rgba + encodedImageSize(encoding, width, height));
+    }
+
+    uint32_t blockColumns {(width + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT};
+    uint32_t blockRows {(height + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT};
+    size_t blockSize {textureBlockSize(encoding)};
+    std::vector<uint8_t> blocks(encodedImageSize(encoding, width, height));
+
+    threadPool.parallelFor(blockRows, [&](size_t blockY)
+    {
+        for(uint32_t blockX {0}; blockX < blockColumns; blockX++)
+        {
+            TexelBlock block {block_compression::loadBlock(rgba, width, height, blockX, static_cast<uint32_t>(blockY))};
+            uint8_t * output {blocks.data() + (blockY * blockColumns + blockX) * blockSize};
+            switch(encoding)
+            {
+                case TextureEncoding::BC1:
+                    block_compression::encodeBc1Color(block, output);
+                    break;
+                case TextureEncoding::BC3:
+                    block_compression::encodeBc3Alpha(block, output);
+                    block_compression::encodeBc1Color(block, output + 8);
+                    break;
+                case TextureEncoding::BC7:
+                    block_compression::encodeBc7(block, output);
+                    break;
+                case TextureEncoding::RGBA8:
+                    break;
+            }
+        }
+    });
+    return blocks;
+}
+
+// Decompresses an image of the encoding back to RGBA8, for devices which can't sample the compressed format.
+// One row of blocks per task on the thread pool.
+inline std::vector<uint8_t> decompressImage(
+    const uint8_t * data,
+    uint32_t width,
+    uint32_t height,
+    TextureEncoding encoding,
+    ThreadPool & threadPool
+)
+{
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    if(!isBlockCompressed(encoding))
+    {
+        std::copy(data, data + rgba.size(), rgba.begin());
+        return rgba;
+    }
+
+    uint32_t blockColumns {(width + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT};
+    uint32_t blockRows {(height + TEXTURE_BLOCK_EXTENT - 1) / TEXTURE_BLOCK_EXTENT};
+    size_t blockSize {textureBlockSize(encoding)};
+    threadPool.parallelFor(blockRows, [&](size_t blockY)
+    {
+        for(uint32_t blockX {0}; blockX < blockColumns; blockX++)
+        {
+            const uint8_t * input {data + (blockY * blockColumns + blockX) * blockSize};
+            TexelBlock block;
+            switch(encoding)
+            {
+                case TextureEncoding::BC1:
+                    block_compression::decodeBc1Color(input, block, false);
+                    break;
+                case TextureEncoding::BC3:
+                    block_compression::decodeBc1Color(input + 8, block, true);
+                    block_compression::decodeBc3Alpha(input, block);
+                    break;
+                case TextureEncoding::BC7:
+                    block_compression::decodeBc7(input, block);
+                    break;
+                case TextureEncoding::RGBA8:
+                    break;
+            }
+            block_compression::storeBlock(block, rgba.data(), width, height, blockX, static_cast<uint32_t>(blockY));
+        }
+    });
+    return rgba;
+}
+
+// Peak signal to noise ratio of the RGB channels of b against a, in dB
+inline double rgbPsnr(const uint8_t * a, const uint8_t * b, size_t texelCount)
+{
+    double squaredError {0.0};
+    for(size_t i {0}; i < texelCount; i++)
+    {
+        for(size_t c {0}; c < 3; c++)
+        {
+            double difference {static_cast<double>(a[4 * i + c]) - b[4 * i + c]};
+            squaredError += difference * difference;
+        }
+    }
+    if(squaredError == 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    double meanSquaredError {squaredError / (3.0 * texelCount)};
+    return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // for memcpy, memcmp
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include "mesh_cache.h" // for MappedFile, writeFileAtomically
+#include "texture_compression.h"
+#include "texture_mips.h" // for mipLevelCount
+
+// Texture container file, laid out like a minimal KTX2:
+// a TextureContainerHeader, followed by one TextureContainerLevel per mip level, largest first,
+// followed by the data of the levels, each starting at a multiple of TEXTURE_CONTAINER_ALIGNMENT.
+const char TEXTURE_CONTAINER_MAGIC[8] {'V', 'K', 'T', 'E', 'X', '\0', '\0', '\0'};
+// Increment whenever the file layout, or the way the levels are encoded, changes
+const uint32_t TEXTURE_CONTAINER_VERSION {2};
+const size_t TEXTURE_CONTAINER_ALIGNMENT {16};
+
+struct TextureContainerHeader
+{
+    char magic[8];
+    uint32_t version;
+    TextureEncoding encoding;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t reserved;
+    // Hash of the source image file contents
+    uint64_t sourceHash;
+};
+
+struct TextureContainerLevel
+{
+    // From the start of the file
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Texture inside a mapped container file
+struct TextureContainerView
+{
+    TextureEncoding encoding {TextureEncoding::RGBA8};
+    uint32_t width {0};
+    uint32_t height {0};
+    uint32_t levelCount {0};
+    const TextureContainerLevel * levels {nullptr};
+    // Start of the file, which the level offsets are relative to
+    const unsigned char * fileData {nullptr};
+
+    const unsigned char * levelData(uint32_t level) const
+    {
+        return fileData + levels[level].offset;
+    }
+};
+
+// Returns false if the file isn't a valid container of the given source, in which case it has to be rebuilt
+inline bool readTextureContainer(const MappedFile & file, uint64_t sourceHash, TextureContainerView & view)
+{
+    if(!file.isOpen() || file.size() < sizeof(TextureContainerHeader))
+    {
+        return false;
+    }
+
+    TextureContainerHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if(
+        memcmp(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC)) != 0 ||
+        header.version != TEXTURE_CONTAINER_VERSION ||
+        header.sourceHash != sourceHash ||
+        header.encoding > TextureEncoding::BC7 ||
+        header.width == 0 ||
+        header.height == 0 ||
+        header.levelCount == 0 ||
+        header.levelCount > mipLevelCount(header.width, header.height) ||
+        file.size() < sizeof(TextureContainerHeader) + sizeof(TextureContainerLevel) * static_cast<size_t>(header.levelCount)
+    )
+    {
+        return false;
+    }
+
+    const TextureContainerLevel * levels {reinterpret_cast<const TextureContainerLevel *>(file.data() + sizeof(TextureContainerHeader))};
+    for(uint32_t level {0}; level < header.levelCount; level++)
+    {
+        if(
+            levels[level].width != std::max(1u, header.width >> level) ||
+            levels[level].height != std::max(1u, header.height >> level) ||
+            levels[level].size != encodedImageSize(header.encoding, levels[level].width, levels[level].height) ||
+            levels[level].offset % TEXTURE_CONTAINER_ALIGNMENT != 0 ||
+            levels[level].offset + levels[level].size > file.size()
+        )
+        {
+            return false;
+        }
+    }
+
+    view.encoding = header.encoding;
+    view.width = header.width;
+    view.height = header.height;
+    view.levelCount = header.levelCount;
+    view.levels = levels;
+    view.fileData = file.data();
+    return true;
+}
+
+// levelData holds the encoded levels, largest first, each half the size of the previous one.
+// Written with writeFileAtomically, so an interrupted write never leaves a truncated file behind.
+inline bool writeTextureContainer(
+    const std::string & path,
+    uint64_t sourceHash,
+    TextureEncoding encoding,
+    uint32_t width,
+    uint32_t height,
+    const std::vector<std::vector<uint8_t>> & levelData
+)
+{
+    TextureContainerHeader header {};
+    memcpy(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(TEXTURE_CONTAINER_MAGIC));
+    header.version = TEXTURE_CONTAINER_VERSION;
+    header.encoding = encoding;
+    header.width = width;
+    header.height = height;
+    header.levelCount = static_cast<uint32_t>(levelData.size());
+    header.sourceHash = sourceHash;
+
+    std::vector<TextureContainerLevel> levels(levelData.size());
+    uint64_t offset {sizeof(TextureContainerHeader) + sizeof(TextureContainerLevel) * levels.size()};
+    for(size_t level {0}; level < levels.size(); level++)
+    {
+        offset = (offset + TEXTURE_CONTAINER_ALIGNMENT - 1) / TEXTURE_CONTAINER_ALIGNMENT * TEXTURE_CONTAINER_ALIGNMENT;
+        levels[level].offset = offset;
+        levels[level].size = levelData[level].size();
+        levels[level].width = std::max(1u, width >> level);
+        levels[level].height = std::max(1u, height >> level);
+        offset += levels[level].size;
+    }
+
+    return writeFileAtomically(path, [&](std::ofstream & file)
+    {
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(levels.data()), sizeof(TextureContainerLevel) * levels.size());
+        uint64_t written {sizeof(TextureContainerHeader) + sizeof(TextureContainerLevel) * levels.size()};
+        const char padding[TEXTURE_CONTAINER_ALIGNMENT] {};
+        for(size_t level {0}; level < levels.size(); level++)
+        {
+            file.write(padding, static_cast<std::streamsize>(levels[level].offset - written));
+            file.write(reinterpret_cast<const char *>(levelData[level].data()), static_cast<std::streamsize>(levels[level].size));
+            written = levels[level].offset + levels[level].size;
+        }
+    });
+}
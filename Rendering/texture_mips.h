@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include "thread_pool.h"
+
+// One level of a mip chain, tightly packed RGBA8
+struct MipLevel
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> texels;
+};
+
+namespace mip_generation
+{
+    // Linear values of the 8 bit sRGB values
+    inline const std::array<float, 256> & srgbToLinearTable()
+    {
+        static const std::array<float, 256> table {[]
+        {
+            std::array<float, 256> values {};
+            for(size_t i {0}; i < values.size(); i++)
+            {
+                float srgb {static_cast<float>(i) / 255.0f};
+                values[i] = srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }()};
+        return table;
+    }
+
+    // Resolution of linearToSrgbTable, fine enough to round dark values to the nearest 8 bit sRGB value
+    const size_t LINEAR_TABLE_SIZE {16384};
+
+    // Nearest 8 bit sRGB values of evenly spaced linear values in [0, 1]
+    inline const std::vector<uint8_t> & linearToSrgbTable()
+    {
+        static const std::vector<uint8_t> table {[]
+        {
+            std::vector<uint8_t> values(LINEAR_TABLE_SIZE);
+            for(size_t i {0}; i < values.size(); i++)
+            {
+                float linear {static_cast<float>(i) / static_cast<float>(LINEAR_TABLE_SIZE - 1)};
+                float srgb {linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f};
+                values[i] = static_cast<uint8_t>(std::clamp(srgb * 255.0f + 0.5f, 0.0f, 255.0f));
+            }
+            return values;
+        }()};
+        return table;
+    }
+
+    // Converts a row of RGBA8 texels to linear floats. Alpha is already linear.
+    inline void loadLinearRow(const uint8_t * row, uint32_t width, float * linear)
+    {
+        const std::array<float, 256> & toLinear {srgbToLinearTable()};
+        for(size_t i {0}; i < 4 * static_cast<size_t>(width); i += 4)
+        {
+            linear[i] = toLinear[row[i]];
+            linear[i + 1] = toLinear[row[i + 1]];
+            linear[i + 2] = toLinear[row[i + 2]];
+            linear[i + 3] = row[i + 3] / 255.0f;
+        }
+    }
+
+    // Halves an sRGB RGBA8 level with a 2x2 box filter averaged in linear space.
+    // Odd sizes round down, so the last row or column of the source is left out of the level.
+    // A side of 1 stays 1, and its texels are counted twice.
+    inline MipLevel downsample(const MipLevel & source, ThreadPool & threadPool)
+    {
+        MipLevel level {std::max(1u, source.width / 2), std::max(1u, source.height / 2), {}};
+        level.texels.resize(4 * static_cast<size_t>(level.width) * level.height);
+        const std::vector<uint8_t> & toSrgb {linearToSrgbTable()};
+
+        threadPool.parallelFor(level.height, [&](size_t y)
+        {
+            // Sum of the two source rows, so the horizontal pass reads one contiguous float array
+            std::vector<float> rowA(4 * static_cast<size_t>(source.width));
+            std::vector<float> rowB(rowA.size());
+            size_t sourceY0 {std::min<size_t>(2 * y, source.height - 1)};
+            size_t sourceY1 {std::min<size_t>(2 * y + 1, source.height - 1)};
+            loadLinearRow(source.texels.data() + 4 * sourceY0 * source.width, source.width, rowA.data());
+            loadLinearRow(source.texels.data() + 4 * sourceY1 * source.width, source.width, rowB.data());
+            for(size_t i {0}; i < rowA.size(); i++)
+            {
+                rowA[i] += rowB[i];
+            }
+
+            uint8_t * output {level.texels.data() + 4 * y * level.width};
+            for(size_t x {0}; x < level.width; x++)
+            {
+                size_t left {4 * std::min<size_t>(2 * x, source.width - 1)};
+                size_t right {4 * std::min<size_t>(2 * x + 1, source.width - 1)};
+                for(size_t c {0}; c < 3; c++)
+                {
+                    float linear {(rowA[left + c] + rowA[right + c]) * 0.25f};
+                    output[4 * x + c] = toSrgb[static_cast<size_t>(linear * (LINEAR_TABLE_SIZE - 1) + 0.5f)];
+                }
+                float alpha {(rowA[left + 3] + rowA[right + 3]) * 0.25f};
+                output[4 * x + 3] = static_cast<uint8_t>(alpha * 255.0f + 0.5f);
+            }
+        });
+        return level;
+    }
+}
+
+// Number of levels in a full mip chain down to 1x1
+inline uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levelCount {1};
+    for(uint32_t size {std::max(width, height)}; size > 1; size /= 2)
+    {
+        levelCount++;
+    }
+    return levelCount;
+}
+
+// Builds the full mip chain of an sRGB RGBA8 image, with the image itself as level 0.
+// Each level is filtered from the previous one, one row per task on the thread pool.
+inline std::vector<MipLevel> generateMipChain(const uint8_t * rgba, uint32_t width, uint32_t height, ThreadPool & threadPool)
+{
+    std::vector<MipLevel> levels;
+    levels.reserve(mipLevelCount(width, height));
+    levels.push_back({width, height, std::vector<uint8_t>(rgba, rgba + 4 * static_cast<size_t>(width) * height)});
+    while(levels.back().width > 1 || levels.back().height > 1)
+    {
+        levels.push_back(mip_generation::downsample(levels.back(), threadPool));
+    }
+    return levels;
+}
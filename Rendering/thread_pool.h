@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <algorithm> // for std::max, std::min
+
+// Fixed set of worker threads running submitted tasks in submission order
+class ThreadPool
+{
+public:
+    // threadCount 0 uses one thread per hardware thread
+    explicit ThreadPool(size_t threadCount = 0)
+    {
+        if(threadCount == 0)
+        {
+            threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+
+        workers.reserve(threadCount);
+        for(size_t i {0}; i < threadCount; i++)
+        {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            stopping = true;
+        }
+        condition.notify_all();
+        for(std::thread & worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    size_t threadCount() const
+    {
+        return workers.size();
+    }
+
+    // The future rethrows any exception thrown by the task
+    std::future<void> submit(std::function<void()> task)
+    {
+        std::packaged_task<void()> packagedTask {std::move(task)};
+        std::future<void> future {packagedTask.get_future()};
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            tasks.push_back(std::move(packagedTask));
+        }
+        condition.notify_one();
+        return future;
+    }
+
+    // Calls function(i) for every i in [0, count), and waits until all calls are done.
+    // The calling thread works too. Must not be called from inside a task of the same pool.
+    void parallelFor(size_t count, const std::function<void(size_t)> & function)
+    {
+        if(count == 0)
+        {
+            return;
+        }
+
+        std::atomic<size_t> nextIndex {0};
+        auto work = [&]()
+        {
+            for(size_t i {nextIndex++}; i < count; i = nextIndex++)
+            {
+                function(i);
+            }
+        };
+
+        size_t helperCount {std::min(count, workers.size()) - 1};
+        std::vector<std::future<void>> helpers;
+        helpers.reserve(helperCount);
+        for(size_t i {0}; i < helperCount; i++)
+        {
+            helpers.push_back(submit(work));
+        }
+
+        // Wait for all helpers even if one throws, since they reference this stack frame
+        std::exception_ptr exception;
+        try
+        {
+            work();
+        }
+        catch(...)
+        {
+            exception = std::current_exception();
+            nextIndex = count;
+        }
+        for(std::future<void> & helper : helpers)
+        {
+            try
+            {
+                helper.get();
+            }
+            catch(...)
+            {
+                if(!exception)
+                {
+                    exception = std::current_exception();
+                }
+            }
+        }
+        if(exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping {false};
+
+    void workerLoop()
+    {
+        while(true)
+        {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock {mutex};
+                condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if(stopping && tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
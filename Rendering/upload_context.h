@@ -0,0 +1,494 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+#include <cstring> // for memcpy
+#include <algorithm> // for std::min
+#include "staging_ring.h"
+
+// Tightly packed texels of one mip level of a 2D image
+struct ImageLevel
+{
+    uint32_t width;
+    uint32_t height;
+    const void * texels;
+};
+
+// Records uploads into one batch of command buffers, submitted once and tracked with a fence,
+// instead of submitting and waiting for every copy.
+// If the transfer family differs from the graphics family, copies run on the transfer queue,
+// and the resources are handed to the graphics queue with queue family ownership transfers.
+// Commands which need the graphics queue (blits, transitions for sampling) go in the graphics command
+// buffer, which runs after the transfer command buffer.
+// Data is staged in a ring buffer shared by all uploads. Uploads larger than the free part of the ring
+// are split into chunks, submitting and waiting for the batch whenever the ring is full.
+class UploadContext
+{
+public:
+    // stagingBuffer must be persistently mapped at stagingMapped, and usable as a transfer source.
+    // transferGranularity is the minImageTransferGranularity of the transfer family.
+    void init(
+        VkDevice device,
+        VkBuffer stagingBuffer,
+        void * stagingMapped,
+        VkDeviceSize stagingSize,
+        uint32_t transferFamily,
+        VkQueue transferQueue,
+        VkExtent3D transferGranularity,
+        uint32_t graphicsFamily,
+        VkQueue graphicsQueue
+    )
+    {
+        this->device = device;
+        this->stagingBuffer = stagingBuffer;
+        stagingRing.init(stagingMapped, stagingSize);
+        this->transferGranularity = transferGranularity;
+        this->transferFamily = transferFamily;
+        this->transferQueue = transferQueue;
+        this->graphicsFamily = graphicsFamily;
+        this->graphicsQueue = graphicsQueue;
+
+        graphicsCommandPool = createCommandPool(graphicsFamily);
+        graphicsCommands = allocateCommandBuffer(graphicsCommandPool);
+        if(usesTransferQueue())
+        {
+            transferCommandPool = createCommandPool(transferFamily);
+            transferCommands = allocateCommandBuffer(transferCommandPool);
+
+            VkSemaphoreCreateInfo semaphoreCreateInfo {};
+            semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            if(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &transferFinishedSemaphore) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create upload semaphore.");
+            }
+        }
+        else
+        {
+            transferCommands = graphicsCommands;
+        }
+
+        VkFenceCreateInfo fenceCreateInfo {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if(vkCreateFence(device, &fenceCreateInfo, nullptr, &uploadFinishedFence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create upload fence.");
+        }
+    }
+
+    void destroy()
+    {
+        wait();
+        vkDestroyFence(device, uploadFinishedFence, nullptr);
+        if(usesTransferQueue())
+        {
+            vkDestroySemaphore(device, transferFinishedSemaphore, nullptr);
+            vkDestroyCommandPool(device, transferCommandPool, nullptr);
+        }
+        vkDestroyCommandPool(device, graphicsCommandPool, nullptr);
+    }
+
+    bool usesTransferQueue() const
+    {
+        return transferFamily != graphicsFamily;
+    }
+
+    // Starts recording a new batch. The previous batch must have been waited for.
+    void begin()
+    {
+        if(submitted)
+        {
+            throw std::logic_error("Previous upload batch wasn't waited for.");
+        }
+
+        VkCommandBufferBeginInfo commandBufferBeginInfo {};
+        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(graphicsCommands, &commandBufferBeginInfo);
+        if(usesTransferQueue())
+        {
+            vkBeginCommandBuffer(transferCommands, &commandBufferBeginInfo);
+        }
+        acquireStages = 0;
+        recording = true;
+    }
+
+    // For copies. The same command buffer as graphicsCommandBuffer() without a transfer queue.
+    VkCommandBuffer transferCommandBuffer() const
+    {
+        return transferCommands;
+    }
+
+    // For commands which need the graphics queue. Runs after the transfer command buffer.
+    VkCommandBuffer graphicsCommandBuffer() const
+    {
+        return graphicsCommands;
+    }
+
+    // Records copies of data into the buffer, at dstOffset
+    void uploadBuffer(VkBuffer buffer, VkDeviceSize dstOffset, const void * data, VkDeviceSize size)
+    {
+        const char * source {static_cast<const char *>(data)};
+        VkDeviceSize copied {0};
+        while(copied < size)
+        {
+            // Don't split into tiny chunks just because the ring is almost full
+            VkDeviceSize remaining {size - copied};
+            VkDeviceSize available {stagingRing.largestFreeRegion(BUFFER_COPY_ALIGNMENT)};
+            if(available < std::min(remaining, stagingRing.size() / 4))
+            {
+                flush();
+                continue;
+            }
+
+            VkDeviceSize chunkSize {std::min(remaining, available)};
+            VkDeviceSize stagingOffset;
+            stagingRing.allocate(chunkSize, BUFFER_COPY_ALIGNMENT, stagingOffset);
+            memcpy(stagingRing.pointer(stagingOffset), source + copied, chunkSize);
+
+            VkBufferCopy copyRegion {};
+            copyRegion.srcOffset = stagingOffset;
+            copyRegion.dstOffset = dstOffset + copied;
+            copyRegion.size = chunkSize;
+            vkCmdCopyBuffer(transferCommands, stagingBuffer, buffer, 1, &copyRegion);
+
+            copied += chunkSize;
+        }
+    }
+
+    // Records copies of tightly packed texels into a mip level of a 2D image, in bands of rows.
+    // The image must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+    // For block compressed formats, texelSize is the size of a blockExtent x blockExtent block, and rows are rows of blocks.
+    void uploadImage(
+        VkImage image,
+        uint32_t mipLevel,
+        uint32_t width,
+        uint32_t height,
+        VkDeviceSize texelSize,
+        const void * texels,
+        uint32_t blockExtent = 1
+    )
+    {
+        uint32_t blockColumns {(width + blockExtent - 1) / blockExtent};
+        uint32_t blockRows {(height + blockExtent - 1) / blockExtent};
+        VkDeviceSize rowSize {blockColumns * texelSize};
+        // Bands must be multiples of the transfer granularity, except the last one.
+        // A granularity of 0 only allows whole mip levels to be copied. For compressed formats it counts blocks.
+        uint32_t rowGranularity {transferGranularity.height == 0 ? blockRows : std::max(1u, transferGranularity.height)};
+        // Buffer offsets must be multiples of 4 and of the texel size
+        VkDeviceSize alignment {texelSize % 4 == 0 ? texelSize : texelSize * 4};
+
+        const char * source {static_cast<const char *>(texels)};
+        uint32_t copiedRows {0};
+        while(copiedRows < blockRows)
+        {
+            uint32_t remainingRows {blockRows - copiedRows};
+            uint32_t availableRows {static_cast<uint32_t>(std::min<VkDeviceSize>(stagingRing.largestFreeRegion(alignment) / rowSize, remainingRows))};
+            if(availableRows < remainingRows)
+            {
+                availableRows -= availableRows % rowGranularity;
+            }
+            if(availableRows < std::min(remainingRows, rowGranularity))
+            {
+                if(stagingRing.largestFreeRegion(alignment) == stagingRing.size())
+                {
+                    throw std::runtime_error("Image rows don't fit into the staging ring.");
+                }
+                flush();
+                continue;
+            }
+
+            VkDeviceSize chunkSize {availableRows * rowSize};
+            VkDeviceSize stagingOffset;
+            stagingRing.allocate(chunkSize, alignment, stagingOffset);
+            memcpy(stagingRing.pointer(stagingOffset), source + copiedRows * rowSize, chunkSize);
+
+            VkBufferImageCopy region {};
+            region.bufferOffset = stagingOffset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = mipLevel;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            // The extent of the last band stops at the edge of the image, even inside a block
+            region.imageOffset = {0, static_cast<int32_t>(copiedRows * blockExtent), 0};
+            region.imageExtent = {width, std::min(availableRows * blockExtent, height - copiedRows * blockExtent), 1};
+            vkCmdCopyBufferToImage(transferCommands, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+            copiedRows += availableRows;
+        }
+    }
+
+    // Records copies of a whole mip chain, levels[i] going to mip level i, with a single
+    // vkCmdCopyBufferToImage which has one region per level.
+    // Falls back to uploadImage for each level when the chain doesn't fit into the staging ring at once.
+    void uploadImageLevels(
+        VkImage image,
+        const std::vector<ImageLevel> & levels,
+        VkDeviceSize texelSize,
+        uint32_t blockExtent = 1
+    )
+    {
+        VkDeviceSize alignment {texelSize % 4 == 0 ? texelSize : texelSize * 4};
+        std::vector<VkDeviceSize> levelOffsets(levels.size());
+        std::vector<VkDeviceSize> levelSizes(levels.size());
+        VkDeviceSize totalSize {0};
+        for(size_t level {0}; level < levels.size(); level++)
+        {
+            VkDeviceSize blockColumns {(levels[level].width + blockExtent - 1) / blockExtent};
+            VkDeviceSize blockRows {(levels[level].height + blockExtent - 1) / blockExtent};
+            levelOffsets[level] = (totalSize + alignment - 1) / alignment * alignment;
+            levelSizes[level] = blockColumns * blockRows * texelSize;
+            totalSize = levelOffsets[level] + levelSizes[level];
+        }
+
+        if(totalSize > stagingRing.size())
+        {
+            for(size_t level {0}; level < levels.size(); level++)
+            {
+                uploadImage(image, static_cast<uint32_t>(level), levels[level].width, levels[level].height, texelSize, levels[level].texels, blockExtent);
+            }
+            return;
+        }
+        if(stagingRing.largestFreeRegion(alignment) < totalSize)
+        {
+            flush();
+        }
+
+        VkDeviceSize stagingOffset;
+        stagingRing.allocate(totalSize, alignment, stagingOffset);
+        std::vector<VkBufferImageCopy> regions(levels.size());
+        for(size_t level {0}; level < levels.size(); level++)
+        {
+            memcpy(stagingRing.pointer(stagingOffset + levelOffsets[level]), levels[level].texels, levelSizes[level]);
+
+            // Whole levels satisfy any transfer granularity
+            VkBufferImageCopy & region {regions[level]};
+            region.bufferOffset = stagingOffset + levelOffsets[level];
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = static_cast<uint32_t>(level);
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {levels[level].width, levels[level].height, 1};
+        }
+        vkCmdCopyBufferToImage(
+            transferCommands,
+            stagingBuffer,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()),
+            regions.data()
+        );
+    }
+
+    // Makes the transfer writes to the buffer visible to the graphics queue at dstStage
+    void releaseBuffer(VkBuffer buffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkBufferMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        if(!usesTransferQueue())
+        {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            return;
+        }
+
+        // Release on the transfer queue
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        // Acquire on the graphics queue
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        acquireStages |= dstStage;
+    }
+
+    // Makes the transfer writes to the image visible to the graphics queue at dstStage.
+    // The image stays in the given layout.
+    void releaseImage(
+        VkImage image,
+        VkImageLayout layout,
+        const VkImageSubresourceRange & subresourceRange,
+        VkPipelineStageFlags dstStage,
+        VkAccessFlags dstAccess
+    )
+    {
+        VkImageMemoryBarrier barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.oldLayout = layout;
+        barrier.newLayout = layout;
+        barrier.subresourceRange = subresourceRange;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        if(!usesTransferQueue())
+        {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            return;
+        }
+
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        acquireStages |= dstStage;
+    }
+
+    // Submits the batch without waiting for it
+    void submit()
+    {
+        if(!recording)
+        {
+            throw std::logic_error("No upload batch is being recorded.");
+        }
+        recording = false;
+        submittedBatch = stagingRing.closeBatch();
+
+        VkSubmitInfo submitInfo {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        VkPipelineStageFlags waitStages {acquireStages != 0 ? acquireStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)};
+
+        if(usesTransferQueue())
+        {
+            vkEndCommandBuffer(transferCommands);
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &transferCommands;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &transferFinishedSemaphore;
+            if(vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to submit upload transfer commands.");
+            }
+
+            // The graphics commands wait for the transfers
+            submitInfo = {};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &transferFinishedSemaphore;
+            submitInfo.pWaitDstStageMask = &waitStages;
+        }
+
+        vkEndCommandBuffer(graphicsCommands);
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &graphicsCommands;
+        if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, uploadFinishedFence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to submit upload graphics commands.");
+        }
+        submitted = true;
+    }
+
+    // True if nothing is in flight
+    bool isComplete() const
+    {
+        return !submitted || vkGetFenceStatus(device, uploadFinishedFence) == VK_SUCCESS;
+    }
+
+    // Submits the batch, waits for it, and starts a new one, to make room in the staging ring
+    void flush()
+    {
+        submit();
+        wait();
+        begin();
+    }
+
+    // Waits for the submitted batch, then frees the staging ring regions it used
+    void wait()
+    {
+        if(!submitted)
+        {
+            return;
+        }
+
+        vkWaitForFences(device, 1, &uploadFinishedFence, VK_TRUE, UINT64_MAX);
+        vkResetFences(device, 1, &uploadFinishedFence);
+        submitted = false;
+
+        stagingRing.releaseBatch(submittedBatch);
+
+        vkResetCommandPool(device, graphicsCommandPool, 0);
+        if(usesTransferQueue())
+        {
+            vkResetCommandPool(device, transferCommandPool, 0);
+        }
+    }
+
+private:
+    // Satisfies the alignment of buffer to buffer copies on every device
+    static constexpr VkDeviceSize BUFFER_COPY_ALIGNMENT {16};
+
+    VkDevice device {VK_NULL_HANDLE};
+    VkBuffer stagingBuffer {VK_NULL_HANDLE};
+    StagingRing stagingRing;
+    VkExtent3D transferGranularity {1, 1, 1};
+    uint32_t transferFamily {0};
+    VkQueue transferQueue {VK_NULL_HANDLE};
+    uint32_t graphicsFamily {0};
+    VkQueue graphicsQueue {VK_NULL_HANDLE};
+
+    VkCommandPool transferCommandPool {VK_NULL_HANDLE};
+    VkCommandPool graphicsCommandPool {VK_NULL_HANDLE};
+    VkCommandBuffer transferCommands {VK_NULL_HANDLE};
+    VkCommandBuffer graphicsCommands {VK_NULL_HANDLE};
+    VkSemaphore transferFinishedSemaphore {VK_NULL_HANDLE};
+    VkFence uploadFinishedFence {VK_NULL_HANDLE};
+
+    // Stages at which the graphics queue acquires resources from the transfer queue
+    VkPipelineStageFlags acquireStages {0};
+    bool recording {false};
+    bool submitted {false};
+    uint64_t submittedBatch {0};
+
+    VkCommandPool createCommandPool(uint32_t queueFamily)
+    {
+        VkCommandPoolCreateInfo commandPoolCreateInfo {};
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolCreateInfo.queueFamilyIndex = queueFamily;
+
+        VkCommandPool commandPool;
+        if(vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create upload command pool.");
+        }
+        return commandPool;
+    }
+
+    VkCommandBuffer allocateCommandBuffer(VkCommandPool commandPool)
+    {
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo {};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandPool = commandPool;
+        commandBufferAllocateInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate upload command buffer.");
+        }
+        return commandBuffer;
+    }
+};
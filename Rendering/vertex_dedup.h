@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional> // for std::equal_to
+#include <stdexcept>
+
+// Welds identical vertices together, assigning each unique vertex an index.
+// Uses a flat open-addressing table (linear probing) of indices into the vertex array,
+// so a lookup touches one contiguous slot array instead of chasing linked list nodes.
+// Hash must return a well mixed 64-bit hash, and must be consistent with Equal.
+template<typename VertexType, typename Hash, typename Equal = std::equal_to<VertexType>>
+class VertexDeduplicator
+{
+public:
+    // Unique vertices are appended to vertices.
+    // expectedVertexCount is an upper bound of the unique vertices, e.g. the index count,
+    // so the table never has to grow.
+    VertexDeduplicator(std::vector<VertexType> & vertices, size_t expectedVertexCount, Hash hash = Hash {}, Equal equal = Equal {})
+        : vertices {vertices}, hash {hash}, equal {equal}
+    {
+        rebuild(expectedVertexCount);
+    }
+
+    // Returns the index of the vertex, adding it if it is new. Single lookup per call.
+    uint32_t insert(const VertexType & vertex)
+    {
+        // Keep the load factor at most 1/2
+        if(2 * (vertices.size() + 1) > slots.size())
+        {
+            rebuild(2 * vertices.size() + 1);
+        }
+
+        uint64_t vertexHash {hash(vertex)};
+        uint32_t tag {static_cast<uint32_t>(vertexHash >> 32)};
+        size_t slot {static_cast<size_t>(vertexHash) & mask};
+        while(true)
+        {
+            Slot & current {slots[slot]};
+            if(current.index == EMPTY_SLOT)
+            {
+                if(vertices.size() >= EMPTY_SLOT)
+                {
+                    throw std::length_error("Too many unique vertices for 32 bit indices.");
+                }
+                current.index = static_cast<uint32_t>(vertices.size());
+                current.tag = tag;
+                vertices.push_back(vertex);
+                return current.index;
+            }
+            // Compare the cached hash bits first, to skip most vertex comparisons
+            if(current.tag == tag && equal(vertices[current.index], vertex))
+            {
+                return current.index;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+private:
+    static constexpr uint32_t EMPTY_SLOT {UINT32_MAX};
+
+    struct Slot
+    {
+        uint32_t index {EMPTY_SLOT};
+        // High bits of the vertex hash
+        uint32_t tag {0};
+    };
+
+    std::vector<VertexType> & vertices;
+    Hash hash;
+    Equal equal;
+    std::vector<Slot> slots;
+    size_t mask {0};
+
+    // Resizes the table to hold vertexCount vertices, and reinserts the vertices already added
+    void rebuild(size_t vertexCount)
+    {
+        size_t capacity {16};
+        while(capacity < 2 * vertexCount)
+        {
+            capacity *= 2;
+        }
+        slots.assign(capacity, Slot {});
+        mask = capacity - 1;
+
+        for(size_t i {0}; i < vertices.size(); i++)
+        {
+            uint64_t vertexHash {hash(vertices[i])};
+            size_t slot {static_cast<size_t>(vertexHash) & mask};
+            while(slots[slot].index != EMPTY_SLOT)
+            {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot].index = static_cast<uint32_t>(i);
+            slots[slot].tag = static_cast<uint32_t>(vertexHash >> 32);
+        }
+    }
+};